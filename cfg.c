@@ -68,6 +68,10 @@
  *   convert it into a number with syntax checking
  *   check if its in a given range. As it uses cfg_get()
  *   internally, the evaluator is used here, too.
+ *
+ * cfg_get() and cfg_number() compile every entry only once,
+ * and evaluate it again only if a variable or function it
+ * depends on may have changed. Changing an entry drops both.
  * 
  */
 
@@ -95,6 +99,8 @@ typedef struct {
     char *key;
     char *val;
     int lock;
+    void *tree;			/* compiled value, or NULL */
+    RESULT *result;		/* last evaluated value */
 } ENTRY;
 
 
@@ -179,6 +185,21 @@ static int validchars(const char *string, const int numstart)
 }
 
 
+/* drop compiled and evaluated value of an entry */
+static void cfg_forget(ENTRY * entry)
+{
+    if (entry->tree != NULL) {
+	DelTree(entry->tree);
+	entry->tree = NULL;
+    }
+    if (entry->result != NULL) {
+	DelResult(entry->result);
+	free(entry->result);
+	entry->result = NULL;
+    }
+}
+
+
 static void cfg_add(const char *section, const char *key, const char *val, const int lock)
 {
     char *buffer;
@@ -206,6 +227,7 @@ static void cfg_add(const char *section, const char *key, const char *val, const
 	if (entry->val)
 	    free(entry->val);
 	entry->val = strdup(val);
+	cfg_forget(entry);
 	return;
     }
 
@@ -214,6 +236,8 @@ static void cfg_add(const char *section, const char *key, const char *val, const
     Config[nConfig - 1].key = buffer;
     Config[nConfig - 1].val = strdup(val);
     Config[nConfig - 1].lock = lock;
+    Config[nConfig - 1].tree = NULL;
+    Config[nConfig - 1].result = NULL;
 
     qsort(Config, nConfig, sizeof(ENTRY), c_sort);
 
@@ -334,7 +358,7 @@ int cfg_rename(const char *section, const char *old, const char *new)
 }
 
 
-static char *cfg_lookup(const char *section, const char *key)
+static ENTRY *cfg_entry(const char *section, const char *key)
 {
     int len;
     char *buffer;
@@ -362,6 +386,14 @@ static char *cfg_lookup(const char *section, const char *key)
     /* free buffer again */
     free(buffer);
 
+    return entry;
+}
+
+
+static char *cfg_lookup(const char *section, const char *key)
+{
+    ENTRY *entry = cfg_entry(section, key);
+
     if (entry != NULL)
 	return entry->val;
 
@@ -369,6 +401,39 @@ static char *cfg_lookup(const char *section, const char *key)
 }
 
 
+/* evaluate an entry, compile it on first use only */
+static RESULT *cfg_eval(ENTRY * entry)
+{
+    int ret;
+
+    if (entry->tree == NULL) {
+	if (Compile(entry->val, &entry->tree) != 0) {
+	    DelTree(entry->tree);
+	    entry->tree = NULL;
+	    return NULL;
+	}
+	/* the result is kept when an entry is compiled again */
+	if (entry->result == NULL)
+	    entry->result = calloc(1, sizeof(RESULT));
+    }
+
+    /* nothing the value depends on has changed */
+    if (entry->result->type != 0 && !EvalStale(entry->tree))
+	return entry->result;
+
+    ret = Eval(entry->tree, entry->result);
+
+    /* the entry has been read before all plugins registered their */
+    /* functions: compile it again next time instead of keeping "" */
+    if (EvalUnknown(entry->tree)) {
+	DelTree(entry->tree);
+	entry->tree = NULL;
+    }
+
+    return ret == 0 ? entry->result : NULL;
+}
+
+
 char *cfg_get_raw(const char *section, const char *key, const char *defval)
 {
     char *val = cfg_lookup(section, key);
@@ -382,24 +447,17 @@ char *cfg_get_raw(const char *section, const char *key, const char *defval)
 
 char *cfg_get(const char *section, const char *key, const char *defval)
 {
-    char *expression;
-    char *retval;
-    void *tree = NULL;
-    RESULT result = { 0, 0, 0, NULL };
+    ENTRY *entry;
+    RESULT *result;
 
-    expression = cfg_lookup(section, key);
+    entry = cfg_entry(section, key);
 
-    if (expression != NULL) {
-	if (*expression == '\0')
+    if (entry != NULL) {
+	if (*entry->val == '\0')
 	    return strdup("");
-	if (Compile(expression, &tree) == 0 && Eval(tree, &result) == 0) {
-	    retval = strdup(R2S(&result));
-	    DelTree(tree);
-	    DelResult(&result);
-	    return (retval);
+	if ((result = cfg_eval(entry)) != NULL) {
+	    return strdup(R2S(result));
 	}
-	DelTree(tree);
-	DelResult(&result);
     }
     if (defval)
 	return strdup(defval);
@@ -409,32 +467,23 @@ char *cfg_get(const char *section, const char *key, const char *defval)
 
 int cfg_number(const char *section, const char *key, const int defval, const int min, const int max, int *value)
 {
-    char *expression;
-    void *tree = NULL;
-    RESULT result = { 0, 0, 0, NULL };
+    ENTRY *entry;
+    RESULT *result;
 
     /* start with default value */
     /* in case of an (uncatched) error, you have the */
     /* default value set, which may be handy... */
     *value = defval;
 
-    expression = cfg_get_raw(section, key, NULL);
-    if (expression == NULL || *expression == '\0') {
+    entry = cfg_entry(section, key);
+    if (entry == NULL || *entry->val == '\0') {
 	return 0;
     }
 
-    if (Compile(expression, &tree) != 0) {
-	DelTree(tree);
-	return -1;
-    }
-    if (Eval(tree, &result) != 0) {
-	DelTree(tree);
-	DelResult(&result);
+    if ((result = cfg_eval(entry)) == NULL) {
 	return -1;
     }
-    *value = R2N(&result);
-    DelTree(tree);
-    DelResult(&result);
+    *value = R2N(result);
 
     if (*value < min) {
 	error("bad '%s.%s' value '%d' in %s, minimum is %d", section, key, *value, cfg_source(), min);
@@ -694,6 +743,7 @@ int cfg_exit(void)
 {
     int i;
     for (i = 0; i < nConfig; i++) {
+	cfg_forget(&Config[i]);
 	if (Config[i].key)
 	    free(Config[i].key);
 	if (Config[i].val)
@@ -649,9 +649,8 @@ int drv_G15_quit(const int quiet)
     DEBUG("generic_graphic_quit()");
     drv_generic_graphic_quit();
 
-    mutex_destroy(kb_mutex);
-    usleep(10 * 1000);
     thread_destroy(kb_thread_pid);
+    mutex_destroy(kb_mutex);
 
     drv_G15_closeUIDevice();
     DEBUG("closing UInputDev");
@@ -61,6 +61,8 @@ int YRES = 8;			/* pixel height of one char */
 
 
 void (*drv_generic_blit) () = NULL;
+void (*drv_generic_batch_begin) () = NULL;
+void (*drv_generic_batch_end) () = NULL;
 
 
 static void my_drows(RESULT * result)
@@ -38,6 +38,11 @@ extern int XRES, YRES;		/* pixel width/height of one char */
 /* these function must be implemented by the generic driver */
 extern void (*drv_generic_blit) (const int row, const int col, const int height, const int width);
 
+/* these functions may be implemented by the generic driver: */
+/* display updates between them are transferred at once at the end */
+extern void (*drv_generic_batch_begin) (void);
+extern void (*drv_generic_batch_end) (void);
+
 int drv_generic_init(void);
 
 #endif
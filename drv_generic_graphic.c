@@ -46,6 +46,10 @@
  * int drv_generic_graphic_quit (void);
  *   closes generic graphic driver
  *
+ * while the widgets of a timer group are processed, blits are
+ * collected and the union of the damaged regions is transferred
+ * with a single call to drv_generic_graphic_real_blit()
+ *
  */
 
 
@@ -102,6 +106,12 @@ static int INVERTED = 0;
 /* must be implemented by the real driver */
 void (*drv_generic_graphic_real_blit) () = NULL;
 
+/* nesting depth of display update batches */
+static int Batch = 0;
+
+/* bounding box of the region damaged during a batch */
+static int DamageRow, DamageCol, DamageHeight = 0, DamageWidth = 0;
+
 
 /****************************************/
 /*** generic Framebuffer stuff        ***/
@@ -180,11 +190,57 @@ static void drv_generic_graphic_blit(const int row, const int col, const int hei
 		drv_generic_graphic_window(col, width, DCOLS, &c, &w);
 		if (h > 0 && w > 0)
 		{
-			drv_generic_graphic_real_blit(r, c, h, w);
+			if (Batch == 0)
+			{
+				drv_generic_graphic_real_blit(r, c, h, w);
+			}
+			else if (DamageHeight == 0)
+			{
+				DamageRow = r;
+				DamageCol = c;
+				DamageHeight = h;
+				DamageWidth = w;
+			}
+			else
+			{
+				/* grow the damaged region */
+				int r2 = DamageRow + DamageHeight;
+				int c2 = DamageCol + DamageWidth;
+				if (r + h > r2)
+					r2 = r + h;
+				if (c + w > c2)
+					c2 = c + w;
+				if (r < DamageRow)
+					DamageRow = r;
+				if (c < DamageCol)
+					DamageCol = c;
+				DamageHeight = r2 - DamageRow;
+				DamageWidth = c2 - DamageCol;
+			}
 		}
 	}
 }
 
+/* widgets drawn from now on are rendered into the framebuffer only */
+static void drv_generic_graphic_batch_begin(void)
+{
+	Batch++;
+}
+
+/* transfer everything drawn during the batch with a single blit */
+static void drv_generic_graphic_batch_end(void)
+{
+	if (Batch == 0 || --Batch > 0)
+		return;
+
+	if (DamageHeight > 0 && drv_generic_graphic_real_blit)
+	{
+		drv_generic_graphic_real_blit(DamageRow, DamageCol, DamageHeight, DamageWidth);
+	}
+	DamageHeight = 0;
+	DamageWidth = 0;
+}
+
 static RGBA drv_generic_graphic_blend(const int row, const int col)
 {
 	int l, o;
@@ -746,6 +802,13 @@ int drv_generic_graphic_init(const char *section, const char *driver)
 	/* init generic driver & register plugins */
 	drv_generic_init();
 
+	/* let timer groups update the display in batches */
+	Batch = 0;
+	DamageHeight = 0;
+	DamageWidth = 0;
+	drv_generic_batch_begin = drv_generic_graphic_batch_begin;
+	drv_generic_batch_end = drv_generic_graphic_batch_end;
+
 	/* set default colors */
 	color = cfg_get(Section, "foreground", "000000ff");
 	if (color2RGBA(color, &FG_COL) < 0)
@@ -859,6 +922,8 @@ int drv_generic_graphic_quit(void)
 			drv_generic_graphic_FB[l] = NULL;
 		}
 	}
+	drv_generic_batch_begin = NULL;
+	drv_generic_batch_end = NULL;
 	widget_unregister();
 	return (0);
 }
@@ -40,6 +40,38 @@
  * int AddFunction (char *name, int argc, void (*func)())
  *   adds a function to the evaluator
  *
+ * int AddFunctionFlags (char *name, int argc, void (*func)(), int flags)
+ *   adds a function with flags: F_PURE functions depend on their
+ *   arguments only and are evaluated at compile time if possible,
+ *   F_STABLE functions return the same value during one tick.
+ *   Calls of both kinds are shared between all compiled expressions
+ *
+ * int AddFunctionTTL (char *name, int argc, void (*func)(), int flags, int ttl)
+ *   adds a function whose results are cached for ttl msec,
+ *   keyed by the values of its arguments
+ *
+ * int FunctionStats (char *name, unsigned long *hits, unsigned long *misses)
+ *   returns the cache statistics of a function
+ *
+ * void SetProfile (int enable)
+ *   measures wall time and result allocations of every function
+ *   call; calls are counted even if profiling is disabled
+ *
+ * void ProfileStart (PROFILE_CLOCK *clock)
+ * void ProfileStop (PROFILE_CLOCK *clock, PROFILE *profile)
+ *   accounts the cost of the code between them to 'profile'
+ *
+ * PROFILE *FunctionProfile (char *name)
+ *   returns the cost accounting of a function, or NULL
+ *
+ * void EachFunction (void (*callback)(name, profile, data), void *data)
+ *   calls 'callback' for every function
+ *
+ * void FreezeFunctions (void)
+ *   builds a perfect hash table of all functions added so far.
+ *   Adding a function drops the table, it is built again on the
+ *   next lookup; so call this after adding a bunch of functions
+ *
  * void DeleteVariables    (void);
  *   frees all allocated variables
  *
@@ -60,11 +92,39 @@
  *   converts a result into a string
  *
  *
+ * void SetBytecode (int enable)
+ *   compile expressions into bytecode (default) or
+ *   into a tree which is walked on every evaluation
+ *
+ * void EvalTick (void)
+ *   starts a new tick: shared calls will be evaluated again
+ *
+ * int NewTick (unsigned long *tick)
+ *   returns 1 once per tick for every 'tick' stamp, so a plugin
+ *   serving several cached functions reads its data source once
+ *
  * int Compile (char* expression, void **tree)
  *   compiles a expression into a tree
+ *   several threads may compile at the same time, as long
+ *   as SetVariable() or AddFunction() are not called meanwhile
  * 
  * int Eval (void *tree, RESULT *result)
- *   evaluates an expression
+ *   evaluates an expression, reusing the buffer of 'result'
+ *
+ * int EvalStale (void *tree)
+ *   checks if an expression has to be evaluated again:
+ *   returns 0 if no variable or data source it depends on
+ *   has changed since its last evaluation
+ *
+ * int EvalUnknown (void *tree)
+ *   returns the number of functions which were unknown when
+ *   the expression was compiled; they evaluate to "", so the
+ *   expression has to be compiled again once they are added
+ *
+ * int EvalBorrow (void *tree, RESULT **result)
+ *   evaluates an expression without copying the result:
+ *   the returned result belongs to the tree, it is valid
+ *   until the next evaluation and must not be freed
  *
  * void DelTree (void *tree)
  *   frees a compiled tree
@@ -79,8 +139,11 @@
 #include <ctype.h>
 #include <math.h>
 #include <setjmp.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "debug.h"
+#include "qprintf.h"
 #include "evaluator.h"
 
 #ifdef WITH_DMALLOC
@@ -90,6 +153,13 @@
 /* string buffer chunk size */
 #define CHUNK_SIZE 16
 
+/* hash buckets and maximum number of cached results per function */
+#define MEMO_SIZE 16
+#define MEMO_MAX 256
+
+/* maximum length of the argument values used as cache key */
+#define MEMO_KEY 256
+
 typedef enum {
     T_UNDEF,
     T_NAME,
@@ -140,15 +210,35 @@ typedef struct {
     OPERATOR op;
 } PATTERN;
 
-typedef struct {
+typedef struct _VARIABLE {
     char *name;
+    unsigned int hash;
+    unsigned long generation;	/* incremented on every change */
     RESULT *value;
+    struct _VARIABLE *next;
 } VARIABLE;
 
+/* memoized function result */
+typedef struct _MEMO {
+    char *key;			/* argument values */
+    unsigned int hash;
+    unsigned long tick;		/* tick of the call */
+    unsigned long stamp;	/* time of the call in msec */
+    RESULT value;
+    struct _MEMO *next;
+} MEMO;
+
 typedef struct {
     char *name;
     int argc;
+    int flags;
+    int ttl;			/* cache results for ttl msec */
     void (*func) ();
+    MEMO **memo;		/* hash buckets of cached results */
+    int nMemo;
+    unsigned long hits;
+    unsigned long misses;
+    PROFILE profile;
 } FUNCTION;
 
 typedef struct _NODE {
@@ -161,6 +251,105 @@ typedef struct _NODE {
     struct _NODE **Child;
 } NODE;
 
+/* bytecode instructions */
+typedef enum {
+    C_VAR,			/* copy variable: Dst = Variable */
+    C_SET,			/* store variable: Variable = A */
+    C_CALL,			/* function call: Dst = Function(Arg[A]...Arg[A+B-1]) */
+    C_OP1,			/* unary operator: Dst = Operator A */
+    C_OP2,			/* binary operator: Dst = A Operator B */
+    C_MOV,			/* alias register: Dst = A (no copy) */
+    C_BOOL,			/* logical value: Dst = (A != 0) */
+    C_NUM,			/* load number: Dst = Number */
+    C_JZ,			/* jump if A == 0 */
+    C_JNZ,			/* jump if A != 0 */
+    C_JMP,			/* unconditional jump */
+    C_SHARED			/* shared subexpression: Dst = Shared */
+} CODE;
+
+typedef struct _SHARED SHARED;
+
+/* how often a program has to run even if no dependency changed */
+typedef enum {
+    V_NEVER,			/* pure functions only */
+    V_TICK,			/* stable functions: once per tick */
+    V_ALWAYS			/* other functions or assignments */
+} VOLATILE;
+
+/* a variable or shared program a program depends on, */
+/* and its generation when the program did run */
+typedef struct {
+    VARIABLE *Variable;
+    SHARED *Shared;
+    unsigned long Generation;
+} DEPEND;
+
+typedef struct {
+    CODE Code;
+    OPERATOR Operator;
+    int Dst;
+    int A;
+    int B;
+    int Jump;
+    double Number;
+    VARIABLE *Variable;
+    FUNCTION *Function;
+    SHARED *Shared;
+} INSN;
+
+/* a compiled expression in bytecode form: a linear list of */
+/* instructions working on a flat array of result registers. */
+/* Constants live in preloaded registers and need no instruction, */
+/* operands are read through Ptr[] which may point directly */
+/* to a variable instead of a copy of it. */
+typedef struct {
+    int nCode;
+    INSN *Code;
+    int nReg;
+    RESULT *Reg;
+    RESULT **Ptr;
+    VARIABLE **Bind;
+    int nArg;
+    int *Arg;
+    int Result;
+    int Volatile;
+    int Valid;
+    unsigned long Tick;
+    int nDepend;
+    DEPEND *Depend;
+} PROGRAM;
+
+/* a subexpression built from constants and pure or stable */
+/* functions only. Identical subexpressions are compiled once */
+/* into a program of their own, which is run at most once per tick */
+struct _SHARED {
+    char *Key;
+    int Refs;
+    unsigned long Tick;
+    unsigned long Generation;	/* incremented whenever the result changes */
+    RESULT Last;
+    PROGRAM *Program;
+    SHARED *Next;
+};
+
+/* parser state */
+typedef struct {
+    char *Expression;
+    char *ExprPtr;
+    char *Word;
+    TOKEN Token;
+    OPERATOR Operator;
+    int Unknown;		/* calls of unknown functions */
+} PARSER;
+
+/* handle returned by Compile(): either a parse tree */
+/* for the tree walker, or a bytecode program */
+typedef struct {
+    NODE *Root;
+    PROGRAM *Program;
+    int Unknown;
+} EXPR;
+
 
 
 /* non-alphanumeric operators */
@@ -203,17 +392,52 @@ static PATTERN Pattern2[] = {
 };
 
 
-static char *Expression = NULL;
-static char *ExprPtr = NULL;
-static char *Word = NULL;
-static TOKEN Token = T_UNDEF;
-static OPERATOR Operator = O_UNDEF;
+/* Compile() may run in several threads at the same time: */
+/* the parser keeps its state in a PARSER of its own, and */
+/* the variable and shared expression tables are locked */
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
 
-static VARIABLE Variable[255];
+/* variables are allocated one by one and never move, */
+/* so compiled expressions can keep pointers to them */
+static VARIABLE **Variable = NULL;	/* hash buckets */
 static unsigned int nVariable = 0;
+static unsigned int sVariable = 0;	/* number of buckets, power of 2 */
 
-static FUNCTION *Function = NULL;
+/* the functions are allocated one by one and never move, */
+/* because compiled expressions point to them */
+static FUNCTION **Function = NULL;	/* sorted by name when frozen */
 static unsigned int nFunction = 0;
+static unsigned int sFunction = 0;
+
+/* perfect hash table of all functions, built by FreezeFunctions(): */
+/* a function lives in slot Hash(name, Disp[Hash(name, 0) % nDisp]) */
+static int Frozen = 0;
+static FUNCTION **Table = NULL;
+static unsigned int nTable = 0;		/* power of 2 */
+static unsigned short *Disp = NULL;
+static unsigned int nDisp = 0;		/* power of 2 */
+
+/* measure the cost of function calls */
+static int Profile = 0;
+
+/* number of heap allocated result buffers */
+static unsigned long Allocs = 0;
+
+/* registry statistics, in nsec */
+static unsigned long long AddTime = 0;
+static unsigned long long FreezeTime = 0;
+static unsigned long long FindTime = 0;
+static unsigned long nFind = 0;
+
+/* compile expressions into bytecode (default) or keep the parse tree */
+static int Bytecode = 1;
+
+/* shared subexpressions, hashed by their canonical form */
+#define SHARED_SIZE 64
+static SHARED *Shared[SHARED_SIZE];
+
+/* current tick */
+static unsigned long Tick = 0;
 
 
 /* strndup() may be not available on several platforms */
@@ -246,12 +470,21 @@ void DelResult(RESULT * result)
     result->size = 0;
     result->number = 0.0;
     if (result->string) {
-	free(result->string);
+	if (result->string != result->buffer)
+	    free(result->string);
 	result->string = NULL;
     }
 }
 
 
+/* set a result to none, but keep its string buffer */
+static inline void ClearResult(RESULT * result)
+{
+    result->type = 0;
+    result->number = 0.0;
+}
+
+
 static void FreeResult(RESULT * result)
 {
     if (result != NULL) {
@@ -277,35 +510,50 @@ static RESULT *NewResult(void)
 }
 
 
+/* make room for a string of 'len' characters */
+/* short strings use the inline buffer, longer ones */
+/* are allocated in multiples of CHUNK_SIZE. An existing */
+/* buffer is reused if it is large enough. */
+static char *Reserve(RESULT * result, const int len)
+{
+    if (result->string != NULL && len < result->size)
+	return result->string;
+
+    if (result->string != NULL && result->string != result->buffer)
+	free(result->string);
+
+    if (len < RESULT_INLINE) {
+	result->size = RESULT_INLINE;
+	result->string = result->buffer;
+    } else {
+	result->size = CHUNK_SIZE * ((len + 1) / CHUNK_SIZE + 1);
+	result->string = malloc(result->size);
+	/* results may be allocated by several compiler threads */
+	if (Profile)
+	    __atomic_fetch_add(&Allocs, 1, __ATOMIC_RELAXED);
+    }
+
+    return result->string;
+}
+
+
 RESULT *SetResult(RESULT ** result, const int type, const void *value)
 {
     if (*result == NULL) {
 	if ((*result = NewResult()) == NULL)
 	    return NULL;
-    } else if (type == R_NUMBER) {
-	DelResult(*result);
     }
 
     if (type == R_NUMBER) {
 	(*result)->type = R_NUMBER;
-	(*result)->size = 0;
 	(*result)->number = *(double *) value;
-	(*result)->string = NULL;
     }
 
     else if (type == R_STRING) {
 	int len = strlen((char *) value);
 	(*result)->type = R_STRING;
 	(*result)->number = 0.0;
-	if ((*result)->string == NULL || len >= (*result)->size) {
-	    /* buffer is either empty or too small */
-	    if ((*result)->string)
-		free((*result)->string);
-	    /* allocate memory in multiples of CHUNK_SIZE */
-	    (*result)->size = CHUNK_SIZE * ((len + 1) / CHUNK_SIZE + 1);
-	    (*result)->string = malloc((*result)->size);
-	}
-	strcpy((*result)->string, value);
+	memmove(Reserve(*result, len), value, len + 1);
     } else {
 	error("Evaluator: internal error: invalid result type %d", type);
 	return NULL;
@@ -322,24 +570,16 @@ RESULT *CopyResult(RESULT ** result, RESULT * value)
 	    return NULL;
     }
 
+    if (*result == value)
+	return *result;
+
     (*result)->type = value->type;
     (*result)->number = value->number;
 
-    if (value->string == NULL) {
-	(*result)->size = 0;
-	if ((*result)->string)
-	    free((*result)->string);
-	(*result)->string = NULL;
-    } else {
-	/* is buffer large enough? */
-	if ((*result)->string == NULL || value->size > (*result)->size) {
-	    if ((*result)->string)
-		free((*result)->string);
-	    (*result)->size = value->size;
-	    (*result)->string = malloc((*result)->size);
-	}
-	strcpy((*result)->string, value->string);
+    if (value->type & R_STRING) {
+	strcpy(Reserve(*result, strlen(value->string)), value->string);
     }
+
     return *result;
 }
 
@@ -387,11 +627,7 @@ char *R2S(RESULT * result)
 
     if (result->type & R_NUMBER) {
 	result->type |= R_STRING;
-	if (result->string)
-	    free(result->string);
-	result->size = CHUNK_SIZE;
-	result->string = malloc(result->size);
-	snprintf(result->string, result->size, "%g", result->number);
+	qgtoa(Reserve(result, RESULT_INLINE - 1), RESULT_INLINE, result->number);
 	return result->string;
     }
 
@@ -401,38 +637,111 @@ char *R2S(RESULT * result)
 }
 
 
+/* check if two results have the same value */
+static int SameResult(RESULT * a, RESULT * b)
+{
+    if (a->type & R_STRING && b->type & R_STRING)
+	return strcmp(a->string, b->string) == 0;
+    if (a->type & R_STRING || b->type & R_STRING)
+	return 0;
+    return a->type == b->type && a->number == b->number;
+}
+
+
+/* change a variable, programs depending on it will notice */
+static void StoreVariable(VARIABLE * V, RESULT * value)
+{
+    if (!SameResult(V->value, value)) {
+	CopyResult(&V->value, value);
+	V->generation++;
+    }
+}
+
+
+static unsigned int HashString(const char *key)
+{
+    unsigned int hash = 5381;
+
+    while (*key)
+	hash = hash * 33 + (unsigned char) *key++;
+
+    return hash;
+}
+
+
 static VARIABLE *FindVariable(const char *name)
 {
-    unsigned int i;
+    unsigned int hash;
+    VARIABLE *V;
+
+    if (nVariable == 0)
+	return NULL;
 
-    for (i = 0; i < nVariable; i++) {
-	if (strcmp(name, Variable[i].name) == 0) {
-	    return &Variable[i];
+    hash = HashString(name);
+    for (V = Variable[hash & (sVariable - 1)]; V != NULL; V = V->next) {
+	if (V->hash == hash && strcmp(name, V->name) == 0) {
+	    return V;
 	}
     }
     return NULL;
 }
 
 
+/* double the number of hash buckets */
+static int GrowVariables(void)
+{
+    unsigned int i, size;
+    VARIABLE **table, *V, *next;
+
+    size = sVariable ? 2 * sVariable : 64;
+    table = calloc(size, sizeof(VARIABLE *));
+    if (table == NULL)
+	return -1;
+
+    for (i = 0; i < sVariable; i++) {
+	for (V = Variable[i]; V != NULL; V = next) {
+	    next = V->next;
+	    V->next = table[V->hash & (size - 1)];
+	    table[V->hash & (size - 1)] = V;
+	}
+    }
+
+    free(Variable);
+    Variable = table;
+    sVariable = size;
+
+    return 0;
+}
+
+
 int SetVariable(const char *name, RESULT * value)
 {
     VARIABLE *V;
 
     V = FindVariable(name);
     if (V != NULL) {
-	CopyResult(&V->value, value);
+	StoreVariable(V, value);
 	return 1;
     }
 
-    if (nVariable >= sizeof(Variable) / sizeof(Variable[0])) {
-	error("Evaluator: cannot set variable <%s>: out of slots", name);
+    if (nVariable >= sVariable && GrowVariables() < 0) {
+	error("Evaluator: cannot set variable <%s>: out of memory!", name);
 	return -1;
     }
 
+    V = malloc(sizeof(VARIABLE));
+    if (V == NULL) {
+	error("Evaluator: cannot set variable <%s>: out of memory!", name);
+	return -1;
+    }
+    V->name = strdup(name);
+    V->hash = HashString(name);
+    V->generation = 0;
+    V->value = NULL;
+    CopyResult(&V->value, value);
+    V->next = Variable[V->hash & (sVariable - 1)];
+    Variable[V->hash & (sVariable - 1)] = V;
     nVariable++;
-    Variable[nVariable - 1].name = strdup(name);
-    Variable[nVariable - 1].value = NULL;
-    CopyResult(&Variable[nVariable - 1].value, value);
 
     return 0;
 }
@@ -440,7 +749,7 @@ int SetVariable(const char *name, RESULT * value)
 
 int SetVariableNumeric(const char *name, const double value)
 {
-    RESULT result = { 0, 0, 0, NULL };
+    RESULT result = { 0, 0, 0, NULL, "" };
     RESULT *rp = &result;
 
     SetResult(&rp, R_NUMBER, &value);
@@ -451,24 +760,81 @@ int SetVariableNumeric(const char *name, const double value)
 
 int SetVariableString(const char *name, const char *value)
 {
-    RESULT result = { 0, 0, 0, NULL };
+    int ret;
+    RESULT result = { 0, 0, 0, NULL, "" };
     RESULT *rp = &result;
 
     SetResult(&rp, R_STRING, value);
+    ret = SetVariable(name, rp);
+    DelResult(rp);
 
-    return SetVariable(name, rp);
+    return ret;
+}
+
+
+/* find or create a variable while compiling */
+static VARIABLE *BindVariable(const char *name)
+{
+    VARIABLE *V;
+
+    pthread_mutex_lock(&Lock);
+    V = FindVariable(name);
+    if (V == NULL) {
+	SetVariableString(name, "");
+	V = FindVariable(name);
+    }
+    pthread_mutex_unlock(&Lock);
+
+    return V;
 }
 
 
 void DeleteVariables(void)
 {
     unsigned int i;
-
-    for (i = 0; i < nVariable; i++) {
-	free(Variable[i].name);
-	FreeResult(Variable[i].value);
+    VARIABLE *V, *next;
+
+    for (i = 0; i < sVariable; i++) {
+	for (V = Variable[i]; V != NULL; V = next) {
+	    next = V->next;
+	    free(V->name);
+	    FreeResult(V->value);
+	    free(V);
+	}
     }
+    free(Variable);
+    Variable = NULL;
     nVariable = 0;
+    sVariable = 0;
+}
+
+
+/* monotonic time in nsec, for statistics */
+static unsigned long long Nsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+/* seeded FNV-1a with a final avalanche, */
+/* so that different seeds scatter the names differently */
+static unsigned int HashSeed(const char *key, const unsigned int seed)
+{
+    unsigned int h = 2166136261u ^ (seed * 0x9e3779b9u);
+
+    while (*key)
+	h = (h ^ (unsigned char) *key++) * 16777619u;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
 }
 
 
@@ -476,7 +842,7 @@ void DeleteVariables(void)
 static int LookupFunction(const void *a, const void *b)
 {
     char *n = (char *) a;
-    FUNCTION *f = (FUNCTION *) b;
+    FUNCTION *f = *(FUNCTION **) b;
 
     return strcmp(n, f->name);
 }
@@ -485,151 +851,532 @@ static int LookupFunction(const void *a, const void *b)
 /* qsort compare function for functions */
 static int SortFunction(const void *a, const void *b)
 {
-    FUNCTION *fa = (FUNCTION *) a;
-    FUNCTION *fb = (FUNCTION *) b;
+    FUNCTION *fa = *(FUNCTION **) a;
+    FUNCTION *fb = *(FUNCTION **) b;
 
     return strcmp(fa->name, fb->name);
 }
 
 
+/* hash and displace: place the largest buckets first, and for */
+/* every bucket search a seed which puts all of its functions */
+/* into free slots. Returns -1 if there is no such seed. */
+static int BuildTable(void)
+{
+    unsigned int *first, *member, *count;
+    unsigned int i, j, k, n, size, max, slot;
+    unsigned int d;
+
+    for (nTable = 8; nTable < 2 * nFunction; nTable *= 2);
+    nDisp = nTable / 4;
+
+    Table = calloc(nTable, sizeof(FUNCTION *));
+    Disp = calloc(nDisp, sizeof(unsigned short));
+
+    /* bucket k holds member[first[k]] ... member[first[k]+count[k]-1] */
+    count = calloc(nDisp, sizeof(unsigned int));
+    first = calloc(nDisp + 1, sizeof(unsigned int));
+    member = malloc(nFunction * sizeof(unsigned int));
+
+    for (i = 0; i < nFunction; i++) {
+	/* duplicate names: the first one wins, like bsearch() did */
+	if (i > 0 && strcmp(Function[i]->name, Function[i - 1]->name) == 0)
+	    continue;
+	count[HashSeed(Function[i]->name, 0) & (nDisp - 1)]++;
+    }
+    max = 0;
+    for (k = 0; k < nDisp; k++) {
+	first[k + 1] = first[k] + count[k];
+	if (count[k] > max)
+	    max = count[k];
+	count[k] = 0;
+    }
+    for (i = 0; i < nFunction; i++) {
+	if (i > 0 && strcmp(Function[i]->name, Function[i - 1]->name) == 0)
+	    continue;
+	k = HashSeed(Function[i]->name, 0) & (nDisp - 1);
+	member[first[k] + count[k]++] = i;
+    }
+
+    for (size = max; size > 0; size--) {
+	for (k = 0; k < nDisp; k++) {
+	    if (count[k] != size)
+		continue;
+	    for (d = 1; d < 65536; d++) {
+		for (n = 0; n < size; n++) {
+		    i = member[first[k] + n];
+		    slot = HashSeed(Function[i]->name, d) & (nTable - 1);
+		    if (Table[slot] != NULL)
+			break;
+		    Table[slot] = Function[i];
+		}
+		if (n == size)
+		    break;
+		/* collision: take this seed back */
+		for (j = 0; j < n; j++) {
+		    i = member[first[k] + j];
+		    Table[HashSeed(Function[i]->name, d) & (nTable - 1)] = NULL;
+		}
+	    }
+	    if (d == 65536) {
+		free(member);
+		free(first);
+		free(count);
+		return -1;
+	    }
+	    Disp[k] = d;
+	}
+    }
+
+    free(member);
+    free(first);
+    free(count);
+    return 0;
+}
+
+
+static void ThawFunctions(void)
+{
+    free(Table);
+    Table = NULL;
+    nTable = 0;
+    free(Disp);
+    Disp = NULL;
+    nDisp = 0;
+    Frozen = 0;
+}
+
+
+void FreezeFunctions(void)
+{
+    unsigned long long start = Nsec();
+
+    ThawFunctions();
+    Frozen = 1;
+
+    qsort(Function, nFunction, sizeof(FUNCTION *), SortFunction);
+
+    if (BuildTable() < 0) {
+	/* should never happen, bsearch() still works */
+	error("evaluator: cannot build function table, using binary search");
+	ThawFunctions();
+	Frozen = 1;
+    }
+
+    FreezeTime += Nsec() - start;
+    debug("%u functions registered in %llu usec, %u slot table built in %llu usec",
+	  nFunction, AddTime / 1000, nTable, FreezeTime / 1000);
+}
+
+
+/* called while parsing, possibly by several threads */
 static FUNCTION *FindFunction(const char *name)
 {
-    return bsearch(name, Function, nFunction, sizeof(FUNCTION), LookupFunction);
+    unsigned long long start;
+    FUNCTION **F, *f;
+
+    pthread_mutex_lock(&Lock);
+
+    start = Nsec();
+
+    /* functions have been added since the last freeze */
+    if (!Frozen)
+	FreezeFunctions();
+
+    if (Table != NULL) {
+	f = Table[HashSeed(name, Disp[HashSeed(name, 0) & (nDisp - 1)]) & (nTable - 1)];
+	if (f != NULL && strcmp(f->name, name) != 0)
+	    f = NULL;
+    } else {
+	F = bsearch(name, Function, nFunction, sizeof(FUNCTION *), LookupFunction);
+	f = F ? *F : NULL;
+    }
+
+    FindTime += Nsec() - start;
+    nFind++;
+
+    pthread_mutex_unlock(&Lock);
+
+    return f;
+}
+
+
+int AddFunctionTTL(const char *name, const int argc, void (*func) (), const int flags, const int ttl)
+{
+    unsigned long long start = Nsec();
+    FUNCTION *F;
+
+    F = malloc(sizeof(FUNCTION));
+    F->name = strdup(name);
+    F->argc = argc;
+    F->flags = flags;
+    F->ttl = ttl;
+    F->func = func;
+    F->memo = NULL;
+    F->nMemo = 0;
+    F->hits = 0;
+    F->misses = 0;
+    memset(&F->profile, 0, sizeof(PROFILE));
+
+    /* just append, FreezeFunctions() sorts and hashes once */
+    if (nFunction >= sFunction) {
+	sFunction = sFunction ? 2 * sFunction : 64;
+	Function = realloc(Function, sFunction * sizeof(FUNCTION *));
+    }
+    Function[nFunction++] = F;
+
+    if (Frozen)
+	ThawFunctions();
+
+    AddTime += Nsec() - start;
+
+    return 0;
+}
+
+
+int AddFunctionFlags(const char *name, const int argc, void (*func) (), const int flags)
+{
+    return AddFunctionTTL(name, argc, func, flags, 0);
 }
 
 
 int AddFunction(const char *name, const int argc, void (*func) ())
 {
-    nFunction++;
-    Function = realloc(Function, nFunction * sizeof(FUNCTION));
-    Function[nFunction - 1].name = strdup(name);
-    Function[nFunction - 1].argc = argc;
-    Function[nFunction - 1].func = func;
+    return AddFunctionFlags(name, argc, func, 0);
+}
+
+
+int FunctionStats(const char *name, unsigned long *hits, unsigned long *misses)
+{
+    FUNCTION *F = FindFunction(name);
 
-    qsort(Function, nFunction, sizeof(FUNCTION), SortFunction);
+    if (F == NULL)
+	return -1;
+
+    *hits = F->hits;
+    *misses = F->misses;
 
     return 0;
 }
 
 
+static void FlushMemo(FUNCTION * F)
+{
+    MEMO *M, *next;
+    int i;
+
+    if (F->memo == NULL)
+	return;
+
+    for (i = 0; i < MEMO_SIZE; i++) {
+	for (M = F->memo[i]; M != NULL; M = next) {
+	    next = M->next;
+	    free(M->key);
+	    DelResult(&M->value);
+	    free(M);
+	}
+    }
+    free(F->memo);
+    F->memo = NULL;
+    F->nMemo = 0;
+}
+
+
 void DeleteFunctions(void)
 {
     unsigned int i;
 
     for (i = 0; i < nFunction; i++) {
-	free(Function[i].name);
+	FUNCTION *F = Function[i];
+	if (F->hits + F->misses > 0)
+	    debug("function %s(): %lu cache hits, %lu misses", F->name, F->hits, F->misses);
+	FlushMemo(F);
+	free(F->name);
+	free(F);
     }
+    if (nFind > 0)
+	debug("%lu function lookups in %llu usec", nFind, FindTime / 1000);
     free(Function);
     Function = NULL;
     nFunction = 0;
+    sFunction = 0;
+    ThawFunctions();
 }
 
 
-#define is_space(c)  ((c) == ' ' || (c) == '\t')
-#define is_digit(c)  ((c) >= '0' && (c) <= '9')
-#define is_alpha(c) (((c) >= 'A' && (c) <= 'Z') || ((c) >= 'a' && (c) <= 'z') || ((c) == '_'))
-#define is_alnum(c) (is_alpha(c) || is_digit(c))
-
-static void Parse(void)
+void SetProfile(const int enable)
 {
-    Token = T_UNDEF;
-    Operator = O_UNDEF;
+    Profile = enable;
+}
 
-    if (Word) {
-	free(Word);
-	Word = NULL;
-    }
 
-    /* NULL expression? */
-    if (ExprPtr == NULL) {
-	Word = strdup("");
+void ProfileStart(PROFILE_CLOCK * clock)
+{
+    if (!Profile) {
+	clock->start = 0;
 	return;
     }
 
-    /* skip leading whitespace */
-    while (is_space(*ExprPtr))
-	ExprPtr++;
+    clock->start = Nsec();
+    clock->allocs = __atomic_load_n(&Allocs, __ATOMIC_RELAXED);
+}
 
-    /* names */
-    if (is_alpha(*ExprPtr)) {
-	int i;
-	char *start = ExprPtr;
-	while (is_alnum(*ExprPtr))
-	    ExprPtr++;
-	if (*ExprPtr == ':' && *(ExprPtr + 1) == ':' && is_alpha(*(ExprPtr + 2))) {
-	    ExprPtr += 3;
-	    while (is_alnum(*ExprPtr))
-		ExprPtr++;
-	}
-	Word = strndup(start, ExprPtr - start);
-	Token = T_NAME;
 
-	/* check for alphanumeric operators */
-	for (i = sizeof(Pattern2) / sizeof(Pattern2[0]) - 1; i >= 0; i--) {
-	    if (strcmp(Word, Pattern2[i].pattern) == 0) {
-		Token = T_OPERATOR;
-		Operator = Pattern2[i].op;
-		break;
-	    }
-	}
+void ProfileStop(PROFILE_CLOCK * clock, PROFILE * profile)
+{
+    unsigned long long time;
 
-    }
+    profile->calls++;
 
-    /* numbers */
-    else if (is_digit(*ExprPtr) || (*ExprPtr == '.' && is_digit(*(ExprPtr + 1)))) {
-	char *start = ExprPtr;
-	while (is_digit(*ExprPtr))
-	    ExprPtr++;
-	if (*ExprPtr == '.') {
-	    ExprPtr++;
-	    while (is_digit(*ExprPtr))
-		ExprPtr++;
-	}
-	Word = strndup(start, ExprPtr - start);
-	Token = T_NUMBER;
+    if (clock->start == 0)
+	return;
+
+    time = Nsec() - clock->start;
+    profile->time += time;
+    if (time > profile->max)
+	profile->max = time;
+    profile->allocs += __atomic_load_n(&Allocs, __ATOMIC_RELAXED) - clock->allocs;
+}
+
+
+PROFILE *FunctionProfile(const char *name)
+{
+    FUNCTION *F = FindFunction(name);
+
+    return F ? &F->profile : NULL;
+}
+
+
+void EachFunction(void (*callback) (const char *name, PROFILE * profile, void *data), void *data)
+{
+    unsigned int i;
+
+    for (i = 0; i < nFunction; i++) {
+	callback(Function[i]->name, &Function[i]->profile, data);
     }
+}
 
-    /* strings */
-    else if (*ExprPtr == '\'') {
-	size_t length = 0;
-	size_t size = CHUNK_SIZE;
-	Word = malloc(size);
-	ExprPtr++;
-	while (*ExprPtr != '\0' && *ExprPtr != '\'') {
-	    if (*ExprPtr == '\\') {
-		switch (*(ExprPtr + 1)) {
-		case '\\':
-		case '\'':
-		    Word[length++] = *(ExprPtr + 1);
-		    ExprPtr += 2;
-		    break;
-		case 'a':
-		    Word[length++] = '\a';
-		    ExprPtr += 2;
-		    break;
-		case 'b':
-		    Word[length++] = '\b';
-		    ExprPtr += 2;
-		    break;
+
+/* current (monotonic) time in msec */
+static unsigned long Now(void)
+{
+    return Nsec() / 1000000;
+}
+
+
+/* a cached result is valid for ttl msec, */
+/* and during the whole tick for F_STABLE functions */
+static int Fresh(FUNCTION * F, MEMO * M, const unsigned long now)
+{
+    if ((F->flags & F_STABLE) && M->tick == Tick)
+	return 1;
+    return now - M->stamp < (unsigned long) F->ttl;
+}
+
+
+/* build the cache key from the argument values */
+static int MemoKey(char *key, const int argc, RESULT * param[])
+{
+    int i, len, n;
+
+    len = 0;
+    for (i = 0; i < argc; i++) {
+	n = strlen(R2S(param[i]));
+	if (len + n + 1 >= MEMO_KEY)
+	    return -1;
+	memcpy(key + len, param[i]->string, n);
+	len += n;
+	/* unit separator */
+	key[len++] = '\037';
+    }
+    key[len] = '\0';
+
+    return len;
+}
+
+
+static void Invoke(FUNCTION * F, RESULT * result, const int argc, RESULT * param[])
+{
+    PROFILE_CLOCK clock;
+
+    ProfileStart(&clock);
+
+    if (F->argc < 0) {
+	/* Function with variable argument list:  */
+	/* pass number of arguments as first parameter */
+	F->func(result, argc, param);
+    } else {
+	F->func(result, param[0], param[1], param[2], param[3], param[4], param[5], param[6], param[7], param[8],
+		param[9]);
+    }
+
+    ProfileStop(&clock, &F->profile);
+}
+
+
+/* call a function, or take its result from the cache */
+static void CallFunction(FUNCTION * F, RESULT * result, const int argc, RESULT * param[])
+{
+    char key[MEMO_KEY];
+    unsigned int hash;
+    unsigned long now;
+    MEMO *M, **prev;
+    RESULT *R;
+
+    ClearResult(result);
+
+    if (F->ttl <= 0 || MemoKey(key, argc, param) < 0) {
+	Invoke(F, result, argc, param);
+	return;
+    }
+
+    hash = HashString(key);
+    now = Now();
+
+    if (F->memo == NULL)
+	F->memo = calloc(MEMO_SIZE, sizeof(MEMO *));
+
+    for (prev = &F->memo[hash % MEMO_SIZE]; (M = *prev) != NULL; prev = &M->next) {
+	if (M->hash == hash && strcmp(M->key, key) == 0)
+	    break;
+    }
+
+    if (M != NULL && Fresh(F, M, now)) {
+	F->hits++;
+	CopyResult(&result, &M->value);
+	return;
+    }
+
+    F->misses++;
+    Invoke(F, result, argc, param);
+
+    if (M == NULL) {
+	/* too many different arguments: start over */
+	if (F->nMemo >= MEMO_MAX) {
+	    FlushMemo(F);
+	    F->memo = calloc(MEMO_SIZE, sizeof(MEMO *));
+	    prev = &F->memo[hash % MEMO_SIZE];
+	}
+	M = calloc(1, sizeof(MEMO));
+	M->key = strdup(key);
+	M->hash = hash;
+	M->next = NULL;
+	*prev = M;
+	F->nMemo++;
+    }
+
+    M->tick = Tick;
+    M->stamp = now;
+    R = &M->value;
+    CopyResult(&R, result);
+}
+
+
+#define is_space(c)  ((c) == ' ' || (c) == '\t')
+#define is_digit(c)  ((c) >= '0' && (c) <= '9')
+#define is_alpha(c) (((c) >= 'A' && (c) <= 'Z') || ((c) >= 'a' && (c) <= 'z') || ((c) == '_'))
+#define is_alnum(c) (is_alpha(c) || is_digit(c))
+
+static void Parse(PARSER * P)
+{
+    P->Token = T_UNDEF;
+    P->Operator = O_UNDEF;
+
+    if (P->Word) {
+	free(P->Word);
+	P->Word = NULL;
+    }
+
+    /* NULL expression? */
+    if (P->ExprPtr == NULL) {
+	P->Word = strdup("");
+	return;
+    }
+
+    /* skip leading whitespace */
+    while (is_space(*P->ExprPtr))
+	P->ExprPtr++;
+
+    /* names */
+    if (is_alpha(*P->ExprPtr)) {
+	int i;
+	char *start = P->ExprPtr;
+	while (is_alnum(*P->ExprPtr))
+	    P->ExprPtr++;
+	if (*P->ExprPtr == ':' && *(P->ExprPtr + 1) == ':' && is_alpha(*(P->ExprPtr + 2))) {
+	    P->ExprPtr += 3;
+	    while (is_alnum(*P->ExprPtr))
+		P->ExprPtr++;
+	}
+	P->Word = strndup(start, P->ExprPtr - start);
+	P->Token = T_NAME;
+
+	/* check for alphanumeric operators */
+	for (i = sizeof(Pattern2) / sizeof(Pattern2[0]) - 1; i >= 0; i--) {
+	    if (strcmp(P->Word, Pattern2[i].pattern) == 0) {
+		P->Token = T_OPERATOR;
+		P->Operator = Pattern2[i].op;
+		break;
+	    }
+	}
+
+    }
+
+    /* numbers */
+    else if (is_digit(*P->ExprPtr) || (*P->ExprPtr == '.' && is_digit(*(P->ExprPtr + 1)))) {
+	char *start = P->ExprPtr;
+	while (is_digit(*P->ExprPtr))
+	    P->ExprPtr++;
+	if (*P->ExprPtr == '.') {
+	    P->ExprPtr++;
+	    while (is_digit(*P->ExprPtr))
+		P->ExprPtr++;
+	}
+	P->Word = strndup(start, P->ExprPtr - start);
+	P->Token = T_NUMBER;
+    }
+
+    /* strings */
+    else if (*P->ExprPtr == '\'') {
+	size_t length = 0;
+	size_t size = CHUNK_SIZE;
+	P->Word = malloc(size);
+	P->ExprPtr++;
+	while (*P->ExprPtr != '\0' && *P->ExprPtr != '\'') {
+	    if (*P->ExprPtr == '\\') {
+		switch (*(P->ExprPtr + 1)) {
+		case '\\':
+		case '\'':
+		    P->Word[length++] = *(P->ExprPtr + 1);
+		    P->ExprPtr += 2;
+		    break;
+		case 'a':
+		    P->Word[length++] = '\a';
+		    P->ExprPtr += 2;
+		    break;
+		case 'b':
+		    P->Word[length++] = '\b';
+		    P->ExprPtr += 2;
+		    break;
 		case 't':
-		    Word[length++] = '\t';
-		    ExprPtr += 2;
+		    P->Word[length++] = '\t';
+		    P->ExprPtr += 2;
 		    break;
 		case 'n':
-		    Word[length++] = '\n';
-		    ExprPtr += 2;
+		    P->Word[length++] = '\n';
+		    P->ExprPtr += 2;
 		    break;
 		case 'v':
-		    Word[length++] = '\v';
-		    ExprPtr += 2;
+		    P->Word[length++] = '\v';
+		    P->ExprPtr += 2;
 		    break;
 		case 'f':
-		    Word[length++] = '\f';
-		    ExprPtr += 2;
+		    P->Word[length++] = '\f';
+		    P->ExprPtr += 2;
 		    break;
 		case 'r':
-		    Word[length++] = '\r';
-		    ExprPtr += 2;
+		    P->Word[length++] = '\r';
+		    P->ExprPtr += 2;
 		    break;
 		case 'x':
 		    {
@@ -638,7 +1385,7 @@ static void Parse(void)
 			int hex[2];
 
 			for (i = 0; i < 2; i++) {
-			    hexC = *(ExprPtr + 2 + i);
+			    hexC = *(P->ExprPtr + 2 + i);
 			    if (hexC >= '0' && hexC <= '9')
 				hex[i] = hexC - '0';
 			    else if (hexC >= 'a' && hexC <= 'f')
@@ -650,21 +1397,21 @@ static void Parse(void)
 			}
 			switch (i) {
 			case 1:
-			    Word[length] = hex[0];
-			    ExprPtr += 3;
+			    P->Word[length] = hex[0];
+			    P->ExprPtr += 3;
 			    break;
 			case 2:
-			    Word[length] = hex[0] * 16 + hex[1];
-			    ExprPtr += 4;
+			    P->Word[length] = hex[0] * 16 + hex[1];
+			    P->ExprPtr += 4;
 			    break;
 			default:
 			    error("Evaluator: Illegal hex sequence '\\x%c' in <%s> keeps unchanged.",
-				  *(ExprPtr + 2), Expression);
-			    Word[length] = '\\';
-			    ExprPtr += 1;
+				  *(P->ExprPtr + 2), P->Expression);
+			    P->Word[length] = '\\';
+			    P->ExprPtr += 1;
 			}
-			if (Word[length] == 0)
-			    error("Evaluator: Null character(s) in <%s> will be ignored.", Expression);
+			if (P->Word[length] == 0)
+			    error("Evaluator: Null character(s) in <%s> will be ignored.", P->Expression);
 			else
 			    length++;
 		    }
@@ -673,35 +1420,35 @@ static void Parse(void)
 		case '1':
 		case '2':
 		case '3':
-		    if (*(ExprPtr + 2) >= '0' && *(ExprPtr + 2) <= '7' &&
-			*(ExprPtr + 3) >= '0' && *(ExprPtr + 3) <= '7') {
-			Word[length++] =
-			    (*(ExprPtr + 1) - '0') * 64 + (*(ExprPtr + 2) - '0') * 8 + (*(ExprPtr + 3) - '0');
-			ExprPtr += 4;
+		    if (*(P->ExprPtr + 2) >= '0' && *(P->ExprPtr + 2) <= '7' &&
+			*(P->ExprPtr + 3) >= '0' && *(P->ExprPtr + 3) <= '7') {
+			P->Word[length++] =
+			    (*(P->ExprPtr + 1) - '0') * 64 + (*(P->ExprPtr + 2) - '0') * 8 + (*(P->ExprPtr + 3) - '0');
+			P->ExprPtr += 4;
 		    } else {
 			error("Evaluator: illegal octal sequence '\\%c%c%c' in <%s>",
-			      *(ExprPtr + 1), *(ExprPtr + 2), *(ExprPtr + 3), Expression);
-			Word[length++] = *ExprPtr++;
+			      *(P->ExprPtr + 1), *(P->ExprPtr + 2), *(P->ExprPtr + 3), P->Expression);
+			P->Word[length++] = *P->ExprPtr++;
 		    }
 		    break;
 		default:
-		    error("Evaluator: unknown escape sequence '\\%c' in <%s>", *(ExprPtr + 1), Expression);
-		    Word[length++] = *ExprPtr++;
+		    error("Evaluator: unknown escape sequence '\\%c' in <%s>", *(P->ExprPtr + 1), P->Expression);
+		    P->Word[length++] = *P->ExprPtr++;
 		}
 	    } else {
-		Word[length++] = *ExprPtr++;
+		P->Word[length++] = *P->ExprPtr++;
 	    }
 	    if (length >= size) {
 		size += CHUNK_SIZE;
-		Word = realloc(Word, size);
+		P->Word = realloc(P->Word, size);
 	    }
 	}
-	Word[length] = '\0';
-	Token = T_STRING;
-	if (*ExprPtr == '\'') {
-	    ExprPtr++;
+	P->Word[length] = '\0';
+	P->Token = T_STRING;
+	if (*P->ExprPtr == '\'') {
+	    P->ExprPtr++;
 	} else {
-	    error("Evaluator: unterminated string in <%s>", Expression);
+	    error("Evaluator: unterminated string in <%s>", P->Expression);
 	}
     }
 
@@ -710,32 +1457,32 @@ static void Parse(void)
 	int i;
 	for (i = sizeof(Pattern1) / sizeof(Pattern1[0]) - 1; i >= 0; i--) {
 	    int len = Pattern1[i].len;
-	    if (strncmp(ExprPtr, Pattern1[i].pattern, Pattern1[i].len) == 0) {
-		Word = strndup(ExprPtr, len);
-		Token = T_OPERATOR;
-		Operator = Pattern1[i].op;
-		ExprPtr += len;
+	    if (strncmp(P->ExprPtr, Pattern1[i].pattern, Pattern1[i].len) == 0) {
+		P->Word = strndup(P->ExprPtr, len);
+		P->Token = T_OPERATOR;
+		P->Operator = Pattern1[i].op;
+		P->ExprPtr += len;
 		break;
 	    }
 	}
     }
 
     /* syntax check */
-    if (Token == T_UNDEF && *ExprPtr != '\0') {
-	error("Evaluator: parse error in <%s>: garbage <%s>", Expression, ExprPtr);
+    if (P->Token == T_UNDEF && *P->ExprPtr != '\0') {
+	error("Evaluator: parse error in <%s>: garbage <%s>", P->Expression, P->ExprPtr);
     }
 
     /* skip trailing whitespace */
-    while (is_space(*ExprPtr))
-	ExprPtr++;
+    while (is_space(*P->ExprPtr))
+	P->ExprPtr++;
 
     /* empty token */
-    if (Word == NULL)
-	Word = strdup("");
+    if (P->Word == NULL)
+	P->Word = strdup("");
 }
 
 
-static NODE *NewNode(NODE * Child)
+static NODE *NewNode(PARSER * P, NODE * Child)
 {
     NODE *N;
 
@@ -744,8 +1491,8 @@ static NODE *NewNode(NODE * Child)
 	return NULL;
 
     memset(N, 0, sizeof(NODE));
-    N->Token = Token;
-    N->Operator = Operator;
+    N->Token = P->Token;
+    N->Operator = P->Operator;
 
     if (Child != NULL) {
 	N->Children = 1;
@@ -758,11 +1505,11 @@ static NODE *NewNode(NODE * Child)
 }
 
 
-static NODE *JunkNode(void)
+static NODE *JunkNode(PARSER * P)
 {
     NODE *Junk;
 
-    Junk = NewNode(NULL);
+    Junk = NewNode(P, NULL);
     Junk->Token = T_STRING;
     SetResult(&Junk->Result, R_STRING, "");
 
@@ -784,120 +1531,117 @@ static void LinkNode(NODE * Root, NODE * Child)
 
 
 /* forward declaration */
-static NODE *Level01(void);
+static NODE *Level01(PARSER * P);
 
 
 /* literal numbers, variables, functions */
-static NODE *Level12(void)
+static NODE *Level12(PARSER * P)
 {
     NODE *Root = NULL;
 
-    if (Token == T_OPERATOR && Operator == O_BRO) {
-	Parse();
-	Root = Level01();
-	if (Token != T_OPERATOR || Operator != O_BRC) {
-	    error("Evaluator: unbalanced parentheses in <%s>", Expression);
-	    LinkNode(Root, JunkNode());
+    if (P->Token == T_OPERATOR && P->Operator == O_BRO) {
+	Parse(P);
+	Root = Level01(P);
+	if (P->Token != T_OPERATOR || P->Operator != O_BRC) {
+	    error("Evaluator: unbalanced parentheses in <%s>", P->Expression);
+	    LinkNode(Root, JunkNode(P));
 	}
     }
 
-    else if (Token == T_NUMBER) {
-	double value = atof(Word);
-	Root = NewNode(NULL);
+    else if (P->Token == T_NUMBER) {
+	double value = atof(P->Word);
+	Root = NewNode(P, NULL);
 	SetResult(&Root->Result, R_NUMBER, &value);
     }
 
-    else if (Token == T_STRING) {
-	Root = NewNode(NULL);
-	SetResult(&Root->Result, R_STRING, Word);
+    else if (P->Token == T_STRING) {
+	Root = NewNode(P, NULL);
+	SetResult(&Root->Result, R_STRING, P->Word);
     }
 
-    else if (Token == T_NAME) {
+    else if (P->Token == T_NAME) {
 
 	/* look-ahead for opening brace */
-	if (*ExprPtr == '(') {
+	if (*P->ExprPtr == '(') {
 	    int argc = 0;
-	    Root = NewNode(NULL);
+	    Root = NewNode(P, NULL);
 	    Root->Token = T_FUNCTION;
 	    Root->Result = NewResult();
-	    Root->Function = FindFunction(Word);
+	    Root->Function = FindFunction(P->Word);
 	    if (Root->Function == NULL) {
-		error("Evaluator: unknown function '%s' in <%s>", Word, Expression);
+		error("Evaluator: unknown function '%s' in <%s>", P->Word, P->Expression);
+		P->Unknown++;
 		Root->Token = T_STRING;
 		SetResult(&Root->Result, R_STRING, "");
 	    }
 
 	    /* opening brace */
-	    Parse();
+	    Parse(P);
 	    do {
-		Parse();	/* read argument */
-		if (Token == T_OPERATOR && Operator == O_BRC) {
+		Parse(P);	/* read argument */
+		if (P->Token == T_OPERATOR && P->Operator == O_BRC) {
 		    break;
-		} else if (Token == T_OPERATOR && Operator == O_COM) {
-		    error("Evaluator: empty argument in <%s>", Expression);
-		    LinkNode(Root, JunkNode());
+		} else if (P->Token == T_OPERATOR && P->Operator == O_COM) {
+		    error("Evaluator: empty argument in <%s>", P->Expression);
+		    LinkNode(Root, JunkNode(P));
 		} else {
-		    LinkNode(Root, Level01());
+		    LinkNode(Root, Level01(P));
 		}
 		argc++;
-	    } while (Token == T_OPERATOR && Operator == O_COM);
+	    } while (P->Token == T_OPERATOR && P->Operator == O_COM);
 
 	    /* check for closing brace */
-	    if (Token != T_OPERATOR || Operator != O_BRC) {
-		error("Evaluator: missing closing brace in <%s>", Expression);
+	    if (P->Token != T_OPERATOR || P->Operator != O_BRC) {
+		error("Evaluator: missing closing brace in <%s>", P->Expression);
 	    }
 
 	    /* check number of arguments */
 	    if (Root->Function != NULL && Root->Function->argc >= 0 && Root->Function->argc != argc) {
-		error("Evaluator: wrong number of arguments in <%s>", Expression);
+		error("Evaluator: wrong number of arguments in <%s>", P->Expression);
 		while (argc < Root->Function->argc) {
-		    LinkNode(Root, JunkNode());
+		    LinkNode(Root, JunkNode(P));
 		    argc++;
 		}
 	    }
 
 	} else {
-	    Root = NewNode(NULL);
+	    Root = NewNode(P, NULL);
 	    Root->Token = T_VARIABLE;
 	    Root->Result = NewResult();
-	    Root->Variable = FindVariable(Word);
-	    if (Root->Variable == NULL) {
-		SetVariableString(Word, "");
-		Root->Variable = FindVariable(Word);
-	    }
+	    Root->Variable = BindVariable(P->Word);
 	}
     }
 
     else {
-	error("Evaluator: syntax error in <%s>: <%s>", Expression, Word);
-	Root = NewNode(NULL);
+	error("Evaluator: syntax error in <%s>: <%s>", P->Expression, P->Word);
+	Root = NewNode(P, NULL);
 	Root->Token = T_STRING;
 	SetResult(&Root->Result, R_STRING, "");
     }
 
-    Parse();
+    Parse(P);
     return Root;
 
 }
 
 
 /* unary + or - signs or logical 'not' */
-static NODE *Level11(void)
+static NODE *Level11(PARSER * P)
 {
     NODE *Root;
     OPERATOR sign = O_UNDEF;
 
-    if (Token == T_OPERATOR && (Operator == O_ADD || Operator == O_SUB || Operator == O_NOT)) {
-	sign = Operator;
+    if (P->Token == T_OPERATOR && (P->Operator == O_ADD || P->Operator == O_SUB || P->Operator == O_NOT)) {
+	sign = P->Operator;
 	if (sign == O_SUB)
 	    sign = O_SGN;
-	Parse();
+	Parse(P);
     }
 
-    Root = Level12();
+    Root = Level12(P);
 
     if (sign == O_SGN || sign == O_NOT) {
-	Root = NewNode(Root);
+	Root = NewNode(P, Root);
 	Root->Token = T_OPERATOR;
 	Root->Operator = sign;
     }
@@ -907,16 +1651,16 @@ static NODE *Level11(void)
 
 
 /* x^y */
-static NODE *Level10(void)
+static NODE *Level10(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level11();
+    Root = Level11(P);
 
-    while (Token == T_OPERATOR && Operator == O_POW) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level11());
+    while (P->Token == T_OPERATOR && P->Operator == O_POW) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level11(P));
     }
 
     return Root;
@@ -924,16 +1668,16 @@ static NODE *Level10(void)
 
 
 /* multiplication, division, modulo */
-static NODE *Level09(void)
+static NODE *Level09(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level10();
+    Root = Level10(P);
 
-    while (Token == T_OPERATOR && (Operator == O_MUL || Operator == O_DIV || Operator == O_MOD)) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level10());
+    while (P->Token == T_OPERATOR && (P->Operator == O_MUL || P->Operator == O_DIV || P->Operator == O_MOD)) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level10(P));
     }
 
     return Root;
@@ -941,16 +1685,16 @@ static NODE *Level09(void)
 
 
 /* addition, subtraction, string concatenation */
-static NODE *Level08(void)
+static NODE *Level08(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level09();
+    Root = Level09(P);
 
-    while (Token == T_OPERATOR && (Operator == O_ADD || Operator == O_SUB || Operator == O_CAT)) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level09());
+    while (P->Token == T_OPERATOR && (P->Operator == O_ADD || P->Operator == O_SUB || P->Operator == O_CAT)) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level09(P));
     }
 
     return Root;
@@ -958,17 +1702,17 @@ static NODE *Level08(void)
 
 
 /* relational operators */
-static NODE *Level07(void)
+static NODE *Level07(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level08();
+    Root = Level08(P);
 
-    while (Token == T_OPERATOR && (Operator == O_NGT || Operator == O_NGE || Operator == O_NLT || Operator == O_NLE ||
-				   Operator == O_SGT || Operator == O_SGE || Operator == O_SLT || Operator == O_SLE)) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level08());
+    while (P->Token == T_OPERATOR && (P->Operator == O_NGT || P->Operator == O_NGE || P->Operator == O_NLT || P->Operator == O_NLE ||
+				   P->Operator == O_SGT || P->Operator == O_SGE || P->Operator == O_SLT || P->Operator == O_SLE)) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level08(P));
     }
 
     return Root;
@@ -976,32 +1720,32 @@ static NODE *Level07(void)
 
 
 /* equal, not equal */
-static NODE *Level06(void)
+static NODE *Level06(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level07();
+    Root = Level07(P);
 
-    while (Token == T_OPERATOR && (Operator == O_NEQ || Operator == O_NNE || Operator == O_SEQ || Operator == O_SNE)) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level07());
+    while (P->Token == T_OPERATOR && (P->Operator == O_NEQ || P->Operator == O_NNE || P->Operator == O_SEQ || P->Operator == O_SNE)) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level07(P));
     }
 
     return Root;
 }
 
 /* logical 'and' */
-static NODE *Level05(void)
+static NODE *Level05(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level06();
+    Root = Level06(P);
 
-    while (Token == T_OPERATOR && Operator == O_AND) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level06());
+    while (P->Token == T_OPERATOR && P->Operator == O_AND) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level06(P));
     }
 
     return Root;
@@ -1009,16 +1753,16 @@ static NODE *Level05(void)
 
 
 /* logical 'or' */
-static NODE *Level04(void)
+static NODE *Level04(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level05();
+    Root = Level05(P);
 
-    while (Token == T_OPERATOR && Operator == O_OR) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level05());
+    while (P->Token == T_OPERATOR && P->Operator == O_OR) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level05(P));
     }
 
     return Root;
@@ -1026,22 +1770,22 @@ static NODE *Level04(void)
 
 
 /* conditional expression a?b:c */
-static NODE *Level03(void)
+static NODE *Level03(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level04();
+    Root = Level04(P);
 
-    if (Token == T_OPERATOR && Operator == O_CND) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level04());
-	if (Token == T_OPERATOR && Operator == O_COL) {
-	    Parse();
-	    LinkNode(Root, Level04());
+    if (P->Token == T_OPERATOR && P->Operator == O_CND) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level04(P));
+	if (P->Token == T_OPERATOR && P->Operator == O_COL) {
+	    Parse(P);
+	    LinkNode(Root, Level04(P));
 	} else {
-	    error("Evaluator: syntax error in <%s>: expecting ':' got '%s'", Expression, Word);
-	    LinkNode(Root, JunkNode());
+	    error("Evaluator: syntax error in <%s>: expecting ':' got '%s'", P->Expression, P->Word);
+	    LinkNode(Root, JunkNode(P));
 	}
     }
 
@@ -1050,26 +1794,20 @@ static NODE *Level03(void)
 
 
 /* variable assignments */
-static NODE *Level02(void)
+static NODE *Level02(PARSER * P)
 {
     NODE *Root;
 
     /* we have to do a look-ahead if it's really an assignment */
-    if ((Token == T_NAME) && (*ExprPtr == '=') && (*(ExprPtr + 1) != '=')) {
-	char *name = strdup(Word);
-	VARIABLE *V = FindVariable(name);
-	if (V == NULL) {
-	    SetVariableString(name, "");
-	    V = FindVariable(name);
-	}
-	Parse();
-	Root = NewNode(NULL);
+    if ((P->Token == T_NAME) && (*P->ExprPtr == '=') && (*(P->ExprPtr + 1) != '=')) {
+	VARIABLE *V = BindVariable(P->Word);
+	Parse(P);
+	Root = NewNode(P, NULL);
 	Root->Variable = V;
-	Parse();
-	LinkNode(Root, Level03());
-	free(name);
+	Parse(P);
+	LinkNode(Root, Level03(P));
     } else {
-	Root = Level03();
+	Root = Level03(P);
     }
 
     return Root;
@@ -1077,16 +1815,16 @@ static NODE *Level02(void)
 
 
 /* expression lists */
-static NODE *Level01(void)
+static NODE *Level01(PARSER * P)
 {
     NODE *Root;
 
-    Root = Level02();
+    Root = Level02(P);
 
-    while (Token == T_OPERATOR && Operator == O_LST) {
-	Root = NewNode(Root);
-	Parse();
-	LinkNode(Root, Level02());
+    while (P->Token == T_OPERATOR && P->Operator == O_LST) {
+	Root = NewNode(P, Root);
+	Parse(P);
+	LinkNode(Root, Level02(P));
     }
 
     return Root;
@@ -1117,7 +1855,6 @@ static int EvalTree(NODE * Root)
 	return 0;
 
     case T_FUNCTION:
-	DelResult(Root->Result);
 	/* prepare parameter list */
 	argc = Root->Children;
 	if (argc > 10) {
@@ -1128,14 +1865,7 @@ static int EvalTree(NODE * Root)
 	    EvalTree(Root->Child[i]);
 	    param[i] = Root->Child[i]->Result;
 	}
-	if (Root->Function->argc < 0) {
-	    /* Function with variable argument list:  */
-	    /* pass number of arguments as first parameter */
-	    Root->Function->func(Root->Result, argc, &param);
-	} else {
-	    Root->Function->func(Root->Result, param[0], param[1], param[2], param[3], param[4], param[5], param[6],
-				 param[7], param[8], param[9]);
-	}
+	CallFunction(Root->Function, Root->Result, argc, param);
 	return 0;
 
     case T_OPERATOR:
@@ -1153,7 +1883,7 @@ static int EvalTree(NODE * Root)
 
 	case O_SET:		/* variable assignment */
 	    EvalTree(Root->Child[0]);
-	    CopyResult(&Root->Variable->value, Root->Child[0]->Result);
+	    StoreVariable(Root->Variable, Root->Child[0]->Result);
 	    type = Root->Child[0]->Result->type;
 	    number = Root->Child[0]->Result->number;
 	    string = Root->Child[0]->Result->string;
@@ -1383,85 +2113,1076 @@ static int EvalTree(NODE * Root)
 }
 
 
+/* forward declaration */
+static void DelNode(NODE * Root);
+
+
+/* constant nodes */
+#define Constant(n) ((n)->Token == T_NUMBER || (n)->Token == T_STRING)
+
+/* turn an evaluated node into a constant */
+static void MakeConstant(NODE * Root)
+{
+    int i;
+
+    for (i = 0; i < Root->Children; i++) {
+	DelNode(Root->Child[i]);
+    }
+    if (Root->Child)
+	free(Root->Child);
+    Root->Child = NULL;
+    Root->Children = 0;
+    Root->Token = Root->Result->type & R_STRING ? T_STRING : T_NUMBER;
+    Root->Operator = O_UNDEF;
+    Root->Variable = NULL;
+    Root->Function = NULL;
+}
+
+
+/* replace a node by one of its children */
+static void Replace(NODE * Root, const int n)
+{
+    int i;
+    NODE *Child = Root->Child[n];
+
+    for (i = 0; i < Root->Children; i++) {
+	if (i != n)
+	    DelNode(Root->Child[i]);
+    }
+    free(Root->Child);
+    if (Root->Result)
+	FreeResult(Root->Result);
+    *Root = *Child;
+    free(Child);
+}
+
+
+/* evaluate constant subtrees at compile time */
+static void Fold(NODE * Root)
+{
+    int i, constant = 1;
+
+    for (i = 0; i < Root->Children; i++) {
+	Fold(Root->Child[i]);
+	if (!Constant(Root->Child[i]))
+	    constant = 0;
+    }
+
+    switch (Root->Token) {
+
+    case T_FUNCTION:
+	if (constant && Root->Function->flags & F_PURE) {
+	    /* plugin functions need not be thread-safe */
+	    pthread_mutex_lock(&Lock);
+	    EvalTree(Root);
+	    pthread_mutex_unlock(&Lock);
+	    MakeConstant(Root);
+	}
+	break;
+
+    case T_OPERATOR:
+	switch (Root->Operator) {
+
+	case O_SET:		/* assignments are never constant */
+	    break;
+
+	case O_CND:		/* constant condition selects one branch */
+	    if (Constant(Root->Child[0]))
+		Replace(Root, 1 + (R2N(Root->Child[0]->Result) == 0.0));
+	    break;
+
+	case O_OR:		/* left operand may decide alone */
+	case O_AND:
+	    if (Constant(Root->Child[0]) && (R2N(Root->Child[0]->Result) != 0.0) == (Root->Operator == O_OR))
+		constant = 1;
+	    /* fall through */
+
+	default:
+	    if (constant) {
+		EvalTree(Root);
+		MakeConstant(Root);
+	    }
+	    break;
+	}
+	break;
+
+    default:
+	break;
+    }
+}
+
+
+/* store a number into a register, keeping its string buffer */
+static inline void SetNumber(RESULT * result, const double number)
+{
+    result->type = R_NUMBER;
+    result->number = number;
+}
+
+
+/* numeric value of a register, without a function call for numbers */
+#define N(r) ((r)->type & R_NUMBER ? (r)->number : R2N(r))
+
+/* apply a bytecode operator to its operand registers */
+static inline void Operate(RESULT * result, const OPERATOR op, RESULT * a, RESULT * b)
+{
+    double number = 0.0;
+    double dummy;
+    char *s1, *s2;
+    int len;
+
+    switch (op) {
+
+    case O_NEQ:		/* numeric equal */
+	number = (N(a) == N(b));
+	break;
+
+    case O_NNE:		/* numeric not equal */
+	number = (N(a) != N(b));
+	break;
+
+    case O_NLT:		/* numeric less than */
+	number = (N(a) < N(b));
+	break;
+
+    case O_NLE:		/* numeric less equal */
+	number = (N(a) <= N(b));
+	break;
+
+    case O_NGT:		/* numeric greater than */
+	number = (N(a) > N(b));
+	break;
+
+    case O_NGE:		/* numeric greater equal */
+	number = (N(a) >= N(b));
+	break;
+
+    case O_SEQ:		/* string equal */
+	number = (strcmp(R2S(a), R2S(b)) == 0);
+	break;
+
+    case O_SNE:		/* string not equal */
+	number = (strcmp(R2S(a), R2S(b)) != 0);
+	break;
+
+    case O_SLT:		/* string less than */
+	number = (strcmp(R2S(a), R2S(b)) < 0);
+	break;
+
+    case O_SLE:		/* string less equal */
+	number = (strcmp(R2S(a), R2S(b)) <= 0);
+	break;
+
+    case O_SGT:		/* string greater than */
+	number = (strcmp(R2S(a), R2S(b)) > 0);
+	break;
+
+    case O_SGE:		/* string greater equal */
+	number = (strcmp(R2S(a), R2S(b)) >= 0);
+	break;
+
+    case O_ADD:		/* addition */
+	number = N(a) + N(b);
+	break;
+
+    case O_SUB:		/* subtraction */
+	number = N(a) - N(b);
+	break;
+
+    case O_SGN:		/* sign */
+	number = -N(a);
+	break;
+
+    case O_CAT:		/* string concatenation */
+	/* concatenate directly into the register buffer */
+	s1 = R2S(a);
+	s2 = R2S(b);
+	len = strlen(s1);
+	Reserve(result, len + strlen(s2));
+	strcpy(result->string, s1);
+	strcpy(result->string + len, s2);
+	result->type = R_STRING;
+	result->number = 0.0;
+	return;
+
+    case O_MUL:		/* multiplication */
+	number = N(a) * N(b);
+	break;
+
+    case O_DIV:		/* division */
+	dummy = N(b);
+	if (dummy == 0) {
+	    error("Evaluator: warning: division by zero");
+	    number = 0.0;
+	} else {
+	    number = N(a) / dummy;
+	}
+	break;
+
+    case O_MOD:		/* modulo */
+	dummy = N(b);
+	if (dummy == 0) {
+	    error("Evaluator: warning: division by zero");
+	    number = 0.0;
+	} else {
+	    number = fmod(N(a), dummy);
+	}
+	break;
+
+    case O_POW:		/* x^y */
+	number = pow(N(a), N(b));
+	break;
+
+    case O_NOT:		/* logical NOT */
+	number = (N(a) == 0.0);
+	break;
+
+    default:
+	error("Evaluator: internal error: unhandled operator <%d>", op);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    SetNumber(result, number);
+}
+
+#undef N
+
+
+/* forward declaration */
+static void Refresh(SHARED * S);
+
+
+static int Run(PROGRAM * Program)
+{
+    int i;
+    double number;
+    INSN *I = Program->Code;
+    INSN *End = Program->Code + Program->nCode;
+    RESULT *Reg = Program->Reg;
+    RESULT **Ptr = Program->Ptr;
+    RESULT *R;
+    RESULT *param[10];
+
+    while (I < End) {
+
+	switch (I->Code) {
+
+	case C_VAR:
+	    R = Reg + I->Dst;
+	    CopyResult(&R, I->Variable->value);
+	    break;
+
+	case C_SET:
+	    if (Ptr[I->A] != I->Variable->value)
+		StoreVariable(I->Variable, Ptr[I->A]);
+	    break;
+
+	case C_CALL:
+	    R = Reg + I->Dst;
+	    for (i = 0; i < I->B; i++) {
+		param[i] = Ptr[Program->Arg[I->A + i]];
+	    }
+	    CallFunction(I->Function, R, I->B, param);
+	    break;
+
+	case C_OP1:
+	    Operate(Reg + I->Dst, I->Operator, Ptr[I->A], NULL);
+	    break;
+
+	case C_OP2:
+	    Operate(Reg + I->Dst, I->Operator, Ptr[I->A], Ptr[I->B]);
+	    break;
+
+	case C_MOV:
+	    Ptr[I->Dst] = Ptr[I->A];
+	    break;
+
+	case C_BOOL:
+	    R = Reg + I->Dst;
+	    number = (R2N(Ptr[I->A]) != 0.0);
+	    SetResult(&R, R_NUMBER, &number);
+	    break;
+
+	case C_NUM:
+	    R = Reg + I->Dst;
+	    SetResult(&R, R_NUMBER, &I->Number);
+	    break;
+
+	case C_JZ:
+	    if (R2N(Ptr[I->A]) == 0.0) {
+		I = Program->Code + I->Jump;
+		continue;
+	    }
+	    break;
+
+	case C_JNZ:
+	    if (R2N(Ptr[I->A]) != 0.0) {
+		I = Program->Code + I->Jump;
+		continue;
+	    }
+	    break;
+
+	case C_JMP:
+	    I = Program->Code + I->Jump;
+	    continue;
+
+	case C_SHARED:
+	    Refresh(I->Shared);
+	    Ptr[I->Dst] = I->Shared->Program->Ptr[I->Shared->Program->Result];
+	    break;
+
+	default:
+	    error("Evaluator: internal error: unhandled instruction <%d>", I->Code);
+	    return -1;
+	}
+
+	I++;
+    }
+
+    return 0;
+}
+
+
+/* check if a program has to run again, because it is */
+/* volatile or a dependency changed since its last run */
+static int Stale(PROGRAM * Program)
+{
+    int i;
+    DEPEND *D;
+
+    if (!Program->Valid || Program->Volatile == V_ALWAYS)
+	return 1;
+    if (Program->Volatile == V_TICK && Program->Tick != Tick)
+	return 1;
+
+    for (i = 0; i < Program->nDepend; i++) {
+	D = &Program->Depend[i];
+	if (D->Variable != NULL) {
+	    if (D->Variable->generation != D->Generation)
+		return 1;
+	} else {
+	    Refresh(D->Shared);
+	    if (D->Shared->Generation != D->Generation)
+		return 1;
+	}
+    }
+
+    return 0;
+}
+
+
+/* run a program and remember the state of its dependencies */
+static int Execute(PROGRAM * Program)
+{
+    int i, ret;
+    DEPEND *D;
+
+    ret = Run(Program);
+
+    for (i = 0; i < Program->nDepend; i++) {
+	D = &Program->Depend[i];
+	D->Generation = D->Variable != NULL ? D->Variable->generation : D->Shared->Generation;
+    }
+    Program->Valid = 1;
+    Program->Tick = Tick;
+
+    return ret;
+}
+
+
+/* bring a shared program up to date, at most once per tick */
+static void Refresh(SHARED * S)
+{
+    RESULT *R;
+    RESULT *Last = &S->Last;
+
+    if (S->Tick == Tick)
+	return;
+    S->Tick = Tick;
+
+    if (Stale(S->Program)) {
+	Execute(S->Program);
+	R = S->Program->Ptr[S->Program->Result];
+	if (!SameResult(R, Last)) {
+	    CopyResult(&Last, R);
+	    S->Generation++;
+	}
+    }
+}
+
+
+/* remember a variable or shared program a program depends on */
+static void AddDepend(PROGRAM * Program, VARIABLE * Variable, SHARED * Shared)
+{
+    int i;
+
+    for (i = 0; i < Program->nDepend; i++) {
+	if (Program->Depend[i].Variable == Variable && Program->Depend[i].Shared == Shared)
+	    return;
+    }
+
+    Program->nDepend++;
+    Program->Depend = realloc(Program->Depend, Program->nDepend * sizeof(DEPEND));
+    Program->Depend[Program->nDepend - 1].Variable = Variable;
+    Program->Depend[Program->nDepend - 1].Shared = Shared;
+    Program->Depend[Program->nDepend - 1].Generation = 0;
+}
+
+
+static int NewRegister(PROGRAM * Program)
+{
+    int i;
+    RESULT *Reg;
+
+    /* registers may use their inline buffer, so they */
+    /* cannot be moved around with a plain realloc() */
+    Reg = malloc((Program->nReg + 1) * sizeof(RESULT));
+    for (i = 0; i < Program->nReg; i++) {
+	Reg[i] = Program->Reg[i];
+	if (Program->Reg[i].string == Program->Reg[i].buffer)
+	    Reg[i].string = Reg[i].buffer;
+    }
+    memset(&Reg[Program->nReg], 0, sizeof(RESULT));
+    free(Program->Reg);
+    Program->Reg = Reg;
+    Program->nReg++;
+    Program->Bind = realloc(Program->Bind, Program->nReg * sizeof(VARIABLE *));
+    Program->Bind[Program->nReg - 1] = NULL;
+    return Program->nReg - 1;
+}
+
+
+/* append an instruction; note that the returned pointer */
+/* is only valid until the next instruction is added */
+static INSN *NewInsn(PROGRAM * Program, const CODE code, const int dst)
+{
+    INSN *I;
+
+    Program->nCode++;
+    Program->Code = realloc(Program->Code, Program->nCode * sizeof(INSN));
+    I = &Program->Code[Program->nCode - 1];
+    memset(I, 0, sizeof(INSN));
+    I->Code = code;
+    I->Dst = dst;
+
+    return I;
+}
+
+
+/* check if a tree contains an assignment to a variable */
+static int Assigns(NODE * Root, VARIABLE * Variable)
+{
+    int i;
+
+    if (Root->Token == T_OPERATOR && Root->Operator == O_SET && Root->Variable == Variable)
+	return 1;
+
+    for (i = 0; i < Root->Children; i++) {
+	if (Assigns(Root->Child[i], Variable))
+	    return 1;
+    }
+
+    return 0;
+}
+
+
+/* count the calls in a shareable subtree, -1 if it is not shareable */
+static int Calls(NODE * Root)
+{
+    int i, n, calls = 0;
+
+    switch (Root->Token) {
+    case T_NUMBER:
+    case T_STRING:
+	return 0;
+    case T_FUNCTION:
+	if (!(Root->Function->flags & (F_PURE | F_STABLE)))
+	    return -1;
+	calls = 1;
+	break;
+    case T_OPERATOR:
+	if (Root->Operator == O_SET)
+	    return -1;
+	break;
+    default:
+	return -1;
+    }
+
+    for (i = 0; i < Root->Children; i++) {
+	if ((n = Calls(Root->Child[i])) < 0)
+	    return -1;
+	calls += n;
+    }
+
+    return calls;
+}
+
+
+/* append to a growing string */
+static void Append(char **key, int *len, int *size, const char *s)
+{
+    int n = strlen(s);
+
+    if (*len + n >= *size) {
+	*size = CHUNK_SIZE * ((*len + n + 1) / CHUNK_SIZE + 1);
+	*key = realloc(*key, *size);
+    }
+    strcpy(*key + *len, s);
+    *len += n;
+}
+
+
+/* canonical form of a shareable subtree */
+static void Canon(NODE * Root, char **key, int *len, int *size)
+{
+    int i;
+    char buffer[32];
+
+    switch (Root->Token) {
+    case T_NUMBER:
+	snprintf(buffer, sizeof(buffer), "%.17g", Root->Result->number);
+	Append(key, len, size, buffer);
+	return;
+    case T_STRING:
+	snprintf(buffer, sizeof(buffer), "'%d:", (int) strlen(Root->Result->string));
+	Append(key, len, size, buffer);
+	Append(key, len, size, Root->Result->string);
+	return;
+    case T_FUNCTION:
+	Append(key, len, size, Root->Function->name);
+	break;
+    default:
+	snprintf(buffer, sizeof(buffer), "#%d", Root->Operator);
+	Append(key, len, size, buffer);
+	break;
+    }
+
+    Append(key, len, size, "(");
+    for (i = 0; i < Root->Children; i++) {
+	if (i > 0)
+	    Append(key, len, size, ",");
+	Canon(Root->Child[i], key, len, size);
+    }
+    Append(key, len, size, ")");
+}
+
+
+/* forward declarations */
+static PROGRAM *NewProgram(NODE * Root, const int shared);
+static void DelProgram(PROGRAM * Program);
+
+
+/* look up a shared program and take a reference, needs the lock */
+static SHARED *FindShared(const unsigned int hash, const char *key)
+{
+    SHARED *S;
+
+    for (S = Shared[hash]; S != NULL; S = S->Next) {
+	if (strcmp(S->Key, key) == 0) {
+	    S->Refs++;
+	    return S;
+	}
+    }
+    return NULL;
+}
+
+
+/* find or create the shared program for a subtree */
+static SHARED *GetShared(NODE * Root)
+{
+    char *key = NULL;
+    int len = 0, size = 0;
+    unsigned int hash;
+    SHARED *S, *T;
+
+    Canon(Root, &key, &len, &size);
+    hash = HashString(key) % SHARED_SIZE;
+
+    pthread_mutex_lock(&Lock);
+    S = FindShared(hash, key);
+    pthread_mutex_unlock(&Lock);
+    if (S != NULL) {
+	free(key);
+	return S;
+    }
+
+    /* compile without holding the lock, as this recurses */
+    S = malloc(sizeof(SHARED));
+    if (S == NULL) {
+	error("Evaluator: cannot allocate shared expression: out of memory!");
+	free(key);
+	return NULL;
+    }
+    S->Key = key;
+    S->Refs = 1;
+    S->Tick = Tick - 1;
+    S->Generation = 0;
+    memset(&S->Last, 0, sizeof(RESULT));
+    S->Program = NewProgram(Root, 1);
+    if (S->Program == NULL) {
+	free(key);
+	free(S);
+	return NULL;
+    }
+
+    /* another thread may have been faster */
+    pthread_mutex_lock(&Lock);
+    T = FindShared(hash, key);
+    if (T == NULL) {
+	S->Next = Shared[hash];
+	Shared[hash] = S;
+    }
+    pthread_mutex_unlock(&Lock);
+    if (T != NULL) {
+	DelProgram(S->Program);
+	free(S->Key);
+	free(S);
+	return T;
+    }
+
+    return S;
+}
+
+
+/* drop a reference to a shared program */
+static void PutShared(SHARED * S)
+{
+    SHARED **P;
+
+    pthread_mutex_lock(&Lock);
+    if (--S->Refs > 0) {
+	pthread_mutex_unlock(&Lock);
+	return;
+    }
+    for (P = &Shared[HashString(S->Key) % SHARED_SIZE]; *P != S; P = &(*P)->Next);
+    *P = S->Next;
+    pthread_mutex_unlock(&Lock);
+
+    DelProgram(S->Program);
+    DelResult(&S->Last);
+    free(S->Key);
+    free(S);
+}
+
+
+/* forward declaration */
+static int EmitNode(PROGRAM * Program, NODE * Tree, NODE * Root);
+
+
+/* emit bytecode for a (sub)tree, returns the result register */
+static int Emit(PROGRAM * Program, NODE * Tree, NODE * Root)
+{
+    int dst;
+    INSN *I;
+    SHARED *S;
+
+    /* shareable subtrees are referenced, not compiled in */
+    if (Calls(Root) > 0 && (S = GetShared(Root)) != NULL) {
+	dst = NewRegister(Program);
+	I = NewInsn(Program, C_SHARED, dst);
+	I->Shared = S;
+	AddDepend(Program, NULL, S);
+	return dst;
+    }
+
+    return EmitNode(Program, Tree, Root);
+}
+
+
+static int EmitNode(PROGRAM * Program, NODE * Tree, NODE * Root)
+{
+    int i, argc, a, b, dst, jump, end;
+    int arg[10];
+    INSN *I;
+    RESULT *R;
+
+    switch (Root->Token) {
+
+    case T_NUMBER:
+    case T_STRING:
+	/* constants are preloaded and need no code */
+	dst = NewRegister(Program);
+	R = &Program->Reg[dst];
+	CopyResult(&R, Root->Result);
+	return dst;
+
+    case T_VARIABLE:
+	dst = NewRegister(Program);
+	AddDepend(Program, Root->Variable, NULL);
+	if (Assigns(Tree, Root->Variable)) {
+	    /* the expression changes the variable, so we need a snapshot */
+	    I = NewInsn(Program, C_VAR, dst);
+	    I->Variable = Root->Variable;
+	} else {
+	    /* read the variable in place */
+	    Program->Bind[dst] = Root->Variable;
+	}
+	return dst;
+
+    case T_FUNCTION:
+	argc = Root->Children;
+	if (argc > 10) {
+	    error("evaluator: more than 10 children (operands) not supported!");
+	    argc = 10;
+	}
+	for (i = 0; i < argc; i++) {
+	    arg[i] = Emit(Program, Tree, Root->Child[i]);
+	}
+	a = Program->nArg;
+	Program->nArg += argc;
+	Program->Arg = realloc(Program->Arg, Program->nArg * sizeof(int));
+	for (i = 0; i < argc; i++) {
+	    Program->Arg[a + i] = arg[i];
+	}
+	if (!(Root->Function->flags & F_PURE)) {
+	    if (Root->Function->flags & F_STABLE) {
+		if (Program->Volatile < V_TICK)
+		    Program->Volatile = V_TICK;
+	    } else {
+		Program->Volatile = V_ALWAYS;
+	    }
+	}
+	dst = NewRegister(Program);
+	I = NewInsn(Program, C_CALL, dst);
+	I->Function = Root->Function;
+	I->A = a;
+	I->B = argc;
+	return dst;
+
+    case T_OPERATOR:
+	switch (Root->Operator) {
+
+	case O_LST:		/* expression list: result is last expression */
+	    dst = -1;
+	    for (i = 0; i < Root->Children; i++) {
+		dst = Emit(Program, Tree, Root->Child[i]);
+	    }
+	    return dst;
+
+	case O_SET:		/* variable assignment: result is the assigned value */
+	    /* side effects must happen on every evaluation */
+	    Program->Volatile = V_ALWAYS;
+	    a = Emit(Program, Tree, Root->Child[0]);
+	    I = NewInsn(Program, C_SET, -1);
+	    I->Variable = Root->Variable;
+	    I->A = a;
+	    return a;
+
+	case O_CND:		/* conditional expression */
+	    a = Emit(Program, Tree, Root->Child[0]);
+	    dst = NewRegister(Program);
+	    jump = Program->nCode;
+	    I = NewInsn(Program, C_JZ, -1);
+	    I->A = a;
+	    b = Emit(Program, Tree, Root->Child[1]);
+	    I = NewInsn(Program, C_MOV, dst);
+	    I->A = b;
+	    end = Program->nCode;
+	    NewInsn(Program, C_JMP, -1);
+	    Program->Code[jump].Jump = Program->nCode;
+	    b = Emit(Program, Tree, Root->Child[2]);
+	    I = NewInsn(Program, C_MOV, dst);
+	    I->A = b;
+	    Program->Code[end].Jump = Program->nCode;
+	    return dst;
+
+	case O_OR:		/* logical OR */
+	case O_AND:		/* logical AND */
+	    /* short-circuit: skip the right operand if the left one decides */
+	    a = Emit(Program, Tree, Root->Child[0]);
+	    dst = NewRegister(Program);
+	    jump = Program->nCode;
+	    I = NewInsn(Program, Root->Operator == O_OR ? C_JNZ : C_JZ, -1);
+	    I->A = a;
+	    b = Emit(Program, Tree, Root->Child[1]);
+	    I = NewInsn(Program, C_BOOL, dst);
+	    I->A = b;
+	    end = Program->nCode;
+	    NewInsn(Program, C_JMP, -1);
+	    Program->Code[jump].Jump = Program->nCode;
+	    I = NewInsn(Program, C_NUM, dst);
+	    I->Number = (Root->Operator == O_OR);
+	    Program->Code[end].Jump = Program->nCode;
+	    return dst;
+
+	case O_SGN:		/* sign */
+	case O_NOT:		/* logical NOT */
+	    a = Emit(Program, Tree, Root->Child[0]);
+	    dst = NewRegister(Program);
+	    I = NewInsn(Program, C_OP1, dst);
+	    I->Operator = Root->Operator;
+	    I->A = a;
+	    return dst;
+
+	case O_NEQ:
+	case O_NNE:
+	case O_NLT:
+	case O_NLE:
+	case O_NGT:
+	case O_NGE:
+	case O_SEQ:
+	case O_SNE:
+	case O_SLT:
+	case O_SLE:
+	case O_SGT:
+	case O_SGE:
+	case O_ADD:
+	case O_SUB:
+	case O_CAT:
+	case O_MUL:
+	case O_DIV:
+	case O_MOD:
+	case O_POW:
+	    a = Emit(Program, Tree, Root->Child[0]);
+	    b = Emit(Program, Tree, Root->Child[1]);
+	    dst = NewRegister(Program);
+	    I = NewInsn(Program, C_OP2, dst);
+	    I->Operator = Root->Operator;
+	    I->A = a;
+	    I->B = b;
+	    return dst;
+
+	default:
+	    error("Evaluator: internal error: unhandled operator <%d>", Root->Operator);
+	    break;
+	}
+	break;
+
+    default:
+	error("Evaluator: internal error: unhandled token <%d>", Root->Token);
+	break;
+    }
+
+    dst = NewRegister(Program);
+    R = &Program->Reg[dst];
+    SetResult(&R, R_STRING, "");
+    return dst;
+}
+
+
+static PROGRAM *NewProgram(NODE * Root, const int shared)
+{
+    int i;
+    PROGRAM *Program;
+
+    Program = malloc(sizeof(PROGRAM));
+    if (Program == NULL) {
+	error("Evaluator: cannot allocate program: out of memory!");
+	return NULL;
+    }
+    memset(Program, 0, sizeof(PROGRAM));
+
+    /* a shared program must not reference itself */
+    if (shared)
+	Program->Result = EmitNode(Program, Root, Root);
+    else
+	Program->Result = Emit(Program, Root, Root);
+
+    /* resolve operand pointers */
+    Program->Ptr = malloc(Program->nReg * sizeof(RESULT *));
+    for (i = 0; i < Program->nReg; i++) {
+	if (Program->Bind[i] != NULL)
+	    Program->Ptr[i] = Program->Bind[i]->value;
+	else
+	    Program->Ptr[i] = &Program->Reg[i];
+    }
+    free(Program->Bind);
+    Program->Bind = NULL;
+
+    return Program;
+}
+
+
+static void DelProgram(PROGRAM * Program)
+{
+    int i;
+
+    if (Program == NULL)
+	return;
+
+    for (i = 0; i < Program->nCode; i++) {
+	if (Program->Code[i].Code == C_SHARED)
+	    PutShared(Program->Code[i].Shared);
+    }
+    for (i = 0; i < Program->nReg; i++) {
+	DelResult(&Program->Reg[i]);
+    }
+    free(Program->Reg);
+    free(Program->Ptr);
+    free(Program->Code);
+    free(Program->Arg);
+    free(Program->Depend);
+    free(Program);
+}
+
+
+static void DelNode(NODE * Root)
+{
+    int i;
+
+    if (Root == NULL)
+	return;
+
+    for (i = 0; i < Root->Children; i++) {
+	DelNode(Root->Child[i]);
+    }
+
+    if (Root->Child)
+	free(Root->Child);
+    if (Root->Result)
+	FreeResult(Root->Result);
+    free(Root);
+}
+
+
+void SetBytecode(const int enable)
+{
+    Bytecode = enable;
+}
+
+
+void EvalTick(void)
+{
+    Tick++;
+}
+
+
+int NewTick(unsigned long *tick)
+{
+    if (*tick == Tick + 1)
+	return 0;
+    *tick = Tick + 1;
+    return 1;
+}
+
+
 int Compile(const char *expression, void **tree)
 {
+    PARSER Parser;
+    PARSER *P = &Parser;
     NODE *Root;
+    EXPR *Expr;
 
     *tree = NULL;
 
-    Expression = (char *) expression;
-    ExprPtr = Expression;
+    P->Expression = (char *) expression;
+    P->ExprPtr = P->Expression;
+    P->Word = NULL;
+    P->Unknown = 0;
 
-    Parse();
-    if (*Word == '\0') {
-	/* error ("Evaluator: empty expression <%s>", Expression); */
-	free(Word);
-	Word = NULL;
+    Parse(P);
+    if (*P->Word == '\0') {
+	/* error ("Evaluator: empty expression <%s>", P->Expression); */
+	free(P->Word);
+	P->Word = NULL;
 	return -1;
     }
 
-    Root = Level01();
+    Root = Level01(P);
 
-    if (*Word != '\0') {
-	error("Evaluator: syntax error in <%s>: garbage <%s>", Expression, Word);
-	free(Word);
-	Word = NULL;
+    if (*P->Word != '\0') {
+	error("Evaluator: syntax error in <%s>: garbage <%s>", P->Expression, P->Word);
+	free(P->Word);
+	P->Word = NULL;
+	DelNode(Root);
 	return -1;
     }
 
-    free(Word);
-    Word = NULL;
+    free(P->Word);
+    P->Word = NULL;
+
+    Fold(Root);
+
+    Expr = malloc(sizeof(EXPR));
+    if (Expr == NULL) {
+	error("Evaluator: cannot allocate expression: out of memory!");
+	DelNode(Root);
+	return -1;
+    }
+
+    Expr->Root = NULL;
+    Expr->Program = NULL;
+    Expr->Unknown = P->Unknown;
+
+    /* flatten the tree into bytecode, the tree itself is no longer needed */
+    if (Bytecode) {
+	Expr->Program = NewProgram(Root, 0);
+    }
+    if (Expr->Program != NULL) {
+	DelNode(Root);
+    } else {
+	Expr->Root = Root;
+    }
 
-    *(NODE **) tree = Root;
+    *(EXPR **) tree = Expr;
 
     return 0;
 }
 
 
-int Eval(void *tree, RESULT * result)
+int EvalBorrow(void *tree, RESULT ** result)
 {
     int ret;
-    NODE *Tree = (NODE *) tree;
-
-    DelResult(result);
+    EXPR *Expr = (EXPR *) tree;
+    static RESULT Empty = { R_STRING, 0, 0.0, "", "" };
 
-    if (Tree == NULL) {
-	SetResult(&result, R_STRING, "");
+    if (Expr == NULL) {
+	*result = &Empty;
 	return 0;
     }
 
-    ret = EvalTree(Tree);
-
-    result->type = Tree->Result->type;
-    result->size = Tree->Result->size;
-    result->number = Tree->Result->number;
-    if (result->size > 0) {
-	result->string = malloc(result->size);
-	if (Tree->Result->string != NULL) {
-	    strcpy(result->string, Tree->Result->string);
-	} else
-	    result->string[0] = '\0';
+    if (Expr->Program != NULL) {
+	ret = Execute(Expr->Program);
+	*result = Expr->Program->Ptr[Expr->Program->Result];
     } else {
-	result->string = NULL;
+	ret = EvalTree(Expr->Root);
+	*result = Expr->Root->Result;
     }
 
     return ret;
 }
 
 
+int EvalStale(void *tree)
+{
+    EXPR *Expr = (EXPR *) tree;
+
+    if (Expr == NULL || Expr->Program == NULL)
+	return 1;
+
+    return Stale(Expr->Program);
+}
+
+
+int EvalUnknown(void *tree)
+{
+    EXPR *Expr = (EXPR *) tree;
+
+    return Expr ? Expr->Unknown : 0;
+}
+
+
+int Eval(void *tree, RESULT * result)
+{
+    int ret;
+    RESULT *Root;
+
+    ret = EvalBorrow(tree, &Root);
+    CopyResult(&result, Root);
+
+    return ret;
+}
+
+
 void DelTree(void *tree)
 {
-    int i;
-    NODE *Tree = (NODE *) tree;
+    EXPR *Expr = (EXPR *) tree;
 
-    if (Tree == NULL)
+    if (Expr == NULL)
 	return;
 
-    for (i = 0; i < Tree->Children; i++) {
-	DelTree(Tree->Child[i]);
-    }
-
-    if (Tree->Result)
-	FreeResult(Tree->Result);
-    free(Tree);
+    DelProgram(Expr->Program);
+    DelNode(Expr->Root);
+    free(Expr);
 }
@@ -33,11 +33,17 @@
 #define R_NUMBER 1
 #define R_STRING 2
 
+/* size of the inline string buffer */
+#define RESULT_INLINE 16
+
+/* short strings are stored in the inline buffer, so a RESULT */
+/* must not be copied around, use CopyResult() instead */
 typedef struct {
     int type;
-    int size;
+    int size;			/* size of the string buffer */
     double number;
     char *string;
+    char buffer[RESULT_INLINE];
 } RESULT;
 
 /* strndup() may be not available on several platforms */
@@ -46,11 +52,38 @@ typedef struct {
 char *strndup(const char *source, size_t len);
 #endif
 
+/* cost accounting of a function or property */
+typedef struct {
+    unsigned long calls;
+    unsigned long allocs;	/* heap allocated result buffers */
+    unsigned long long time;	/* total wall time in nsec */
+    unsigned long long max;	/* longest call in nsec */
+} PROFILE;
+
+typedef struct {
+    unsigned long long start;
+    unsigned long allocs;
+} PROFILE_CLOCK;
+
 int SetVariable(const char *name, RESULT * value);
 int SetVariableNumeric(const char *name, const double value);
 int SetVariableString(const char *name, const char *value);
 
+/* function flags */
+#define F_PURE   1		/* result depends on the arguments only */
+#define F_STABLE 2		/* result does not change within a tick */
+
 int AddFunction(const char *name, const int argc, void (*func) ());
+int AddFunctionFlags(const char *name, const int argc, void (*func) (), const int flags);
+int AddFunctionTTL(const char *name, const int argc, void (*func) (), const int flags, const int ttl);
+int FunctionStats(const char *name, unsigned long *hits, unsigned long *misses);
+void FreezeFunctions(void);
+
+void SetProfile(const int enable);
+void ProfileStart(PROFILE_CLOCK * clock);
+void ProfileStop(PROFILE_CLOCK * clock, PROFILE * profile);
+PROFILE *FunctionProfile(const char *name);
+void EachFunction(void (*callback) (const char *name, PROFILE * profile, void *data), void *data);
 
 void DeleteVariables(void);
 void DeleteFunctions(void);
@@ -62,8 +95,15 @@ RESULT *CopyResult(RESULT ** result, RESULT * value);
 double R2N(RESULT * result);
 char *R2S(RESULT * result);
 
+void SetBytecode(const int enable);
+void EvalTick(void);
+int NewTick(unsigned long *tick);
+
 int Compile(const char *expression, void **tree);
 int Eval(void *tree, RESULT * result);
+int EvalBorrow(void *tree, RESULT ** result);
+int EvalStale(void *tree);
+int EvalUnknown(void *tree);
 void DelTree(void *tree);
 
 #endif
@@ -29,10 +29,14 @@
  *   Adds a file description to watch
  *
  * int event_del(const int fd);
- *   Remove an event
+ *   Remove an event; returns -1 if there is no event on fd
  *
  * int event_modify(const int fd, const int read, const int write, const int active);
- *   Modify an event
+ *   Modify an event; returns -1 if there is no event on fd
+ *
+ * int event_del_data(const int fd, const void *data);
+ * int event_modify_data(const int fd, const void *data, const int read, const int write, const int active);
+ *   the same for the event on fd which has been added with this data
  *
  * int named_event_add(char *event, void (*callback) (void *data), void *data);
  *   Add an event identified by a string
@@ -43,12 +47,26 @@
  * int named_event_trigger(char *event);	//call all calbacks for this event
  *   call the callbacks of all events that have identified as this string
  *
+ * int named_event_id(const char *event);
+ *   interns an event name, returns its ID or -1
+ *
+ * int named_event_trigger_id(const int id);
+ *   call the callbacks of the event with this ID
+ *
  * int event_process(const struct timespec *delay);
- *   process the event list
+ *   process the event list; waits without a timeout if delay is NULL
  *
  * void event_exit();
  *   releases all events
  *
+ * On Linux, file descriptors stay registered with an epoll instance
+ * ('Event.epoll 0' falls back to ppoll), so adding, modifying and
+ * deleting an event is O(1) and processing does not allocate. Several
+ * events may share a file descriptor (D-Bus watches do); these are
+ * told apart by their data with event_del_data() and
+ * event_modify_data(), while event_del() and event_modify() act on the
+ * first one added.
+ *
  */
 
 
@@ -57,11 +75,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-
-
+#include <errno.h>
+#include <unistd.h>
 
 #include <poll.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 #include "debug.h"
 #include "cfg.h"
 #include "event.h"
@@ -70,144 +92,436 @@
 #include <dmalloc.h>
 #endif
 
+/* maximum number of ready file descriptors per epoll_wait() */
+#define EVENT_MAX_READY 64
+
 typedef struct {
     void (*callback) (event_flags_t flags, void *data);
     void *data;
-    int fd;
+    int fd;			/* -1 if the slot is free */
     int read;
     int write;
     int active;
-    int fds_id;
+    int next;			/* next event on the same fd, or next free slot */
 } event_t;
 
+/* per file descriptor state */
+typedef struct {
+    int first;			/* first event on this fd, or -1 */
+    int registered;		/* fd is watched by epoll/poll */
+    int mask;			/* epoll events the fd is registered for */
+} event_fd_t;
+
 
 //our set of FDs
 static event_t *events = NULL;
+static int event_size = 0;
 static int event_count = 0;
+static int event_free = -1;
+
+//indexed by file descriptor
+static event_fd_t *event_fds = NULL;
+static int event_nfds = 0;
+
+//epoll instance, -1 for the ppoll fallback
+static int event_epoll = -1;
+static int event_init_done = 0;
+
+//pollfd array of the ppoll fallback, rebuilt only if registrations changed
+static struct pollfd *event_pollfds = NULL;
+static int event_npollfds = 0;
+static int event_spollfds = 0;
+static int event_dirty = 0;
+
 static void free_events(void);
+static void free_named_events(void);
+
+
+/* set up the epoll instance, unless disabled by 'Event.epoll 0' */
+static void event_init(void)
+{
+    int enable;
+
+    event_init_done = 1;
+
+    cfg_number("Event", "epoll", 1, 0, 1, &enable);
+    if (!enable)
+	return;
+
+#ifdef __linux__
+    event_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (event_epoll < 0) {
+	info("event: epoll_create1() failed: %s, using poll", strerror(errno));
+	event_epoll = -1;
+    }
+#endif
+}
+
+
+/* first event on a file descriptor, or -1 */
+static int event_find(const int fd)
+{
+    if (fd < 0 || fd >= event_nfds)
+	return -1;
+    return event_fds[fd].first;
+}
+
+
+/* (re-)register a file descriptor for the union of its active events */
+static int event_update(const int fd)
+{
+    int i, active = 0, mask = 0;
+
+    for (i = event_fds[fd].first; i >= 0; i = events[i].next) {
+	if (events[i].active) {
+	    active = 1;
+#ifdef __linux__
+	    if (events[i].read)
+		mask |= EPOLLIN;
+	    if (events[i].write)
+		mask |= EPOLLOUT;
+#endif
+	}
+    }
+
+    if (active == event_fds[fd].registered && mask == event_fds[fd].mask)
+	return 0;
+
+#ifdef __linux__
+    if (event_epoll >= 0) {
+	struct epoll_event ev;
+	int op = !active ? EPOLL_CTL_DEL : event_fds[fd].registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = mask;
+	ev.data.fd = fd;
+	/* a closed fd has already been removed by the kernel */
+	if (epoll_ctl(event_epoll, op, fd, &ev) < 0 && !(op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))) {
+	    error("event: epoll_ctl(%d) failed: %s", fd, strerror(errno));
+	    return -1;
+	}
+    }
+#endif
+
+    event_fds[fd].registered = active;
+    event_fds[fd].mask = mask;
+    event_dirty = 1;
+
+    return 0;
+}
+
 
 int event_add(void (*callback) (event_flags_t flags, void *data), void *data, const int fd, const int read,
 	      const int write, const int active)
 {
-    event_count++;
-    events = realloc(events, sizeof(event_t) * event_count);
+    int i, n;
+
+    if (fd < 0)
+	return -1;
+
+    if (!event_init_done)
+	event_init();
+
+    /* grow the fd table */
+    if (fd >= event_nfds) {
+	event_fd_t *tmp;
+	for (n = event_nfds ? event_nfds : 16; n <= fd; n *= 2);
+	if ((tmp = realloc(event_fds, n * sizeof(event_fd_t))) == NULL)
+	    return -1;
+	event_fds = tmp;
+	for (i = event_nfds; i < n; i++) {
+	    event_fds[i].first = -1;
+	    event_fds[i].registered = 0;
+	    event_fds[i].mask = 0;
+	}
+	event_nfds = n;
+    }
+
+    /* take a free slot, or grow the event table */
+    if (event_free < 0) {
+	event_t *tmp;
+	n = event_size ? 2 * event_size : 16;
+	if ((tmp = realloc(events, n * sizeof(event_t))) == NULL)
+	    return -1;
+	events = tmp;
+	for (i = n - 1; i >= event_size; i--) {
+	    events[i].fd = -1;
+	    events[i].next = event_free;
+	    event_free = i;
+	}
+	event_size = n;
+    }
+    i = event_free;
+    event_free = events[i].next;
 
-    int i = event_count - 1;
     events[i].callback = callback;
     events[i].data = data;
     events[i].fd = fd;
     events[i].read = read;
     events[i].write = write;
     events[i].active = active;
-    events[i].fds_id = -1;
+    events[i].next = -1;
+
+    /* append to the events on this fd */
+    if (event_fds[fd].first < 0) {
+	event_fds[fd].first = i;
+    } else {
+	for (n = event_fds[fd].first; events[n].next >= 0; n = events[n].next);
+	events[n].next = i;
+    }
+    event_count++;
+
+    return event_update(fd);
+}
+
+
+/* call the callbacks of all active events on a ready fd */
+static void event_dispatch(const int fd, const int flags)
+{
+    int i, next, mask;
+
+    for (i = event_find(fd); i >= 0; i = next) {
+	next = events[i].next;
+	mask = EVENT_HUP | EVENT_ERR;
+	if (events[i].read)
+	    mask |= EVENT_READ;
+	if (events[i].write)
+	    mask |= EVENT_WRITE;
+	if (events[i].active && (flags & mask))
+	    events[i].callback(flags & mask, events[i].data);
+	/* the callback may have removed the following event */
+	if (next >= 0 && events[next].fd != fd)
+	    break;
+    }
+}
+
+
+#ifdef __linux__
+static int event_process_epoll(const struct timespec *timeout)
+{
+    struct epoll_event ready[EVENT_MAX_READY];
+    int i, n, flags, ms = -1;
+
+    /* round up, so we do not wake up before the timeout */
+    if (timeout)
+	ms = timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000;
+
+    n = epoll_wait(event_epoll, ready, EVENT_MAX_READY, ms);
+    if (n < 0) {
+	if (errno != EINTR)
+	    error("event: epoll_wait() failed: %s", strerror(errno));
+	return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+	flags = 0;
+	if (ready[i].events & EPOLLIN)
+	    flags |= EVENT_READ;
+	if (ready[i].events & EPOLLOUT)
+	    flags |= EVENT_WRITE;
+	if (ready[i].events & EPOLLHUP)
+	    flags |= EVENT_HUP;
+	if (ready[i].events & EPOLLERR)
+	    flags |= EVENT_ERR;
+	event_dispatch(ready[i].data.fd, flags);
+    }
+
     return 0;
 }
+#endif
 
 
-int event_process(const struct timespec *timeout)
+static int event_process_poll(const struct timespec *timeout)
 {
-    int i, j;
-    struct pollfd *fds = malloc(sizeof(struct pollfd) * event_count);
-    for (i = 0, j = 0; i < event_count; i++) {
-	events[i].fds_id = -1;
-	if (events[i].active) {
-	    events[i].fds_id = j;
-	    fds[j].events = 0;
-	    fds[j].fd = events[i].fd;
-	    if (events[i].read) {
-		fds[j].events |= POLLIN;
-	    }
-	    if (events[i].write) {
-		fds[j].events |= POLLOUT;
+    int i, j, fd;
+
+    /* rebuild the pollfd array only if registrations have changed */
+    if (event_dirty) {
+	if (event_spollfds < event_count) {
+	    struct pollfd *tmp;
+	    if ((tmp = realloc(event_pollfds, event_count * sizeof(struct pollfd))) == NULL)
+		return -1;
+	    event_pollfds = tmp;
+	    event_spollfds = event_count;
+	}
+	for (fd = 0, j = 0; fd < event_nfds; fd++) {
+	    if (!event_fds[fd].registered)
+		continue;
+	    event_pollfds[j].fd = fd;
+	    event_pollfds[j].events = 0;
+	    for (i = event_fds[fd].first; i >= 0; i = events[i].next) {
+		if (!events[i].active)
+		    continue;
+		if (events[i].read)
+		    event_pollfds[j].events |= POLLIN;
+		if (events[i].write)
+		    event_pollfds[j].events |= POLLOUT;
 	    }
 	    j++;
 	}
+	event_npollfds = j;
+	event_dirty = 0;
     }
 #if (__GLIBC__ >= 2 && __GLIBC_MINOR__ >= 4)
-    int ready = ppoll(fds, j, timeout, NULL);
+    int ready = ppoll(event_pollfds, event_npollfds, timeout, NULL);
 #else
-    int ready = poll(fds, j, timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000);
+    int ready = poll(event_pollfds, event_npollfds, timeout ? timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000 : -1);
 #endif
 
-    if (ready > 0) {
-	//search the file descriptors, call all relavant callbacks
-	for (i = 0, j = 0; i < event_count; i++) {
-	    if (events[i].fds_id != j) {
-		continue;
+    //search the file descriptors, call all relavant callbacks
+    for (j = 0; ready > 0 && j < event_npollfds; j++) {
+	if (event_pollfds[j].revents) {
+	    int flags = 0;
+	    ready--;
+	    if (event_pollfds[j].revents & POLLIN) {
+		flags |= EVENT_READ;
 	    }
-	    if (fds[j].revents) {
-		int flags = 0;
-		if (fds[j].revents & POLLIN) {
-		    flags |= EVENT_READ;
-		}
-		if (fds[j].revents & POLLOUT) {
-		    flags |= EVENT_WRITE;
-		}
-		if (fds[j].revents & POLLHUP) {
-		    flags |= EVENT_HUP;
-		}
-		if (fds[j].revents & POLLERR) {
-		    flags |= EVENT_ERR;
-		}
-		events[i].callback(flags, events[i].data);
-
+	    if (event_pollfds[j].revents & POLLOUT) {
+		flags |= EVENT_WRITE;
 	    }
-	    j++;
+	    if (event_pollfds[j].revents & POLLHUP) {
+		flags |= EVENT_HUP;
+	    }
+	    if (event_pollfds[j].revents & POLLERR) {
+		flags |= EVENT_ERR;
+	    }
+	    event_dispatch(event_pollfds[j].fd, flags);
 	}
     }
-    free(fds);
+
     return 0;
+}
+
+
+int event_process(const struct timespec *timeout)
+{
+    if (!event_init_done)
+	event_init();
+
+#ifdef __linux__
+    if (event_epoll >= 0)
+	return event_process_epoll(timeout);
+#endif
 
+    return event_process_poll(timeout);
 }
 
-int event_del(const int fd)
+
+/* event on fd with the given data (any event if 'any' is set), or -1; */
+/* 'prev' returns the preceding event on the same fd */
+static int event_find_data(const int fd, const int any, const void *data, int *prev)
 {
     int i;
-    for (i = 0; i < event_count; i++) {
-	if (events[i].fd == fd) {
-	    events[i] = events[event_count - 1];
-	    break;
-	}
+
+    *prev = -1;
+    for (i = event_find(fd); i >= 0; i = events[i].next) {
+	if (any || events[i].data == data)
+	    return i;
+	*prev = i;
     }
+    return -1;
+}
+
+
+static int event_unlink(const int fd, const int any, const void *data)
+{
+    int prev, i = event_find_data(fd, any, data, &prev);
+
+    if (i < 0)
+	return -1;
+
+    if (prev < 0)
+	event_fds[fd].first = events[i].next;
+    else
+	events[prev].next = events[i].next;
+    events[i].fd = -1;
+    events[i].next = event_free;
+    event_free = i;
     event_count--;
-    events = realloc(events, sizeof(event_t) * event_count);
-    return 0;
+
+    return event_update(fd);
+}
+
+
+static int event_change(const int fd, const int any, const void *data, const int read, const int write,
+			const int active)
+{
+    int prev, i = event_find_data(fd, any, data, &prev);
+
+    if (i < 0)
+	return -1;
+
+    events[i].read = read;
+    events[i].write = write;
+    events[i].active = active;
+
+    return event_update(fd);
 }
 
+
+int event_del(const int fd)
+{
+    return event_unlink(fd, 1, NULL);
+}
+
+
+int event_del_data(const int fd, const void *data)
+{
+    return event_unlink(fd, 0, data);
+}
+
+
 int event_modify(const int fd, const int read, const int write, const int active)
 {
-    int i;
-    for (i = 0; i < event_count; i++) {
-	if (events[i].fd == fd) {
-	    events[i].read = read;
-	    events[i].write = write;
-	    events[i].active = active;
-	    break;
-	}
-    }
-    event_count--;
-    events = realloc(events, sizeof(event_t) * event_count);
-    return 0;
+    return event_change(fd, 1, NULL, read, write, active);
 }
 
+
+int event_modify_data(const int fd, const void *data, const int read, const int write, const int active)
+{
+    return event_change(fd, 0, data, read, write, active);
+}
+
+
 static void free_events(void)
 {
-    if (events != NULL) {
-	free(events);
-    }
-    event_count = 0;
+    free(events);
     events = NULL;
+    event_size = 0;
+    event_count = 0;
+    event_free = -1;
+
+    free(event_fds);
+    event_fds = NULL;
+    event_nfds = 0;
+
+    free(event_pollfds);
+    event_pollfds = NULL;
+    event_npollfds = 0;
+    event_spollfds = 0;
+    event_dirty = 0;
 
+    if (event_epoll >= 0) {
+	close(event_epoll);
+	event_epoll = -1;
+    }
+    event_init_done = 0;
 }
 
 void event_exit(void)
 {
     free_events();
+    free_named_events();
 }
 
 /*
  * Named events are the user facing side of the event subsystem
  *
+ * Event names are interned: each name gets an ID (its index in
+ * ev_names) the first time it is used, which stays valid until
+ * event_exit(). A hash table maps names to IDs, so triggering by
+ * name is O(1), and triggering by ID is a plain array access.
+ *
  */
 
 
@@ -219,13 +533,109 @@ typedef struct {
 
 typedef struct {
     char *name;
+    unsigned hash;
     event_callback_t *c;
     int callback_count;
+    int callback_size;
 } named_event_list_t;
 
 
 static named_event_list_t *ev_names = NULL;
 static int ev_count = 0;
+static int ev_size = 0;
+
+//open addressing hash of ev_names IDs (+1, 0 is an empty slot), at most half full
+static int *ev_index = NULL;
+static int ev_index_size = 0;
+
+
+/* FNV-1a hash of an event name */
+static unsigned named_event_hash(const char *name)
+{
+    unsigned hash = 2166136261u;
+
+    while (*name) {
+	hash ^= (unsigned char) *name++;
+	hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/* ID of an interned event name, or -1 */
+static int named_event_find(const char *event, const unsigned hash)
+{
+    unsigned mask, i;
+    int id;
+
+    if (ev_index_size == 0)
+	return -1;
+
+    mask = ev_index_size - 1;
+    for (i = hash & mask; (id = ev_index[i] - 1) >= 0; i = (i + 1) & mask) {
+	if (ev_names[id].hash == hash && strcmp(ev_names[id].name, event) == 0)
+	    return id;
+    }
+    return -1;
+}
+
+
+int named_event_id(const char *event)
+{
+    unsigned hash, mask, i;
+    int id;
+
+    if (event == NULL || *event == '\0') {
+	return -1;
+    }
+
+    hash = named_event_hash(event);
+    if ((id = named_event_find(event, hash)) >= 0) {
+	return id;
+    }
+
+    //grow the index, so it stays at most half full
+    if (2 * (ev_count + 1) > ev_index_size) {
+	int size = ev_index_size ? 2 * ev_index_size : 32;
+	int *index = calloc(size, sizeof(int));
+	if (index == NULL) {
+	    return -1;
+	}
+	free(ev_index);
+	ev_index = index;
+	ev_index_size = size;
+	mask = size - 1;
+	for (id = 0; id < ev_count; id++) {
+	    for (i = ev_names[id].hash & mask; ev_index[i] != 0; i = (i + 1) & mask);
+	    ev_index[i] = id + 1;
+	}
+    }
+
+    if (ev_count >= ev_size) {
+	int size = ev_size ? 2 * ev_size : 16;
+	named_event_list_t *names = realloc(ev_names, sizeof(named_event_list_t) * size);
+	if (names == NULL) {
+	    return -1;
+	}
+	ev_names = names;
+	ev_size = size;
+    }
+
+    //create the entry
+    id = ev_count++;
+    ev_names[id].name = strdup(event);
+    ev_names[id].hash = hash;
+    ev_names[id].c = NULL;
+    ev_names[id].callback_count = 0;
+    ev_names[id].callback_size = 0;
+
+    mask = ev_index_size - 1;
+    for (i = hash & mask; ev_index[i] != 0; i = (i + 1) & mask);
+    ev_index[i] = id + 1;
+
+    return id;
+}
+
 
 int named_event_add(char *event, void (*callback) (void *data), void *data)
 {
@@ -235,23 +645,20 @@ int named_event_add(char *event, void (*callback) (void *data), void *data)
     if (callback == NULL) {
 	return 2;
     }
-    int i;
-    for (i = 0; i < ev_count; i++) {
-	if (0 == strcmp(event, ev_names[i].name)) {
-	    break;
-	}
+    int i = named_event_id(event);
+    if (i < 0) {
+	return 3;
     }
-    if (i >= ev_count) {
-	//create the entry
-	ev_count++;
-	ev_names = realloc(ev_names, sizeof(named_event_list_t) * ev_count);
-	ev_names[i].name = strdup(event);
-	ev_names[i].callback_count = 0;
-	ev_names[i].c = NULL;
+    if (ev_names[i].callback_count >= ev_names[i].callback_size) {
+	int size = ev_names[i].callback_size ? 2 * ev_names[i].callback_size : 4;
+	event_callback_t *c = realloc(ev_names[i].c, sizeof(event_callback_t) * size);
+	if (c == NULL) {
+	    return 3;
+	}
+	ev_names[i].c = c;
+	ev_names[i].callback_size = size;
     }
-    int j = ev_names[i].callback_count;
-    ev_names[i].callback_count++;
-    ev_names[i].c = realloc(ev_names[i].c, sizeof(event_callback_t) * ev_names[i].callback_count);
+    int j = ev_names[i].callback_count++;
 
     ev_names[i].c[j].callback = callback;
     ev_names[i].c[j].data = data;
@@ -261,42 +668,56 @@ int named_event_add(char *event, void (*callback) (void *data), void *data)
 int named_event_del(char *event, void (*callback) (void *data), void *data)
 {
     int i, j;
-    for (i = 0; i < ev_count; i++) {
-	if (0 == strcmp(event, ev_names[i].name)) {
-	    break;
-	}
-    }
-    if (i >= ev_count) {
+
+    if (event == NULL || (i = named_event_find(event, named_event_hash(event))) < 0) {
 	return 1;		//nothing removed
     }
     for (j = 0; j < ev_names[i].callback_count; j++) {
 	if (ev_names[i].c[j].callback == callback && ev_names[i].c[j].data == data) {
+	    //the ID stays interned, even without callbacks
 	    ev_names[i].callback_count--;
 	    ev_names[i].c[j] = ev_names[i].c[ev_names[i].callback_count];
-	    ev_names[i].c = realloc(ev_names[i].c, sizeof(event_callback_t) * ev_names[i].callback_count);
-	    if (ev_names[i].callback_count == 0) {
-		//drop this event
-		free(ev_names[i].name);
-		ev_count--;
-		ev_names[i] = ev_names[ev_count];
-		ev_names = realloc(ev_names, sizeof(named_event_list_t) * ev_count);
-	    }
 	    return 0;
 	}
     }
     return 2;
 }
 
+int named_event_trigger_id(const int id)
+{
+    int j;
+
+    if (id < 0 || id >= ev_count) {
+	return 1;
+    }
+    for (j = 0; j < ev_names[id].callback_count; j++) {
+	ev_names[id].c[j].callback(ev_names[id].c[j].data);
+    }
+    return 0;
+}
+
 int named_event_trigger(char *event)
 {
-    int i, j;
+    if (event == NULL) {
+	return 1;
+    }
+    return named_event_trigger_id(named_event_find(event, named_event_hash(event)));
+}
+
+static void free_named_events(void)
+{
+    int i;
+
     for (i = 0; i < ev_count; i++) {
-	if (0 == strcmp(event, ev_names[i].name)) {
-	    for (j = 0; j < ev_names[i].callback_count; j++) {
-		ev_names[i].c[j].callback(ev_names[i].c[j].data);
-	    }
-	    return 0;
-	}
+	free(ev_names[i].name);
+	free(ev_names[i].c);
     }
-    return 1;
+    free(ev_names);
+    ev_names = NULL;
+    ev_count = 0;
+    ev_size = 0;
+
+    free(ev_index);
+    ev_index = NULL;
+    ev_index_size = 0;
 }
@@ -51,6 +51,9 @@ int event_add(void (*callback) (event_flags_t flags, void *data), void *data, co
 	      const int write, const int active);
 int event_del(const int fd);
 int event_modify(const int fd, const int read, const int write, const int active);
+//for several events on one fd, identified by their data
+int event_del_data(const int fd, const void *data);
+int event_modify_data(const int fd, const void *data, const int read, const int write, const int active);
 int event_process(const struct timespec *timeout);
 void event_exit(void);
 
@@ -64,5 +67,8 @@ int named_event_add(char *event, void (*callback) (void *data), void *data);
 //remove an event from the list of events
 int named_event_del(char *event, void (*callback) (void *data), void *data);
 int named_event_trigger(char *event);	//call all calbacks for this event
+//events may also be identified by the ID of their interned name
+int named_event_id(const char *event);
+int named_event_trigger_id(const int id);
 
 #endif
@@ -30,6 +30,14 @@
  * void hash_create (HASH *Hash);
  *   initializes hash
  *
+ * void hash_set_column (HASH *Hash, int number, char *column);
+ *   names a column; every value is parsed into a record of
+ *   numbers (the value and its named columns) when it is put
+ *   into the hash, so delta values need no parsing
+ *
+ * void hash_set_delimiter (HASH *Hash, char *delimiter);
+ *   sets the column delimiters
+ *
  * int hash_age (HASH *Hash, char *key, char **value);
  *   return time of last hash_put
  *
@@ -37,16 +45,25 @@
  *   set an entry in the hash
  *
  * void hash_put_delta (HASH *Hash, char *key, char *val);
- *   set a delta entry in the hash
+ *   set a delta entry in the hash; the last DELTA_SLOTS records
+ *   are kept in a ring, ordered by (monotonic) time
  *
- * char *hash_get (HASH *Hash, char *key);
- *   fetch an entry from the hash
+ * char *hash_get (HASH *Hash, char *key, char *column);
+ *   fetch an entry from the hash; the returned string is
+ *   valid until the next hash_get() on the same hash
  *
  * double hash_get_delta (HASH *Hash, char *key, int delay);
  *   fetch a delta antry from the hash
  *
  * double hash_get_regex (HASH *Hash, char *key, int delay);
- *   fetch one or more entries from the hash
+ *   fetch one or more entries from the hash; the compiled pattern
+ *   and the matching items are cached, only items added later
+ *   have to be matched against the pattern
+ *
+ * double hash_get_window (HASH *Hash, char *key, char *column, int window, char *what, int rate);
+ *   aggregates the values (or the rates, if 'rate' is set) of the
+ *   last 'window' msec; 'what' is one of min, max, mean, ewma or
+ *   pNN for the NNth percentile
  *
  * void hash_destroy (HASH *Hash);
  *   releases hash
@@ -59,7 +76,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <regex.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
 
 #include "debug.h"
 #include "hash.h"
@@ -74,42 +93,45 @@
 /* string buffer chunk size */
 #define CHUNK_SIZE 16
 
+/* maximum number of cached regular expressions */
+#define REGEX_MAX 64
+
 
 /* initialize a new hash table */
 void hash_create(HASH * Hash)
 {
-    Hash->sorted = 0;
-
-    Hash->timestamp.tv_sec = 0;
-    Hash->timestamp.tv_usec = 0;
+    Hash->timestamp = 0;
+    Hash->nValue = 1;
 
     Hash->nItems = 0;
+    Hash->sItems = 0;
     Hash->Items = NULL;
 
+    Hash->nIndex = 0;
+    Hash->Index = NULL;
+
     Hash->nColumns = 0;
     Hash->Columns = NULL;
 
     Hash->delimiter = strdup(" \t\n");
-}
 
+    Hash->sField = 0;
+    Hash->field = NULL;
 
-/* bsearch compare function for hash items */
-static int hash_lookup_item(const void *a, const void *b)
-{
-    char *key = (char *) a;
-    HASH_ITEM *item = (HASH_ITEM *) b;
-
-    return strcasecmp(key, item->key);
+    Hash->nRegex = 0;
+    Hash->Regex = NULL;
 }
 
 
-/* qsort compare function for hash items */
-static int hash_sort_item(const void *a, const void *b)
+/* case insensitive FNV-1a hash of a key */
+static unsigned int hash_key(const char *key)
 {
-    HASH_ITEM *ha = (HASH_ITEM *) a;
-    HASH_ITEM *hb = (HASH_ITEM *) b;
+    unsigned int h = 2166136261u;
 
-    return strcasecmp(ha->key, hb->key);
+    while (*key)
+	h = (h ^ (unsigned char) tolower(*key++)) * 16777619u;
+
+    return h;
 }
 
 
@@ -133,81 +155,150 @@ static int hash_sort_column(const void *a, const void *b)
 }
 
 
-/* split a value into columns and  */
-/* return the nth column in a string */
-/* WARNING: does return a pointer to a static string!! */
-static char *split(const char *val, const int column, const char *delimiter)
+/* find the nth column of a value, columns are */
+/* separated by one or more delimiters */
+/* returns the start of the column and its length */
+static const char *hash_field(const char *val, const int column, const char *delimiter, size_t * len)
 {
-    static char buffer[256];
-    int num;
-    size_t len;
     const char *beg, *end;
+    int num;
 
-    if (column < 0)
-	return (char *) val;
-    if (val == NULL)
-	return NULL;
-
-    num = 0;
-    len = 0;
     beg = val;
-    end = beg;
-    while (beg && *beg) {
-	while (strchr(delimiter, *beg))
-	    beg++;
-	end = strpbrk(beg, delimiter);
-	if (num++ == column)
+    for (num = 0;; num++) {
+	beg += strspn(beg, delimiter);
+	if (*beg == '\0')
 	    break;
-	beg = end ? end + 1 : NULL;
+	end = beg + strcspn(beg, delimiter);
+	if (num == column) {
+	    *len = end - beg;
+	    return beg;
+	}
+	beg = end;
     }
-    if (beg != NULL) {
-	len = end ? (size_t) (end - beg) : strlen(beg);
-	if (len >= sizeof(buffer))
-	    len = sizeof(buffer) - 1;
-	strncpy(buffer, beg, len);
+
+    *len = 0;
+    return beg;
+}
+
+
+/* convert a column into a number */
+static double hash_number(const char *field, const size_t len)
+{
+    char buffer[64];
+    char *copy;
+    double value;
+
+    /* the column is not terminated, and atof() */
+    /* might read beyond a delimiter like '-' */
+    if (len < sizeof(buffer)) {
+	memcpy(buffer, field, len);
+	buffer[len] = '\0';
+	return atof(buffer);
     }
 
-    buffer[len] = '\0';
-    return buffer;
+    copy = strndup(field, len);
+    value = atof(copy);
+    free(copy);
+    return value;
+}
+
+
+/* current monotonic time in usec */
+static long long hash_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
 }
 
 
-/* search an entry in the hash table: */
-/* If the table is flagged "sorted", the entry is looked */
-/* up using the bsearch function. If the table is  */
-/* unsorted, it will be searched in a linear way */
-static HASH_ITEM *hash_lookup(HASH * Hash, const char *key, const int do_sort)
+/* parse a value into a record: the value itself, */
+/* followed by as many columns as have been named */
+static void hash_parse(HASH * Hash, const char *value, double *record)
 {
-    HASH_ITEM *Item = NULL;
+    const char *field;
+    size_t len;
+    int i;
+
+    record[0] = atof(value);
 
-    /* maybe sort the array */
-    if (do_sort && !Hash->sorted) {
-	qsort(Hash->Items, Hash->nItems, sizeof(HASH_ITEM), hash_sort_item);
-	Hash->sorted = 1;
+    field = value;
+    for (i = 1; i < Hash->nValue; i++) {
+	field = hash_field(field, 0, Hash->delimiter, &len);
+	record[i] = hash_number(field, len);
+	field += len;
     }
+}
 
-    /* no key was passed */
-    if (key == NULL)
+
+/* search an entry in the hash table */
+/* keys are compared case insensitive */
+static HASH_ITEM *hash_lookup(HASH * Hash, const char *key)
+{
+    HASH_ITEM *Item;
+    unsigned int hash, i;
+
+    /* no key was passed, or empty table */
+    if (key == NULL || Hash->nIndex == 0)
 	return NULL;
 
-    /* lookup using bsearch */
-    if (Hash->sorted) {
-	Item = bsearch(key, Hash->Items, Hash->nItems, sizeof(HASH_ITEM), hash_lookup_item);
+    hash = hash_key(key);
+
+    for (i = hash & (Hash->nIndex - 1); (Item = Hash->Index[i]) != NULL; i = (i + 1) & (Hash->nIndex - 1)) {
+	if (Item->hash == hash && strcasecmp(key, Item->key) == 0)
+	    return Item;
     }
 
-    /* linear search */
-    if (Item == NULL) {
-	int i;
-	for (i = 0; i < Hash->nItems; i++) {
-	    if (strcmp(key, Hash->Items[i].key) == 0) {
-		Item = &(Hash->Items[i]);
-		break;
-	    }
-	}
+    return NULL;
+}
+
+
+/* enter an item into the index */
+static void hash_index(HASH * Hash, HASH_ITEM * Item)
+{
+    unsigned int i;
+
+    for (i = Item->hash & (Hash->nIndex - 1); Hash->Index[i] != NULL; i = (i + 1) & (Hash->nIndex - 1));
+    Hash->Index[i] = Item;
+}
+
+
+/* add a new item, keep the index at most half full */
+static HASH_ITEM *hash_add(HASH * Hash, const char *key)
+{
+    HASH_ITEM *Item;
+    int i;
+
+    if (2 * (Hash->nItems + 1) > Hash->nIndex) {
+	Hash->nIndex = Hash->nIndex ? 2 * Hash->nIndex : 32;
+	free(Hash->Index);
+	Hash->Index = calloc(Hash->nIndex, sizeof(HASH_ITEM *));
+	for (i = 0; i < Hash->nItems; i++)
+	    hash_index(Hash, Hash->Items[i]);
     }
 
-    return Item;
+    if (Hash->nItems >= Hash->sItems) {
+	Hash->sItems = Hash->sItems ? 2 * Hash->sItems : 32;
+	Hash->Items = realloc(Hash->Items, Hash->sItems * sizeof(HASH_ITEM *));
+    }
 
+    Item = malloc(sizeof(HASH_ITEM));
+    Item->key = strdup(key);
+    Item->hash = hash_key(key);
+    Item->size = 0;
+    Item->value = NULL;
+    Item->index = 0;
+    Item->nSlot = 0;
+    Item->nFill = 0;
+    Item->nValue = 0;
+    Item->Time = NULL;
+    Item->Value = NULL;
+
+    Hash->Items[Hash->nItems++] = Item;
+    hash_index(Hash, Item);
+
+    return Item;
 }
 
 
@@ -217,20 +308,18 @@ static HASH_ITEM *hash_lookup(HASH * Hash, const char *key, const int do_sort)
 int hash_age(HASH * Hash, const char *key)
 {
     HASH_ITEM *Item;
-    struct timeval now, *timestamp;
+    long long timestamp;
 
     if (key == NULL) {
-	timestamp = &(Hash->timestamp);
+	timestamp = Hash->timestamp;
     } else {
-	Item = hash_lookup(Hash, key, 1);
+	Item = hash_lookup(Hash, key);
 	if (Item == NULL)
 	    return -1;
-	timestamp = &(Item->Slot[Item->index].timestamp);
+	timestamp = Item->Time[Item->index];
     }
 
-    gettimeofday(&now, NULL);
-
-    return (now.tv_sec - timestamp->tv_sec) * 1000 + (now.tv_usec - timestamp->tv_usec) / 1000;
+    return (hash_now() - timestamp) / 1000;
 }
 
 
@@ -245,6 +334,10 @@ void hash_set_column(HASH * Hash, const int number, const char *column)
     Hash->Columns[Hash->nColumns - 1].key = strdup(column);
     Hash->Columns[Hash->nColumns - 1].val = number;
 
+    /* records hold the value and columns 0..number */
+    if (Hash->nValue < number + 2)
+	Hash->nValue = number + 2;
+
     qsort(Hash->Columns, Hash->nColumns, sizeof(HASH_COLUMN), hash_sort_column);
 
 }
@@ -279,14 +372,176 @@ void hash_set_delimiter(HASH * Hash, const char *delimiter)
 char *hash_get(HASH * Hash, const char *key, const char *column)
 {
     HASH_ITEM *Item;
+    const char *field;
+    size_t len;
     int c;
 
-    Item = hash_lookup(Hash, key, 1);
+    Item = hash_lookup(Hash, key);
     if (Item == NULL)
 	return NULL;
 
     c = hash_get_column(Hash, column);
-    return split(Item->Slot[Item->index].value, c, Hash->delimiter);
+    if (c < 0)
+	return Item->value;
+
+    field = hash_field(Item->value, c, Hash->delimiter, &len);
+    if ((int) len >= Hash->sField) {
+	Hash->sField = CHUNK_SIZE * (len / CHUNK_SIZE + 1);
+	Hash->field = realloc(Hash->field, Hash->sField);
+    }
+    memcpy(Hash->field, field, len);
+    Hash->field[len] = '\0';
+
+    return Hash->field;
+}
+
+
+/* column c of record i of an item */
+static double hash_value(HASH_ITEM * Item, const int i, const int c)
+{
+    return Item->Value[((Item->index + i) % Item->nSlot) * Item->nValue + c + 1];
+}
+
+
+/* time of record i of an item */
+static long long hash_time(HASH_ITEM * Item, const int i)
+{
+    return Item->Time[(Item->index + i) % Item->nSlot];
+}
+
+
+/* the newest record which is older than 'end', */
+/* or the oldest record if there is none */
+static int hash_search(HASH_ITEM * Item, const long long end)
+{
+    int lo, hi, mid;
+
+    /* records get older with increasing i */
+    lo = 1;
+    hi = Item->nFill - 1;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (hash_time(Item, mid) < end)
+	    hi = mid;
+	else
+	    lo = mid + 1;
+    }
+    return hi;
+}
+
+
+/* get a delta value of column c of an item */
+static double hash_item_delta(HASH_ITEM * Item, const int c, const int delay)
+{
+    int i;
+    double dv, dt;
+
+    /* if delay is zero, return absolute value */
+    if (delay == 0)
+	return hash_value(Item, 0, c);
+
+    /* not enough records available... */
+    if (Item->nFill < 2)
+	return 0.0;
+
+    /* search delta record */
+    i = hash_search(Item, hash_time(Item, 0) - 1000LL * delay);
+
+    /* delta value, delta time */
+    dv = hash_value(Item, 0, c) - hash_value(Item, i, c);
+    dt = (hash_time(Item, 0) - hash_time(Item, i)) / 1000000.0;
+
+    if (dt > 0.0 && dv >= 0.0)
+	return dv / dt;
+    return 0.0;
+}
+
+
+/* qsort compare function for doubles */
+static int hash_sort_double(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+
+/* aggregate column c of all records of the last */
+/* 'window' msec, or of the rates between them */
+static double hash_item_window(HASH_ITEM * Item, const int c, const int window, const char *what, const int rate)
+{
+    double sample[DELTA_SLOTS], stamp[DELTA_SLOTS];
+    double value, ewma, alpha;
+    long long end;
+    int i, n, last;
+
+    /* collect samples, oldest first */
+    end = hash_time(Item, 0) - 1000LL * window;
+    last = Item->nFill - 1;
+    while (last > 0 && hash_time(Item, last) < end)
+	last--;
+    if (rate && last == Item->nFill - 1)
+	last--;
+
+    n = 0;
+    for (i = last; i >= 0 && n < DELTA_SLOTS; i--) {
+	if (rate) {
+	    double dv = hash_value(Item, i, c) - hash_value(Item, i + 1, c);
+	    double dt = (hash_time(Item, i) - hash_time(Item, i + 1)) / 1000000.0;
+	    /* skip counter wraps */
+	    if (dt <= 0.0 || dv < 0.0)
+		continue;
+	    value = dv / dt;
+	} else {
+	    value = hash_value(Item, i, c);
+	}
+	stamp[n] = hash_time(Item, i) / 1000000.0;
+	sample[n++] = value;
+    }
+
+    if (n == 0)
+	return 0.0;
+
+    if (strcasecmp(what, "min") == 0 || strcasecmp(what, "max") == 0) {
+	int max = strcasecmp(what, "max") == 0;
+	value = sample[0];
+	for (i = 1; i < n; i++) {
+	    if (max ? sample[i] > value : sample[i] < value)
+		value = sample[i];
+	}
+	return value;
+    }
+
+    if (strcasecmp(what, "mean") == 0) {
+	value = 0.0;
+	for (i = 0; i < n; i++)
+	    value += sample[i];
+	return value / n;
+    }
+
+    /* time weighted, with the window as time constant */
+    if (strcasecmp(what, "ewma") == 0) {
+	ewma = sample[0];
+	for (i = 1; i < n; i++) {
+	    alpha = window > 0 ? 1.0 - exp(-(stamp[i] - stamp[i - 1]) * 1000.0 / window) : 1.0;
+	    ewma += alpha * (sample[i] - ewma);
+	}
+	return ewma;
+    }
+
+    /* 'p95' is the 95th percentile (nearest rank) */
+    if (tolower(what[0]) == 'p' && isdigit(what[1])) {
+	double p = atof(what + 1);
+	if (p > 100.0)
+	    p = 100.0;
+	qsort(sample, n, sizeof(double), hash_sort_double);
+	i = ceil(p / 100.0 * n) - 1;
+	return sample[i < 0 ? 0 : i];
+    }
+
+    error("unknown aggregate '%s', use min, max, mean, ewma or pNN", what);
+    return 0.0;
 }
 
 
@@ -294,66 +549,76 @@ char *hash_get(HASH * Hash, const char *key, const char *column)
 double hash_get_delta(HASH * Hash, const char *key, const char *column, const int delay)
 {
     HASH_ITEM *Item;
-    HASH_SLOT *Slot1, *Slot2;
-    int i, c;
-    double v1, v2;
-    double dv, dt;
-    struct timeval now, end;
 
     /* lookup item */
-    Item = hash_lookup(Hash, key, 1);
+    Item = hash_lookup(Hash, key);
     if (Item == NULL)
 	return 0.0;
 
-    /* this is the "current" Slot */
-    Slot1 = &(Item->Slot[Item->index]);
+    return hash_item_delta(Item, hash_get_column(Hash, column), delay);
+}
 
-    /* fetch column number */
-    c = hash_get_column(Hash, column);
 
-    /* if delay is zero, return absolute value */
-    if (delay == 0)
-	return atof(split(Slot1->value, c, Hash->delimiter));
-
-    /* prepare timing values */
-    now = Slot1->timestamp;
-    end.tv_sec = now.tv_sec;
-    end.tv_usec = now.tv_usec - 1000 * delay;
-    while (end.tv_usec < 0) {
-	end.tv_sec--;
-	end.tv_usec += 1000000;
-    }
+/* aggregate the values, or rates if 'rate' is set, */
+/* of the last 'window' msec */
+double hash_get_window(HASH * Hash, const char *key, const char *column, const int window, const char *what,
+		       const int rate)
+{
+    HASH_ITEM *Item;
 
-    /* search delta slot */
-    Slot2 = &(Item->Slot[Item->index]);
-    for (i = 1; i < Item->nSlot; i++) {
-	Slot2 = &(Item->Slot[(Item->index + i) % Item->nSlot]);
-	if (Slot2->timestamp.tv_sec == 0)
-	    break;
-	if (timercmp(&(Slot2->timestamp), &end, <))
-	    break;
+    /* lookup item */
+    Item = hash_lookup(Hash, key);
+    if (Item == NULL)
+	return 0.0;
+
+    return hash_item_window(Item, hash_get_column(Hash, column), window, what, rate);
+}
+
+
+/* compile a regular expression */
+static int hash_compile(regex_t * preg, const char *pattern)
+{
+    int err;
+
+    err = regcomp(preg, pattern, REG_ICASE | REG_NOSUB);
+    if (err != 0) {
+	char buffer[32];
+	regerror(err, preg, buffer, sizeof(buffer));
+	error("error in regular expression: %s", buffer);
+	regfree(preg);
+	return 0;
     }
+    return 1;
+}
+
+
+/* find or compile a cached regular expression */
+static HASH_REGEX *hash_regex(HASH * Hash, const char *pattern)
+{
+    HASH_REGEX *Regex;
+    int i;
 
-    /* empty slot => try the one before */
-    if (Slot2->timestamp.tv_sec == 0) {
-	i--;
-	Slot2 = &(Item->Slot[(Item->index + i) % Item->nSlot]);
+    for (i = 0; i < Hash->nRegex; i++) {
+	if (strcmp(Hash->Regex[i].pattern, pattern) == 0)
+	    return &(Hash->Regex[i]);
     }
 
-    /* not enough slots available... */
-    if (i == 0)
-	return 0.0;
+    /* patterns built at runtime must not fill up memory */
+    if (Hash->nRegex >= REGEX_MAX)
+	return NULL;
 
-    /* delta value, delta time */
-    v1 = atof(split(Slot1->value, c, Hash->delimiter));
-    v2 = atof(split(Slot2->value, c, Hash->delimiter));
-    dv = v1 - v2;
-    dt = (Slot1->timestamp.tv_sec - Slot2->timestamp.tv_sec)
-	+ (Slot1->timestamp.tv_usec - Slot2->timestamp.tv_usec) / 1000000.0;
+    Hash->nRegex++;
+    Hash->Regex = realloc(Hash->Regex, Hash->nRegex * sizeof(HASH_REGEX));
 
-    if (dt > 0.0 && dv >= 0.0)
-	return dv / dt;
-    return 0.0;
+    Regex = &(Hash->Regex[Hash->nRegex - 1]);
+    Regex->pattern = strdup(pattern);
+    Regex->valid = hash_compile(&(Regex->preg), pattern);
+    Regex->nChecked = 0;
+    Regex->nMatch = 0;
+    Regex->sMatch = 0;
+    Regex->Match = NULL;
+
+    return Regex;
 }
 
 
@@ -362,95 +627,127 @@ double hash_get_delta(HASH * Hash, const char *key, const char *column, const in
 /* of all matching entries is returned. */
 double hash_get_regex(HASH * Hash, const char *key, const char *column, const int delay)
 {
-    double sum;
+    HASH_REGEX *Regex;
     regex_t preg;
-    int i, err;
+    double sum;
+    int i, c;
 
-    err = regcomp(&preg, key, REG_ICASE | REG_NOSUB);
-    if (err != 0) {
-	char buffer[32];
-	regerror(err, &preg, buffer, sizeof(buffer));
-	error("error in regular expression: %s", buffer);
+    c = hash_get_column(Hash, column);
+    sum = 0.0;
+
+    Regex = hash_regex(Hash, key);
+
+    /* cache is full, match every item */
+    if (Regex == NULL) {
+	if (!hash_compile(&preg, key))
+	    return 0.0;
+	for (i = 0; i < Hash->nItems; i++) {
+	    if (regexec(&preg, Hash->Items[i]->key, 0, NULL, 0) == 0) {
+		sum += hash_item_delta(Hash->Items[i], c, delay);
+	    }
+	}
 	regfree(&preg);
-	return 0.0;
+	return sum;
     }
 
-    /* force the table to be sorted by requesting anything */
-    hash_lookup(Hash, NULL, 1);
+    if (!Regex->valid)
+	return 0.0;
 
-    sum = 0.0;
-    for (i = 0; i < Hash->nItems; i++) {
-	if (regexec(&preg, Hash->Items[i].key, 0, NULL, 0) == 0) {
-	    sum += hash_get_delta(Hash, Hash->Items[i].key, column, delay);
+    /* items are never removed, so only new ones have to be matched */
+    for (i = Regex->nChecked; i < Hash->nItems; i++) {
+	if (regexec(&(Regex->preg), Hash->Items[i]->key, 0, NULL, 0) == 0) {
+	    if (Regex->nMatch >= Regex->sMatch) {
+		Regex->sMatch = Regex->sMatch ? 2 * Regex->sMatch : 8;
+		Regex->Match = realloc(Regex->Match, Regex->sMatch * sizeof(HASH_ITEM *));
+	    }
+	    Regex->Match[Regex->nMatch++] = Hash->Items[i];
 	}
     }
-    regfree(&preg);
+    Regex->nChecked = Hash->nItems;
+
+    for (i = 0; i < Regex->nMatch; i++) {
+	sum += hash_item_delta(Regex->Match[i], c, delay);
+    }
+
     return sum;
 }
 
 
+/* resize the ring of an item, keeping the newest records */
+static void hash_resize(HASH * Hash, HASH_ITEM * Item, const int nSlot)
+{
+    long long *Time;
+    double *Value;
+    int i, n;
+
+    Time = malloc(nSlot * sizeof(long long));
+    Value = malloc(nSlot * Hash->nValue * sizeof(double));
+
+    /* records are useless if their columns have changed */
+    n = Item->nValue == Hash->nValue ? Item->nFill : 0;
+    if (n > nSlot)
+	n = nSlot;
+
+    for (i = 0; i < n; i++) {
+	Time[i] = hash_time(Item, i);
+	memcpy(Value + i * Hash->nValue, Item->Value + ((Item->index + i) % Item->nSlot) * Item->nValue,
+	       Hash->nValue * sizeof(double));
+    }
+
+    free(Item->Time);
+    free(Item->Value);
+    Item->Time = Time;
+    Item->Value = Value;
+    Item->index = 0;
+    Item->nSlot = nSlot;
+    Item->nFill = n;
+    Item->nValue = Hash->nValue;
+}
+
+
 /* insert a key/val pair into the hash table */
-/* If the entry does already exist, it will be overwritten, */
-/* and the table stays sorted (if it has been before). */
-/* Otherwise, the entry is appended at the end, and  */
-/* the table will be flagged 'unsorted' afterwards */
+/* If the entry does already exist, it will be overwritten. */
+/* Otherwise, a new entry is created. Entries never move, */
+/* so nothing has to be sorted or copied around. */
 
 static HASH_ITEM *hash_set(HASH * Hash, const char *key, const char *value, const int delta)
 {
     HASH_ITEM *Item;
-    HASH_SLOT *Slot;
     int size;
 
-    Item = hash_lookup(Hash, key, 0);
-
-    if (Item == NULL) {
-
-	/* add entry */
-	Hash->sorted = 0;
-	Hash->nItems++;
-	Hash->Items = realloc(Hash->Items, Hash->nItems * sizeof(HASH_ITEM));
+    Item = hash_lookup(Hash, key);
 
-	Item = &(Hash->Items[Hash->nItems - 1]);
-	Item->key = strdup(key);
-	Item->index = 0;
-	Item->nSlot = delta;
-	Item->Slot = malloc(Item->nSlot * sizeof(HASH_SLOT));
-	memset(Item->Slot, 0, Item->nSlot * sizeof(HASH_SLOT));
-
-    } else {
-
-	/* maybe enlarge delta table */
-	if (Item->nSlot < delta) {
-	    Item->nSlot = delta;
-	    Item->Slot = realloc(Item->Slot, Item->nSlot * sizeof(HASH_SLOT));
-	}
-
-    }
-
-    if (Item->nSlot > 1) {
-	/* move the pointer to the next free slot, wrap around if necessary */
-	if (--Item->index < 0)
-	    Item->index = Item->nSlot - 1;
-    }
+    if (Item == NULL)
+	Item = hash_add(Hash, key);
 
-    /* create entry */
-    Slot = &(Item->Slot[Item->index]);
-    size = strlen(value) + 1;
+    /* maybe enlarge the ring, or start over if columns have been added */
+    if (Item->nSlot < delta || Item->nValue != Hash->nValue)
+	hash_resize(Hash, Item, delta > Item->nSlot ? delta : Item->nSlot);
 
     /* maybe enlarge value buffer */
-    if (size > Slot->size) {
+    size = strlen(value) + 1;
+    if (size > Item->size) {
 	/* buffer is either empty or too small */
 	/* allocate memory in multiples of CHUNK_SIZE */
-	Slot->size = CHUNK_SIZE * (size / CHUNK_SIZE + 1);
-	Slot->value = realloc(Slot->value, Slot->size);
+	Item->size = CHUNK_SIZE * (size / CHUNK_SIZE + 1);
+	Item->value = realloc(Item->value, Item->size);
     }
 
     /* set value */
-    strcpy(Slot->value, value);
+    strcpy(Item->value, value);
+
+    /* move the index to the next free record, wrap around if necessary */
+    if (--Item->index < 0)
+	Item->index = Item->nSlot - 1;
+    if (Item->nFill < Item->nSlot)
+	Item->nFill++;
+
+    /* parse the value once, not on every hash_get_delta() */
+    hash_parse(Hash, value, Item->Value + Item->index * Item->nValue);
 
     /* set timestamps */
-    gettimeofday(&(Hash->timestamp), NULL);
-    Slot->timestamp = Hash->timestamp;
+    Hash->timestamp = hash_now();
+    Item->Time[Item->index] = Hash->timestamp;
 
     return Item;
 }
@@ -476,33 +773,44 @@ void hash_destroy(HASH * Hash)
 {
     int i;
 
-    if(Hash->Columns != NULL) {
-        /* free all headers */
-        for (i = 0; i < Hash->nColumns; i++) {
-            if (Hash->Columns[i].key)
-                free(Hash->Columns[i].key);
-        }
-        /* free header table */
-        free(Hash->Columns);
+    /* free all headers */
+    for (i = 0; i < Hash->nColumns; i++) {
+	free(Hash->Columns[i].key);
     }
-    if (Hash->Items != NULL) {
-        /* free all items */
-        for (i = 0; i < Hash->nItems; i++) {
-            if (Hash->Items[i].key)
-                free(Hash->Items[i].key);
-            if (Hash->Items[i].Slot)
-            {
-		if(Hash->Items[i].Slot->value)
-		    free(Hash->Items[i].Slot->value);
-                free(Hash->Items[i].Slot);
-	    }
-        }
+    free(Hash->Columns);
+    Hash->nColumns = 0;
+    Hash->Columns = NULL;
 
-        /* free items table */
-        free(Hash->Items);
+    /* free all items */
+    for (i = 0; i < Hash->nItems; i++) {
+	HASH_ITEM *Item = Hash->Items[i];
+	free(Item->value);
+	free(Item->Time);
+	free(Item->Value);
+	free(Item->key);
+	free(Item);
     }
+    free(Hash->Items);
+    free(Hash->Index);
 
-    Hash->sorted = 0;
     Hash->nItems = 0;
+    Hash->sItems = 0;
     Hash->Items = NULL;
+    Hash->nIndex = 0;
+    Hash->Index = NULL;
+
+    free(Hash->field);
+    Hash->sField = 0;
+    Hash->field = NULL;
+
+    /* free all cached regular expressions */
+    for (i = 0; i < Hash->nRegex; i++) {
+	if (Hash->Regex[i].valid)
+	    regfree(&(Hash->Regex[i].preg));
+	free(Hash->Regex[i].pattern);
+	free(Hash->Regex[i].Match);
+    }
+    free(Hash->Regex);
+    Hash->nRegex = 0;
+    Hash->Regex = NULL;
 }
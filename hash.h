@@ -27,15 +27,8 @@
 #ifndef _HASH_H_
 #define _HASH_H_
 
-/* struct timeval */
-#include <sys/time.h>
-
-
-typedef struct {
-    int size;
-    char *value;
-    struct timeval timestamp;
-} HASH_SLOT;
+/* regex_t */
+#include <regex.h>
 
 
 typedef struct {
@@ -43,22 +36,50 @@ typedef struct {
     int val;
 } HASH_COLUMN;
 
+/* the history of an item is a ring of nSlot records, */
+/* record i (0 = newest) is at (index + i) % nSlot */
+/* and consists of Time[r] and nValue numbers at */
+/* Value[r * nValue]: the value itself, and its columns */
 typedef struct {
     char *key;
+    unsigned int hash;
+    int size;
+    char *value;		/* the most recent value */
     int index;
     int nSlot;
-    HASH_SLOT *Slot;
+    int nFill;			/* number of records in the ring */
+    int nValue;
+    long long *Time;		/* monotonic, usec */
+    double *Value;
 } HASH_ITEM;
 
 
 typedef struct {
-    int sorted;
-    struct timeval timestamp;
+    char *pattern;
+    int valid;			/* pattern did compile */
+    regex_t preg;
+    int nChecked;		/* items matched against so far */
+    int nMatch;
+    int sMatch;
+    HASH_ITEM **Match;
+} HASH_REGEX;
+
+
+typedef struct {
+    long long timestamp;	/* monotonic, usec */
+    int nValue;			/* numbers per record */
     int nItems;
-    HASH_ITEM *Items;
+    int sItems;
+    HASH_ITEM **Items;		/* in order of insertion, never move */
+    int nIndex;			/* size of Index, a power of 2 */
+    HASH_ITEM **Index;		/* open addressing, linear probing */
     int nColumns;
     HASH_COLUMN *Columns;
     char *delimiter;
+    int sField;
+    char *field;		/* buffer for hash_get() */
+    int nRegex;
+    HASH_REGEX *Regex;		/* compiled patterns of hash_get_regex() */
 } HASH;
 
 
@@ -73,6 +94,8 @@ void hash_set_delimiter(HASH * Hash, const char *delimiter);
 char *hash_get(HASH * Hash, const char *key, const char *column);
 double hash_get_delta(HASH * Hash, const char *key, const char *column, const int delay);
 double hash_get_regex(HASH * Hash, const char *key, const char *column, const int delay);
+double hash_get_window(HASH * Hash, const char *key, const char *column, const int window, const char *what,
+		       const int rate);
 
 void hash_put(HASH * Hash, const char *key, const char *value);
 void hash_put_delta(HASH * Hash, const char *key, const char *value);
@@ -42,6 +42,7 @@
 #include "debug.h"
 #include "cfg.h"
 #include "widget.h"
+#include "property.h"
 #include "layout.h"
 
 #ifdef WITH_DMALLOC
@@ -120,6 +121,9 @@ int layout_init(const char *layout)
     /* get a list of all keys in this section */
     list = cfg_list(section);
 
+    /* collect all widget properties and compile them at once */
+    property_defer();
+
     /* map to lower char for scanf() */
     for (l = list; *l != '\0'; l++)
 	*l = tolower(*l);
@@ -199,5 +203,8 @@ int layout_init(const char *layout)
     }
     free(list);
     free(section);
+
+    property_compile();
+
     return 0;
 }
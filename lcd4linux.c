@@ -66,6 +66,7 @@ static char **my_argv;
 extern char *output;
 
 int got_signal = 0;
+static volatile sig_atomic_t got_dump = 0;
 
 
 static void usage(void)
@@ -106,13 +107,14 @@ static void interactive_mode(void)
 {
     char line[1024];
     void *tree;
-    RESULT result = { 0, 0, 0, NULL };
+    RESULT result = { 0, 0, 0, NULL, "" };
 
     printf("\neval> ");
     for (fgets(line, sizeof(line), stdin); !feof(stdin); fgets(line, sizeof(line), stdin)) {
 	if (line[strlen(line) - 1] == '\n')
 	    line[strlen(line) - 1] = '\0';
 	if (strlen(line) > 0) {
+	    EvalTick();
 	    if (Compile(line, &tree) != -1) {
 		Eval(tree, &result);
 		if (result.type == R_NUMBER) {
@@ -141,6 +143,13 @@ void handler(int signal)
 }
 
 
+static void dump_handler(int signal)
+{
+    (void) signal;
+    got_dump = 1;
+}
+
+
 static void daemonize(void)
 {
 
@@ -403,12 +412,22 @@ int main(int argc, char *argv[])
     signal(SIGINT, handler);
     signal(SIGQUIT, handler);
     signal(SIGTERM, handler);
+    signal(SIGUSR1, dump_handler);
 
     while (got_signal == 0) {
 	struct timespec delay;
-	if (timer_process(&delay) < 0)
+	int armed;
+	/* SIGUSR1 dumps the timer statistics */
+	if (got_dump) {
+	    got_dump = 0;
+	    timer_dump();
+	}
+	/* shared expressions are evaluated once per loop */
+	EvalTick();
+	if ((armed = timer_process(&delay)) < 0)
 	    break;
-	event_process(&delay);
+	/* a timerfd wakes us up at the next deadline */
+	event_process(armed ? NULL : &delay);
     }
 
     debug("leaving main loop");
@@ -425,6 +444,10 @@ int main(int argc, char *argv[])
     debug("timer_exit_group: success");
     timer_exit();
     debug("timer_exit: success");
+    event_exit();
+    debug("event_exit: success");
+    thread_exit();
+    debug("thread_exit: success");
 
     if (got_signal == SIGHUP) {
 	long fd;
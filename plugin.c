@@ -30,6 +30,9 @@
  * int plugin_init (void)
  *  initializes the expression evaluator
  *  adds some handy constants and functions
+ *  config key 'Evaluator.bytecode' selects bytecode (1, default)
+ *  or tree walker (0)
+ *  freezes the function table when all plugins are registered
  *
  */
 
@@ -43,14 +46,18 @@
 #include <string.h>
 
 #include "debug.h"
+#include "cfg.h"
 
 
 char *Plugins[] = {
     "cfg",
     "math",
+    "source",
+    "stats",
     "string",
     "test",
     "time",
+    "timer",
 #ifdef PLUGIN_APM
     "apm",
 #endif
@@ -177,12 +184,18 @@ int plugin_init_cfg(void);
 void plugin_exit_cfg(void);
 int plugin_init_math(void);
 void plugin_exit_math(void);
+int plugin_init_source(void);
+void plugin_exit_source(void);
+int plugin_init_stats(void);
+void plugin_exit_stats(void);
 int plugin_init_string(void);
 void plugin_exit_string(void);
 int plugin_init_test(void);
 void plugin_exit_test(void);
 int plugin_init_time(void);
 void plugin_exit_time(void);
+int plugin_init_timer(void);
+void plugin_exit_timer(void);
 
 int plugin_init_apm(void);
 void plugin_exit_apm(void);
@@ -282,11 +295,20 @@ int plugin_list(void)
 
 int plugin_init(void)
 {
+    int bytecode;
+
+    /* compile expressions into bytecode unless disabled */
+    cfg_number("Evaluator", "bytecode", 1, 0, 1, &bytecode);
+    SetBytecode(bytecode);
+
     plugin_init_cfg();
     plugin_init_math();
+    plugin_init_source();
+    plugin_init_stats();
     plugin_init_string();
     plugin_init_test();
     plugin_init_time();
+    plugin_init_timer();
 
 #ifdef PLUGIN_APM
     plugin_init_apm();
@@ -406,6 +428,9 @@ int plugin_init(void)
     plugin_init_xmms();
 #endif
 
+    /* all plugin functions are known now */
+    FreezeFunctions();
+
     return 0;
 }
 
@@ -529,9 +554,12 @@ void plugin_exit(void)
 
     plugin_exit_cfg();
     plugin_exit_math();
+    plugin_exit_source();
+    plugin_exit_stats();
     plugin_exit_string();
     plugin_exit_test();
     plugin_exit_time();
+    plugin_exit_timer();
 
     DeleteFunctions();
     DeleteVariables();
@@ -56,7 +56,7 @@ static void load_variables(void)
     char *list, *l, *p;
     char *expression;
     void *tree;
-    RESULT result = { 0, 0, 0, NULL };
+    RESULT result = { 0, 0, 0, NULL, "" };
 
     list = cfg_list(section);
     l = list;
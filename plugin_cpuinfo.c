@@ -55,17 +55,16 @@ static FILE *stream = NULL;
 
 static int parse_cpuinfo(char __attribute__ ((unused)) * oid)
 {
-    int age;
-
-    /* reread every second only */
-    age = hash_age(&CPUinfo, NULL);
-    if (age > 0 && age <= 1000)
-	return 0;
-
 #ifndef __MAC_OS_X_VERSION_10_3
 
     /* Linux Kernel, /proc-filesystem */
 
+    static unsigned long tick = 0;
+
+    /* read once per tick, results are cached by the evaluator */
+    if (!NewTick(&tick))
+	return 0;
+
     if (stream == NULL)
 	stream = fopen("/proc/cpuinfo", "r");
     if (stream == NULL) {
@@ -152,7 +151,7 @@ static void my_cpuinfo(RESULT * result, RESULT * arg1)
 int plugin_init_cpuinfo(void)
 {
     hash_create(&CPUinfo);
-    AddFunction("cpuinfo", 1, my_cpuinfo);
+    AddFunctionTTL("cpuinfo", 1, my_cpuinfo, F_STABLE, 1000);
     return 0;
 }
 
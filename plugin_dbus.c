@@ -114,7 +114,7 @@ struct lcd_sig_t {
 
 typedef struct {
     int id;
-    char *event_name;
+    int event_id;		/* interned event name, or -1 */
 } handle_signal_t;
 
 static DBusConnection *sessconn;
@@ -310,11 +310,7 @@ static void load_dbus_cfg(void)
 
 	handle_signal_t *sig_info = malloc(sizeof(handle_signal_t));
 	sig_info->id = i;
-	if (*eventname == '\0') {
-	    sig_info->event_name = NULL;
-	} else {
-	    sig_info->event_name = strdup(eventname);
-	}
+	sig_info->event_id = named_event_id(eventname);
 
 	if (!lcd_register_signal(sender, path, interface, member, handle_inbound_signal,
 				 sig_info, (void (*)(void *)) free_handle_signal)) {
@@ -332,9 +328,6 @@ static void load_dbus_cfg(void)
 
 static void free_handle_signal(handle_signal_t * sig)
 {
-    if (sig->event_name != NULL) {
-	free(sig->event_name);
-    }
     free(sig);
 }
 
@@ -407,9 +400,9 @@ static void remove_watch(DBusWatch * w, void *data)
 {
     (void) data;		//ignore it
 #if (DBUS_VERSION_MAJOR == 1 && DBUS_VERSION_MINOR == 1 && DBUS_VERSION_MICRO >= 1) || (DBUS_VERSION_MAJOR == 1 && DBUS_VERSION_MINOR > 1) || (DBUS_VERSION_MAJOR > 1)
-    event_del(dbus_watch_get_unix_fd(w));
+    event_del_data(dbus_watch_get_unix_fd(w), w);
 #else
-    event_del(dbus_watch_get_fd(w));
+    event_del_data(dbus_watch_get_fd(w), w);
 #endif
     // event_del(dbus_watch_get_unix_fd(w));
 }
@@ -424,7 +417,7 @@ static void toggle_watch(DBusWatch * w, void *data)
 #endif
     // int fd = dbus_watch_get_unix_fd(w);      //we assume we are using unix
     int flags = dbus_watch_get_flags(w);
-    event_modify(fd, flags & DBUS_WATCH_READABLE, flags & DBUS_WATCH_WRITABLE, dbus_watch_get_enabled(w));
+    event_modify_data(fd, w, flags & DBUS_WATCH_READABLE, flags & DBUS_WATCH_WRITABLE, dbus_watch_get_enabled(w));
 }
 
 static void watch_handle(event_flags_t f, void *data)
@@ -468,7 +461,7 @@ static void timeout_dbus_handle(void *data)
 static dbus_bool_t add_dbus_timeout(DBusTimeout * t, void *data)
 {
     (void) data;		//ignore warning
-    if (!timer_add_late(timeout_dbus_handle, t, dbus_timeout_get_interval(t), 0)) {
+    if (timer_add_late(timeout_dbus_handle, t, dbus_timeout_get_interval(t), 0) < 0) {
 	return FALSE;
     }
     return TRUE;
@@ -575,8 +568,8 @@ static void handle_inbound_signal(void *signal, int argc, char **argv)
     sig.arguments = argv;
     set_signal_txt(signal_info->id, &sig);
 
-    if (signal_info->event_name != NULL) {
-	named_event_trigger(signal_info->event_name);
+    if (signal_info->event_id >= 0) {
+	named_event_trigger_id(signal_info->event_id);
     }
 }
 
@@ -52,11 +52,10 @@ static FILE *stream = NULL;
 
 static int parse_diskstats(void)
 {
-    int age;
+    static unsigned long tick = 0;
 
-    /* reread every 10 msec only */
-    age = hash_age(&DISKSTATS, NULL);
-    if (age > 0 && age <= 10)
+    /* read once per tick, results are cached by the evaluator */
+    if (!NewTick(&tick))
 	return 0;
 
     if (stream == NULL)
@@ -125,6 +124,22 @@ static void my_diskstats(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT *
     SetResult(&result, R_NUMBER, &value);
 }
 
+/* diskstats::window(dev, key, window, what) aggregates */
+/* the rates of the last 'window' msec */
+static void my_diskstats_window(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3, RESULT * arg4)
+{
+    double value;
+
+    if (parse_diskstats() < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = hash_get_window(&DISKSTATS, R2S(arg1), R2S(arg2), R2N(arg3), R2S(arg4), 1);
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
 
 int plugin_init_diskstats(void)
 {
@@ -141,7 +156,8 @@ int plugin_init_diskstats(void)
 	hash_set_column(&DISKSTATS, i, header[i]);
     }
 
-    AddFunction("diskstats", 3, my_diskstats);
+    AddFunctionTTL("diskstats", 3, my_diskstats, F_STABLE, 10);
+    AddFunctionTTL("diskstats::window", 4, my_diskstats_window, F_STABLE, 10);
     return 0;
 }
 
@@ -34,6 +34,11 @@
  * int plugin_init_exec (void)
  *  adds functions to start external pocesses
  *
+ * every command runs as '/bin/sh -c <cmd>' spawned from the main
+ * process; its output is collected through a non-blocking pipe
+ * watched by the event loop, so there is no limit on the number of
+ * commands or the size of their output
+ *
  */
 
 
@@ -44,30 +49,58 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "debug.h"
 #include "plugin.h"
 #include "hash.h"
 #include "cfg.h"
-#include "thread.h"
+#include "event.h"
+#include "timer.h"
 #include "qprintf.h"
 
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+/* commands run with a safe path */
+#define EXEC_PATH "PATH=/usr/local/bin:/usr/bin:/bin"
+
+/* first runs are spread over at most this many msec */
+#define EXEC_SPREAD 250
+
+/* minimum free space when reading from the pipe */
+#define EXEC_CHUNK 1024
 
-#define NUM_THREADS 16
-#define SHM_SIZE 4096
+/* msec a command gets to exit on SIGTERM before it is killed */
+#define EXEC_GRACE 300
+
+extern char **environ;
 
 typedef struct {
-    int delay;
-    int mutex;
-    pid_t pid;
-    int shmid;
     char *cmd;
     char *key;
-    char *ret;
-} EXEC_THREAD;
+    int delay;			/* msec */
+    int timer;			/* handle of the next run, or -1 */
+    pid_t pid;			/* running (or unreaped) child, or 0 */
+    int fd;			/* read end of the pipe, or -1 */
+    char *buffer;
+    int len;
+    int size;
+} EXEC_CMD;
 
-static EXEC_THREAD Thread[NUM_THREADS];
-static int max_thread = -1;
+static EXEC_CMD **Cmd = NULL;
+static int nCmd = 0;
+static int sCmd = 0;
+
+static char **Env = NULL;
+static unsigned int Seed = 0;
 
 static HASH EXEC;
 
@@ -92,153 +125,283 @@ static unsigned short CRC(const char *s)
 }
 
 
-static void exec_thread(void *data)
+/* random number 0..n-1, good enough to spread the commands */
+static int exec_jitter(const int n)
 {
-    EXEC_THREAD *Thread = (EXEC_THREAD *) data;
-    FILE *pipe;
-    char buffer[SHM_SIZE];
-    int len;
+    if (n <= 1)
+	return 0;
 
-    /* use a safe path */
-    putenv("PATH=/usr/local/bin:/usr/bin:/bin");
+    if (Seed == 0)
+	Seed = (unsigned int) getpid() ^ (unsigned int) time(NULL);
 
-    /* forever... */
-    while (1) {
-	pipe = popen(Thread->cmd, "r");
-	if (pipe == NULL) {
-	    error("exec error: could not run pipe '%s': %s", Thread->cmd, strerror(errno));
-	    len = 0;
-	} else {
-	    len = fread(buffer, 1, SHM_SIZE - 1, pipe);
-	    if (len <= 0) {
-		error("exec error: could not read from pipe '%s': %s", Thread->cmd, strerror(errno));
-		len = 0;
-	    }
-	    pclose(pipe);
-	}
+    return rand_r(&Seed) % n;
+}
 
-	/* force trailing zero */
-	buffer[len] = '\0';
 
-	/* remove trailing CR/LF */
-	while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r')) {
-	    buffer[--len] = '\0';
-	}
+/* the environment of the commands: ours, but with a safe path */
+static char **exec_environ(void)
+{
+    int i, n;
+
+    if (Env != NULL)
+	return Env;
+
+    for (n = 0; environ != NULL && environ[n] != NULL; n++);
 
-	/* lock shared memory */
-	mutex_lock(Thread->mutex);
-	/* write data */
-	strncpy(Thread->ret, buffer, SHM_SIZE);
-	/* unlock shared memory */
-	mutex_unlock(Thread->mutex);
-	usleep(Thread->delay);
+    Env = malloc((n + 2) * sizeof(char *));
+    for (i = 0, n = 0; environ != NULL && environ[i] != NULL; i++) {
+	if (strncmp(environ[i], "PATH=", 5) != 0)
+	    Env[n++] = strdup(environ[i]);
     }
+    Env[n++] = strdup(EXEC_PATH);
+    Env[n] = NULL;
+
+    return Env;
 }
 
 
-static void destroy_exec_thread(const int n)
+static void exec_start(void *data);
+
+static void exec_schedule(EXEC_CMD * Cmd, const int delay)
 {
-    thread_destroy(Thread[n].pid);
-
-    if (Thread[n].mutex != 0)
-	mutex_destroy(Thread[n].mutex);
-    if (Thread[n].cmd)
-	free(Thread[n].cmd);
-    if (Thread[n].key)
-	free(Thread[n].key);
-    if (Thread[n].ret)
-	shm_destroy(Thread[n].shmid, Thread[n].ret);
-
-    Thread[n].delay = 0;
-    Thread[n].mutex = 0;
-    Thread[n].pid = 0;
-    Thread[n].shmid = 0;
-    Thread[n].cmd = NULL;
-    Thread[n].key = NULL;
-    Thread[n].ret = NULL;
+    Cmd->timer = timer_add(exec_start, Cmd, delay > 0 ? delay : 1, 1);
+    if (Cmd->timer < 0)
+	error("exec(%s): could not schedule next run", Cmd->cmd);
 }
 
 
-static int create_exec_thread(const char *cmd, const char *key, const int delay)
+/* next run after 'delay' msec, +/- 1/16 to keep the commands apart */
+static void exec_reschedule(EXEC_CMD * Cmd)
 {
-    char name[10];
+    exec_schedule(Cmd, Cmd->delay - Cmd->delay / 16 + exec_jitter(Cmd->delay / 8 + 1));
+}
+
+
+static void exec_reap(EXEC_CMD * Cmd)
+{
+    if (Cmd->pid > 0 && waitpid(Cmd->pid, NULL, WNOHANG) != 0)
+	Cmd->pid = 0;
+}
+
+
+static void exec_done(EXEC_CMD * Cmd)
+{
+    int len = Cmd->len;
+
+    event_del(Cmd->fd);
+    close(Cmd->fd);
+    Cmd->fd = -1;
+
+    /* remove trailing CR/LF */
+    while (len > 0 && (Cmd->buffer[len - 1] == '\n' || Cmd->buffer[len - 1] == '\r'))
+	len--;
+    Cmd->buffer[len] = '\0';
 
-    if (max_thread >= NUM_THREADS) {
-	error("cannot create exec thread <%s>: thread buffer full!", cmd);
-	return -1;
+    hash_put(&EXEC, Cmd->key, Cmd->buffer);
+
+    /* the child has closed its output, but may not have exited yet */
+    exec_reap(Cmd);
+
+    exec_reschedule(Cmd);
+}
+
+
+static void exec_read(event_flags_t flags, void *data)
+{
+    EXEC_CMD *Cmd = (EXEC_CMD *) data;
+    ssize_t n;
+
+    (void) flags;
+
+    while (1) {
+	if (Cmd->size - Cmd->len < EXEC_CHUNK) {
+	    Cmd->size = Cmd->size ? 2 * Cmd->size : 4 * EXEC_CHUNK;
+	    Cmd->buffer = realloc(Cmd->buffer, Cmd->size);
+	}
+	/* leave room for the trailing zero */
+	n = read(Cmd->fd, Cmd->buffer + Cmd->len, Cmd->size - Cmd->len - 1);
+	if (n > 0) {
+	    Cmd->len += n;
+	    continue;
+	}
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    return;
+	if (n < 0)
+	    error("exec error: could not read from pipe '%s': %s", Cmd->cmd, strerror(errno));
+	break;
     }
 
-    max_thread++;
-    Thread[max_thread].delay = delay;
-    Thread[max_thread].mutex = mutex_create();
-    Thread[max_thread].pid = -1;
-    Thread[max_thread].cmd = strdup(cmd);
-    Thread[max_thread].key = strdup(key);
-    Thread[max_thread].ret = NULL;
-
-    /* create communication buffer */
-    Thread[max_thread].shmid = shm_create((void **) &Thread[max_thread].ret, SHM_SIZE);
-
-    /* catch error */
-    if (Thread[max_thread].shmid < 0) {
-	error("cannot create exec thread <%s>: shared memory allocation failed!", cmd);
-	destroy_exec_thread(max_thread--);
-	return -1;
+    exec_done(Cmd);
+}
+
+
+static void exec_start(void *data)
+{
+    EXEC_CMD *Cmd = (EXEC_CMD *) data;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    char *argv[4];
+    int fds[2], err;
+
+    Cmd->timer = -1;
+
+    /* never run a command twice at the same time */
+    exec_reap(Cmd);
+    if (Cmd->pid > 0 || Cmd->fd >= 0) {
+	exec_reschedule(Cmd);
+	return;
     }
 
-    /* create thread */
-    qprintf(name, sizeof(name), "exec-%s", key);
-    Thread[max_thread].pid = thread_create(name, exec_thread, &Thread[max_thread]);
+    /* only our end is non-blocking, the command writes as usual */
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+	error("exec error: could not create pipe for '%s': %s", Cmd->cmd, strerror(errno));
+	exec_reschedule(Cmd);
+	return;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    /* stdin from /dev/null, stdout into the pipe */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+    /* own process group (so it can be killed as a whole), default */
+    /* signal handling and nothing blocked */
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    argv[0] = "sh";
+    argv[1] = "-c";
+    argv[2] = Cmd->cmd;
+    argv[3] = NULL;
+
+    err = posix_spawn(&Cmd->pid, "/bin/sh", &actions, &attr, argv, exec_environ());
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (err != 0) {
+	error("exec error: could not run '%s': %s", Cmd->cmd, strerror(err));
+	Cmd->pid = 0;
+	close(fds[0]);
+	exec_reschedule(Cmd);
+	return;
+    }
 
-    /* catch error */
-    if (Thread[max_thread].pid < 0) {
-	error("cannot create exec thread <%s>: fork failed?!", cmd);
-	destroy_exec_thread(max_thread--);
-	return -1;
+    Cmd->fd = fds[0];
+    Cmd->len = 0;
+    if (event_add(exec_read, Cmd, Cmd->fd, 1, 0, 1) < 0) {
+	error("exec error: could not watch pipe of '%s'", Cmd->cmd);
+	close(Cmd->fd);
+	Cmd->fd = -1;
+	exec_reschedule(Cmd);
     }
+}
 
-    return 0;
+
+static int create_exec_cmd(const char *cmd, const char *key, const int delay)
+{
+    EXEC_CMD *new;
+
+    if (nCmd >= sCmd) {
+	sCmd = sCmd ? 2 * sCmd : 16;
+	Cmd = realloc(Cmd, sCmd * sizeof(EXEC_CMD *));
+    }
+
+    new = malloc(sizeof(EXEC_CMD));
+    new->cmd = strdup(cmd);
+    new->key = strdup(key);
+    new->delay = delay;
+    new->timer = -1;
+    new->pid = 0;
+    new->fd = -1;
+    new->buffer = NULL;
+    new->len = 0;
+    new->size = 0;
+    Cmd[nCmd++] = new;
+
+    /* commands sharing an interval should not all fork at once */
+    exec_schedule(new, 1 + exec_jitter(delay < EXEC_SPREAD ? delay : EXEC_SPREAD));
+
+    return new->timer < 0 ? -1 : 0;
 }
 
 
-static int do_exec(const char *cmd, const char *key, int delay)
+/* terminate all running commands, killing the ones which ignore */
+/* SIGTERM after a grace period, so that they cannot block the exit */
+static void exec_terminate(void)
 {
-    int i, age;
+    struct timespec delay = { 0, 10000000 };
+    int i, n, wait;
 
-    age = hash_age(&EXEC, key);
+    for (i = 0; i < nCmd; i++) {
+	if (Cmd[i]->pid > 0)
+	    kill(-Cmd[i]->pid, SIGTERM);
+    }
 
-    if (age < 0) {
-	hash_put(&EXEC, key, "");
-	/* first-time call: create thread */
-	if (delay < 10) {
-	    error("exec(%s): delay %d is too short! using 10 msec", cmd, delay);
-	    delay = 10;
+    for (wait = 0; wait <= EXEC_GRACE; wait += 10) {
+	for (i = 0, n = 0; i < nCmd; i++) {
+	    exec_reap(Cmd[i]);
+	    if (Cmd[i]->pid > 0)
+		n++;
 	}
-	if (create_exec_thread(cmd, key, 1000 * delay)) {
-	    return -1;
+	if (n == 0)
+	    return;
+	nanosleep(&delay, NULL);
+    }
+
+    for (i = 0; i < nCmd; i++) {
+	if (Cmd[i]->pid > 0) {
+	    info("exec(%s): still running, killing it", Cmd[i]->cmd);
+	    kill(-Cmd[i]->pid, SIGKILL);
+	    waitpid(Cmd[i]->pid, NULL, 0);
+	    Cmd[i]->pid = 0;
 	}
-	return 0;
     }
+}
 
-    /* reread every 10 msec only */
-    if (age > 0 && age <= 10)
-	return 0;
 
-    /* find thread */
-    for (i = 0; i <= max_thread; i++) {
-	if (strcmp(key, Thread[i].key) == 0) {
-	    /* lock shared memory */
-	    mutex_lock(Thread[i].mutex);
-	    /* copy data */
-	    hash_put(&EXEC, key, Thread[i].ret);
-	    /* unlock shared memory */
-	    mutex_unlock(Thread[i].mutex);
-	    return 0;
-	}
+static void destroy_exec_cmd(EXEC_CMD * Cmd)
+{
+    if (Cmd->timer >= 0)
+	timer_cancel(Cmd->timer);
+
+    if (Cmd->fd >= 0) {
+	event_del(Cmd->fd);
+	close(Cmd->fd);
     }
 
-    error("internal error: could not find thread exec-%s", key);
-    return -1;
+    free(Cmd->cmd);
+    free(Cmd->key);
+    if (Cmd->buffer)
+	free(Cmd->buffer);
+    free(Cmd);
+}
+
+
+static int do_exec(const char *cmd, const char *key, int delay)
+{
+    if (hash_age(&EXEC, key) >= 0)
+	return 0;
+
+    hash_put(&EXEC, key, "");
+    /* first-time call: start command */
+    if (delay < 10) {
+	error("exec(%s): delay %d is too short! using 10 msec", cmd, delay);
+	delay = 10;
+    }
+    return create_exec_cmd(cmd, key, delay);
 }
 
 static void my_exec(RESULT * result, RESULT * arg1, RESULT * arg2)
@@ -276,8 +439,21 @@ void plugin_exit_exec(void)
 {
     int i;
 
-    for (i = 0; i <= max_thread; i++) {
-	destroy_exec_thread(i);
+    exec_terminate();
+
+    for (i = 0; i < nCmd; i++) {
+	destroy_exec_cmd(Cmd[i]);
+    }
+    if (Cmd)
+	free(Cmd);
+    Cmd = NULL;
+    nCmd = sCmd = 0;
+
+    if (Env) {
+	for (i = 0; Env[i] != NULL; i++)
+	    free(Env[i]);
+	free(Env);
+	Env = NULL;
     }
 
     hash_destroy(&EXEC);
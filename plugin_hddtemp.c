@@ -69,6 +69,9 @@ toasty 53 degC.
  *  adds various functions
  * void plugin_exit_hddtemp (void)
  *
+ * the daemons are queried in the background, see source.c for the
+ * 'Plugin:hddtemp' config keys
+ *
  */
 
 #include "config.h"
@@ -89,42 +92,46 @@ toasty 53 degC.
 /* these should always be included */
 #include "debug.h"
 #include "plugin.h"
+#include "qprintf.h"
+#include "source.h"
 
+static SOURCE *Source = NULL;
 
 
-static int socket_open(const char *name, int port)
+/* runs on a worker thread, so getaddrinfo() instead of gethostbyname() */
+static int socket_open(const char *name, int port, const int timeout)
 {
-    struct sockaddr_in server;
-    struct hostent *host_info;
-    unsigned long addr;
-    int sock;
+    struct addrinfo hints, *info;
+    char service[8];
+    int sock, err;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    qprintf(service, sizeof(service), "%d", port);
+
+    if ((err = getaddrinfo(name, service, &hints, &info)) != 0) {
+	error("[hddtemp] Unknown server: %s: %s", name, gai_strerror(err));
+	return -1;
+    }
 
     sock = socket(PF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
 	error("[hddtemp] failed to create socket: %s", strerror(errno));
+	freeaddrinfo(info);
 	return -1;
     }
 
-    memset(&server, 0, sizeof(server));
-    if ((addr = inet_addr(name)) != INADDR_NONE) {
-	memcpy((char *) &server.sin_addr, &addr, sizeof(addr));
-    } else {
-	host_info = gethostbyname(name);
-	if (NULL == host_info) {
-	    error("[hddtemp] Unknown server: %s", name);
-	    return -1;
-	}
-	memcpy((char *) &server.sin_addr, host_info->h_addr, host_info->h_length);
-    }
-
-    server.sin_family = AF_INET;
-    server.sin_port = htons(port);
+    source_timeout(sock, timeout);
 
-    if (connect(sock, (struct sockaddr *) &server, sizeof(server)) < 0) {
+    if (connect(sock, info->ai_addr, info->ai_addrlen) < 0) {
 	error("[hddtemp] can't connect to server %s: %s", name, strerror(errno));
+	close(sock);
+	freeaddrinfo(info);
 	return -1;
     }
 
+    freeaddrinfo(info);
     return sock;
 }
 
@@ -157,11 +164,11 @@ static size_t hddtemp_read(int socket, char *buffer, size_t size)
 }
 
 
-static int hddtemp_connect(const char *host, int port, char *buffer, size_t size)
+static int hddtemp_connect(const char *host, int port, char *buffer, size_t size, const int timeout)
 {
     int socket, ret;
 
-    socket = socket_open(host, port);
+    socket = socket_open(host, port, timeout);
     if (socket < 0) {
 	error("[hddtemp] Error accessing %s:%d: %s", host, port, strerror(errno));
 	return -1;
@@ -210,14 +217,38 @@ static char *split(const char *value, const int column)
     return buffer;
 }
 
-static char *hddtemp_fetch(const char *host, int port, const char *device)
+/* worker thread: fetch a buffer of all hddtemps from 'host:port' */
+static char *hddtemp_fetch(const char *key, const int timeout)
 {
     char buffer[4096];
-    char *key;
+    char host[256];
+    const char *colon;
+    int port;
+
+    colon = strrchr(key, ':');
+    if (colon == NULL || (size_t) (colon - key) >= sizeof(host))
+	return NULL;
+    memcpy(host, key, colon - key);
+    host[colon - key] = '\0';
+    port = atoi(colon + 1);
+
+    if (hddtemp_connect(host, port, buffer, sizeof(buffer), timeout) <= 0)
+	return NULL;
+
+    return strdup(buffer);
+}
+
+
+static char *hddtemp_find(const char *host, int port, const char *device)
+{
+    const char *buffer;
+    char *key, where[300];
     int i;
 
-    /* fetch a buffer of all hddtemps */
-    if (!hddtemp_connect(host, port, buffer, sizeof(buffer))) {
+    qprintf(where, sizeof(where), "%s:%d", host, port);
+
+    /* latest buffer of all hddtemps */
+    if ((buffer = source_get(Source, where)) == NULL) {
 	return "err";
     }
 
@@ -264,13 +295,14 @@ static void my_hddtemp(RESULT * result, int argc, RESULT * argv[])
 	return;
     }
 
-    value = hddtemp_fetch(host, port, device);
+    value = hddtemp_find(host, port, device);
     SetResult(&result, R_STRING, value);
 }
 
 
 int plugin_init_hddtemp(void)
 {
+    Source = source_create("hddtemp", "Plugin:hddtemp", hddtemp_fetch, 1000, 0);
     AddFunction("hddtemp", -1, my_hddtemp);
 
     return 0;
@@ -279,4 +311,6 @@ int plugin_init_hddtemp(void)
 
 void plugin_exit_hddtemp(void)
 {
+    source_destroy(Source);
+    Source = NULL;
 }
@@ -47,6 +47,7 @@
 #include <sys/types.h>		/* data types */
 #include <sys/stat.h>		/* stat structure */
 #include <sys/time.h>		/* timeval structure */
+#include <time.h>		/* clock_gettime() */
 #include <errno.h>		/* system error numbers */
 
 
@@ -136,12 +137,23 @@ static unsigned int sub_mode = 0;	/* system sub mode */
 static int debug = 0;		/* enable debug messages */
 
 
+/* ages are measured on the monotonic clock, */
+/* which does not jump if the system time is set */
+static void age_now(struct timeval *now)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now->tv_sec = ts.tv_sec;
+    now->tv_usec = ts.tv_nsec / 1000;
+}
+
 static int age_diff(struct timeval prev_age)
 {
     int diff;
     struct timeval now;
 
-    gettimeofday(&now, NULL);
+    age_now(&now);
     diff = (now.tv_sec - prev_age.tv_sec) * 1000 + (now.tv_usec - prev_age.tv_usec) / 1000;
 
     return diff;
@@ -809,7 +821,7 @@ static void my_quality(RESULT * result, RESULT * arg1)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_quality(QUALITY);
@@ -858,7 +870,7 @@ static void my_mode(RESULT * result, RESULT * arg1)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_sysinfo(SYSINFO);
@@ -914,7 +926,7 @@ static void my_manuf(RESULT * result)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_manuf(MANUF);
@@ -947,7 +959,7 @@ static void my_model(RESULT * result)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_model(MODEL);
@@ -980,7 +992,7 @@ static void my_fwver(RESULT * result)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_fwver(FWVER);
@@ -1013,7 +1025,7 @@ static void my_operator(RESULT * result)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_operator(OPERATOR);
@@ -1048,7 +1060,7 @@ static void my_flowreport(RESULT * result, RESULT * arg1)
     age = age_diff(prev_age);
 
     if (age < 0 || age >= MIN_INTERVAL) {
-	gettimeofday(&prev_age, NULL);
+	age_now(&prev_age);
 
 	if (huawei_configured() == 1)
 	    huawei_read_flowreport(FLOWREPORT);
@@ -29,6 +29,7 @@
 #include "qprintf.h"
 #include "cfg.h"
 #include "hash.h"
+#include "source.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -64,47 +65,52 @@ static int iport;
 static int fd = 0;
 static int err = 0;
 
+/* imond and telmond are queried in the background */
+static SOURCE *Imon = NULL;
+static SOURCE *Telmon = NULL;
+
 /*----------------------------------------------------------------------------
- *  service_connect (host_name, port)       - connect to tcp-service
+ *  service_connect (host_name, port, timeout)  - connect to tcp-service
  *----------------------------------------------------------------------------
  */
-static int service_connect(const char *host_name, const int port)
+static int service_connect(const char *host_name, const int port, const int timeout)
 {
-    struct sockaddr_in addr;
-    struct hostent *host_p;
+    struct addrinfo hints, *info;
+    char service[8];
     int fd;
     int opt = 1;
 
-    (void) memset((char *) &addr, 0, sizeof(addr));
+    /* runs on a worker thread, so no gethostbyname() */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    qprintf(service, sizeof(service), "%d", port);
 
-    if ((addr.sin_addr.s_addr = inet_addr((char *) host_name)) == INADDR_NONE) {
-	host_p = gethostbyname(host_name);
-	if (!host_p) {
-	    error("%s: host not found\n", host_name);
-	    return (-1);
-	}
-	(void) memcpy((char *) (&addr.sin_addr), host_p->h_addr, host_p->h_length);
+    if (getaddrinfo(host_name, service, &hints, &info) != 0) {
+	error("%s: host not found\n", host_name);
+	return (-1);
     }
 
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons((unsigned short) port);
-
     /* open socket */
     if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
 	perror("socket");
+	freeaddrinfo(info);
 	return (-1);
     }
 
     (void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &opt, sizeof(opt));
+    source_timeout(fd, timeout);
 
-    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    if (connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
 	(void) close(fd);
 	perror(host_name);
+	freeaddrinfo(info);
 	return (-1);
     }
 
+    freeaddrinfo(info);
     return (fd);
-}				/* service_connect (char * host_name, int port) */
+}				/* service_connect (char * host_name, int port, int timeout) */
 
 
 /*----------------------------------------------------------------------------
@@ -208,45 +214,58 @@ static void phonebook(char *number)
 }
 
 
+/* worker thread */
+static char *telmon_fetch(const char __attribute__ ((unused)) * key, const int timeout)
+{
+    char telbuf[128];
+    int telmond_fd, l;
+
+    telmond_fd = service_connect(thost, tport, timeout);
+    if (telmond_fd < 0)
+	return NULL;
+
+    l = read(telmond_fd, telbuf, 127);
+    close(telmond_fd);
+    if (l <= 0)
+	return NULL;
+
+    telbuf[l] = '\0';
+    return strdup(telbuf);
+}
+
+
 static int parse_telmon()
 {
-    static int telmond_fd = -2;
     static char oldanswer[128];
-    int age;
+    const char *telbuf;
 
-    /* reread every 1 sec only */
-    age = hash_age(&TELMON, NULL);
-    if (age > 0 && age <= 1000)
+    /* latest answer of telmond */
+    telbuf = source_get(Telmon, "");
+    if (telbuf == NULL)
 	return 0;
 
-    if (telmond_fd != -1) {
-	char telbuf[128];
-
-	telmond_fd = service_connect(thost, tport);
-	if (telmond_fd >= 0) {
-	    int l = read(telmond_fd, telbuf, 127);
-	    if ((l > 0) && (strcmp(telbuf, oldanswer))) {
-		char date[11];
-		char time[11];
-		char number[256];
-		char msn[256];
-		sscanf(telbuf, "%s %s %s %s", date, time, number, msn);
-		hash_put(&TELMON, "time", time);
-		date[4] = '\0';
-		date[7] = '\0';
-		qprintf(time, sizeof(time), "%s.%s.%s", date + 8, date + 5, date);
-		hash_put(&TELMON, "number", number);
-		hash_put(&TELMON, "msn", msn);
-		hash_put(&TELMON, "date", time);
-		phonebook(number);
-		phonebook(msn);
-		hash_put(&TELMON, "name", number);
-		hash_put(&TELMON, "msnname", msn);
-	    }
-	    close(telmond_fd);
-	    strcpy(oldanswer, telbuf);
-	}
+    if (strcmp(telbuf, oldanswer)) {
+	char date[11];
+	char time[11];
+	char number[256];
+	char msn[256];
+
+	sscanf(telbuf, "%10s %10s %255s %255s", date, time, number, msn);
+	hash_put(&TELMON, "time", time);
+	date[4] = '\0';
+	date[7] = '\0';
+	qprintf(time, sizeof(time), "%s.%s.%s", date + 8, date + 5, date);
+	hash_put(&TELMON, "number", number);
+	hash_put(&TELMON, "msn", msn);
+	hash_put(&TELMON, "date", time);
+	phonebook(number);
+	phonebook(msn);
+	hash_put(&TELMON, "name", number);
+	hash_put(&TELMON, "msnname", msn);
+
+	strncpy(oldanswer, telbuf, sizeof(oldanswer) - 1);
     }
+
     return 0;
 }
 
@@ -307,16 +326,18 @@ static void my_telmon(RESULT * result, RESULT * arg1)
 }
 
 
-void init()
+/* worker thread; the source is serial, so the connection is never */
+/* used by two threads at once */
+static void init(const int timeout)
 {
     if (fd != 0)
 	return;
 
-    fd = service_connect(ihost, iport);
+    fd = service_connect(ihost, iport, timeout);
 
     if (fd < 0) {
 	err++;
-    } else if ((ipass != NULL) && (*ipass != '\0')) {	/* Passwort senden */
+    } else if (*ipass != '\0') {	/* Passwort senden */
 	char buf[40];
 	qprintf(buf, sizeof(buf), "pass %s", ipass);
 	send_command(fd, buf);
@@ -325,20 +346,25 @@ void init()
 }
 
 
-static int parse_imon(const char *cmd)
+/* worker thread: 'key' is the imond command */
+static char *imon_fetch(const char *key, const int timeout)
 {
-    /* reread every half sec only */
-    int age = hash_age(&IMON, cmd);
-    if (age > 0 && age <= 500)
-	return 0;
+    init(timeout);		/* establish connection */
+    if (err)
+	return NULL;
 
-    init();			/* establish connection */
+    return strdup(get_value(key));
+}
 
-    if (err)
-	return -1;
 
-    hash_put(&IMON, cmd, get_value(cmd));
+static int parse_imon(const char *cmd)
+{
+    const char *s;
+
+    if ((s = source_get(Imon, cmd)) == NULL)
+	return -1;
 
+    hash_put(&IMON, cmd, s);
     return 0;
 }
 
@@ -391,20 +417,13 @@ static void my_imon_version(RESULT * result)
     /* read only once */
     age = hash_age(&IMON, "version");
     if (age < 0) {
-	char *s;
-	init();
-	if (err) {
+	const char *s = source_get(Imon, "version");
+	if (s == NULL) {
 	    SetResult(&result, R_STRING, "");
 	    return;
 	}
-	s = get_value("version");
-	for (;;) {		/* interne Versionsnummer killen */
-	    if (s[0] == ' ') {
-		s = s + 1;
-		break;
-	    }
-	    s = s + 1;
-	}
+	/* interne Versionsnummer killen */
+	while (*s != '\0' && *s++ != ' ');
 	hash_put(&IMON, "version", s);
     }
 
@@ -418,25 +437,13 @@ static void my_imon_version(RESULT * result)
 static int parse_imon_rates(const char *channel)
 {
     char buf[128], in[25], out[25];
-    char *s;
-    int age;
-
-    qprintf(buf, sizeof(buf), "rate %s in", channel);
-
-    /* reread every half sec only */
-    age = hash_age(&IMON, buf);
-    if (age > 0 && age <= 500)
-	return 0;
-
-    init();			/* establish connection */
-
-    if (err)
-	return -1;
+    const char *s;
 
     qprintf(buf, sizeof(buf), "rate %s", channel);
-    s = get_value(buf);
+    if ((s = source_get(Imon, buf)) == NULL)
+	return -1;
 
-    if (sscanf(s, "%s %s", in, out) != 2)
+    if (sscanf(s, "%24s %24s", in, out) != 2)
 	return -1;
 
     qprintf(buf, sizeof(buf), "rate %s in", channel);
@@ -474,25 +481,13 @@ static void my_imon_rates(RESULT * result, RESULT * arg1, RESULT * arg2)
 static int parse_imon_quantity(const char *channel)
 {
     char buf[256], fill1[25], in[25], fill2[25], out[25];
-    char *s;
-    int age;
-
-    qprintf(buf, sizeof(buf), "quantity %s in", channel);
-
-    /* reread every half sec only */
-    age = hash_age(&IMON, buf);
-    if (age > 0 && age <= 500)
-	return 0;
-
-    init();			/* establish connection */
-
-    if (err)
-	return -1;
+    const char *s;
 
     qprintf(buf, sizeof(buf), "quantity %s", channel);
-    s = get_value(buf);
+    if ((s = source_get(Imon, buf)) == NULL)
+	return -1;
 
-    if (sscanf(s, "%s %s %s %s", fill1, in, fill2, out) != 4)
+    if (sscanf(s, "%24s %24s %24s %24s", fill1, in, fill2, out) != 4)
 	return -1;
 
     qprintf(buf, sizeof(buf), "quantity %s in", channel);
@@ -506,25 +501,13 @@ static int parse_imon_quantity(const char *channel)
 static int parse_imon_status(const char *channel)
 {
     char buf[256], status[25];
-    char *s;
-    int age;
+    const char *s;
 
     qprintf(buf, sizeof(buf), "status %s", channel);
-
-    /* reread every half sec only */
-    age = hash_age(&IMON, buf);
-    if (age > 0 && age <= 500)
-	return 0;
-
-    init();			/* establish connection */
-
-    if (err)
+    if ((s = source_get(Imon, buf)) == NULL)
 	return -1;
 
-    qprintf(buf, sizeof(buf), "status %s", channel);
-    s = get_value(buf);
-
-    if (sscanf(s, "%s", status) != 1)
+    if (sscanf(s, "%24s", status) != 1)
 	return -1;
 
     qprintf(buf, sizeof(buf), "status %s", channel);
@@ -607,6 +590,9 @@ static void my_imon(RESULT * result, RESULT * arg1)
 
 int plugin_init_imon(void)
 {
+    Imon = source_create("imon", "Plugin:Imon", imon_fetch, 500, SOURCE_SERIAL);
+    Telmon = source_create("telmon", "Plugin:Telmon", telmon_fetch, 1000, 0);
+
     AddFunction("imon", 1, my_imon);
     AddFunction("imon::version", 0, my_imon_version);
     AddFunction("imon::rates", 2, my_imon_rates);
@@ -620,6 +606,11 @@ int plugin_init_imon(void)
 
 void plugin_exit_imon(void)
 {
+    /* the connection is ours again */
+    source_destroy(Imon);
+    source_destroy(Telmon);
+    Imon = Telmon = NULL;
+
     if (fd > 0) {
 	send_command(fd, "quit");
 	close(fd);
@@ -198,44 +198,41 @@ static int get_attrib(char *input, char *name, char **data)
     return -1;
 }
 
+/* runs in the client thread, so getaddrinfo() instead of gethostbyname() */
 static int http_open(char *name)
 {
-    struct sockaddr_in server;
-    struct hostent *host_info;
-    unsigned long addr;
-    int sock;
+    struct addrinfo hints, *info;
+    char service[8];
+    int sock, err;
+
+    /* Wandle den Servernamen in eine IP-Adresse um */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if ((err = getaddrinfo(name, service, &hints, &info)) != 0) {
+	error("[KVV] Unknown server: %s: %s", name, gai_strerror(err));
+	return -1;
+    }
 
     /* create socket */
     sock = socket(PF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
 	perror("failed to create socket");
+	freeaddrinfo(info);
 	return -1;
     }
 
-    /* Erzeuge die Socketadresse des Servers 
-     * Sie besteht aus Typ, IP-Adresse und Portnummer */
-    memset(&server, 0, sizeof(server));
-    if ((addr = inet_addr(name)) != INADDR_NONE) {
-	memcpy((char *) &server.sin_addr, &addr, sizeof(addr));
-    } else {
-	/* Wandle den Servernamen in eine IP-Adresse um */
-	host_info = gethostbyname(name);
-	if (NULL == host_info) {
-	    error("[KVV] Unknown server: %s", name);
-	    return -1;
-	}
-	memcpy((char *) &server.sin_addr, host_info->h_addr, host_info->h_length);
-    }
-
-    server.sin_family = AF_INET;
-    server.sin_port = htons(port);
-
     /* Baue die Verbindung zum Server auf */
-    if (connect(sock, (struct sockaddr *) &server, sizeof(server)) < 0) {
+    if (connect(sock, info->ai_addr, info->ai_addrlen) < 0) {
 	perror("can't connect to server");
+	close(sock);
+	freeaddrinfo(info);
 	return -1;
     }
 
+    freeaddrinfo(info);
     return sock;
 }
 
@@ -393,19 +390,27 @@ static void kvv_client( __attribute__ ((unused))
 	    tv.tv_sec = count ? TIMEOUT_SHORT : TIMEOUT_LONG;
 	    tv.tv_usec = 0;
 
-	    i = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
+	    i = select(sock + 1, &rfds, NULL, NULL, &tv);
 	    if (i < 0) {
-		perror("select");
-		exit(1);
+		/* this is a thread of the daemon, never exit() here */
+		error("[KVV] select() failed: %s", strerror(errno));
+		break;
 	    }
 
 	    if (i != 0) {
 		i = recv(sock, ibuffer + count, sizeof(ibuffer) - count - 1, 0);
-		count += i;
+		if (i > 0)
+		    count += i;
 	    }
 	}
 	while (i > 0);
 
+	if (i < 0) {
+	    close(sock);
+	    sleep(refresh);
+	    continue;
+	}
+
 	ibuffer[count] = 0;	/* terminate string */
 	close(sock);
 
@@ -496,10 +501,11 @@ static void kvv_client( __attribute__ ((unused))
 		    tv.tv_sec = count ? TIMEOUT_SHORT : TIMEOUT_LONG;
 		    tv.tv_usec = 0;
 
-		    i = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
+		    i = select(sock + 1, &rfds, NULL, NULL, &tv);
 		    if (i > 0) {
 			i = recv(sock, ibuffer + count, sizeof(ibuffer) - count - 1, 0);
-			count += i;
+			if (i > 0)
+			    count += i;
 		    }
 		}
 		while (i > 0);	/* leave on select or read error */
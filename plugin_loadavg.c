@@ -92,24 +92,18 @@ int getloadavg(double loadavg[], int nelem)
 static void my_loadavg(RESULT * result, RESULT * arg1)
 {
     static int nelem = -1;
-    int index, age;
+    int index;
     static double loadavg[3];
-    static struct timeval last_value;
-    struct timeval now;
-
-    gettimeofday(&now, NULL);
-
-    age = (now.tv_sec - last_value.tv_sec) * 1000 + (now.tv_usec - last_value.tv_usec) / 1000;
-    /* reread every 10 msec only */
-    if (nelem == -1 || age == 0 || age > 10) {
+    static unsigned long tick = 0;
 
+    /* read once per tick, results are cached by the evaluator */
+    if (nelem < 0 || NewTick(&tick)) {
 	nelem = getloadavg(loadavg, 3);
 	if (nelem < 0) {
 	    error("getloadavg() failed!");
 	    SetResult(&result, R_STRING, "");
 	    return;
 	}
-	last_value = now;
     }
 
     index = R2N(arg1);
@@ -127,7 +121,7 @@ static void my_loadavg(RESULT * result, RESULT * arg1)
 
 int plugin_init_loadavg(void)
 {
-    AddFunction("loadavg", 1, my_loadavg);
+    AddFunctionTTL("loadavg", 1, my_loadavg, F_STABLE, 10);
     return 0;
 }
 
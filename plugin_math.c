@@ -142,24 +142,24 @@ int plugin_init_math(void)
     SetVariableNumeric("e", M_E);
 
     /* register some basic math functions */
-    AddFunction("sqrt", 1, my_sqrt);
-    AddFunction("exp", 1, my_exp);
-    AddFunction("ln", 1, my_ln);
-    AddFunction("log", 1, my_log);
-    AddFunction("sin", 1, my_sin);
-    AddFunction("cos", 1, my_cos);
-    AddFunction("tan", 1, my_tan);
+    AddFunctionFlags("sqrt", 1, my_sqrt, F_PURE);
+    AddFunctionFlags("exp", 1, my_exp, F_PURE);
+    AddFunctionFlags("ln", 1, my_ln, F_PURE);
+    AddFunctionFlags("log", 1, my_log, F_PURE);
+    AddFunctionFlags("sin", 1, my_sin, F_PURE);
+    AddFunctionFlags("cos", 1, my_cos, F_PURE);
+    AddFunctionFlags("tan", 1, my_tan, F_PURE);
 
     /* min, max */
-    AddFunction("min", 2, my_min);
-    AddFunction("max", 2, my_max);
+    AddFunctionFlags("min", 2, my_min, F_PURE);
+    AddFunctionFlags("max", 2, my_max, F_PURE);
 
     /* floor, ceil */
-    AddFunction("floor", 1, my_floor);
-    AddFunction("ceil", 1, my_ceil);
+    AddFunctionFlags("floor", 1, my_floor, F_PURE);
+    AddFunctionFlags("ceil", 1, my_ceil, F_PURE);
 
     /* decode */
-    AddFunction("decode", -1, my_decode);
+    AddFunctionFlags("decode", -1, my_decode, F_PURE);
 
     return 0;
 }
@@ -52,11 +52,10 @@ static FILE *stream = NULL;
 
 static int parse_meminfo(void)
 {
-    int age;
+    static unsigned long tick = 0;
 
-    /* reread every 10 msec only */
-    age = hash_age(&MemInfo, NULL);
-    if (age > 0 && age <= 10)
+    /* read once per tick, results are cached by the evaluator */
+    if (!NewTick(&tick))
 	return 0;
 
     if (stream == NULL)
@@ -94,8 +93,8 @@ static int parse_meminfo(void)
 	if (*c == 'B' && *(c - 1) == 'k' && *(c - 2) == ' ') {
 	    /* strip trailing " kB" from value */
 	    *(c - 2) = '\0';
-	    /* add entry to hash table */
-	    hash_put(&MemInfo, key, val);
+	    /* add entry to hash table, keep a history for meminfo::window() */
+	    hash_put_delta(&MemInfo, key, val);
 	}
     }
     return 0;
@@ -119,10 +118,28 @@ static void my_meminfo(RESULT * result, RESULT * arg1)
 }
 
 
+/* meminfo::window(key, window, what) aggregates */
+/* the values of the last 'window' msec */
+static void my_meminfo_window(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3)
+{
+    double value;
+
+    if (parse_meminfo() < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = hash_get_window(&MemInfo, R2S(arg1), NULL, R2N(arg2), R2S(arg3), 0);
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
 int plugin_init_meminfo(void)
 {
     hash_create(&MemInfo);
-    AddFunction("meminfo", 1, my_meminfo);
+    AddFunctionTTL("meminfo", 1, my_meminfo, F_STABLE, 10);
+    AddFunctionTTL("meminfo::window", 3, my_meminfo_window, F_STABLE, 10);
     return 0;
 }
 
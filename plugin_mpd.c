@@ -132,7 +132,6 @@ static char pw[255];
 static int iport;
 static int plugin_enabled;
 static int waittime;
-struct timeval timestamp;
 
 static struct mpd_connection *conn;
 static char Section[] = "Plugin:MPD";
@@ -416,16 +415,12 @@ void mpd_query_stats(struct mpd_connection *conn)
 
 static int mpd_update()
 {
-    struct timeval now;
+    static unsigned long tick = 0;
 
-    /* reread every 1000 msec only */
-    gettimeofday(&now, NULL);
-    int timedelta = (now.tv_sec - timestamp.tv_sec) * 1000 + (now.tv_usec - timestamp.tv_usec) / 1000;
-
-    if (timedelta > 0 && timedelta < waittime) {
-	/* debug("[MPD] waittime not reached...\n"); */
+    /* query once per tick only, results are cached */
+    /* by the evaluator for 'minUpdateTime' msec */
+    if (!NewTick(&tick))
 	return 1;
-    }
 
     /* check if configured */
     if (configure_mpd() < 0) {
@@ -450,7 +445,6 @@ static int mpd_update()
 	    if (errorcnt == ERROR_DISPLAY)
 		error("[MPD] stop logging, until connection is fixed!");
 	    errorcnt++;
-	    gettimeofday(&timestamp, NULL);
 	    return -1;
 	}
 
@@ -466,7 +460,6 @@ static int mpd_update()
     mpd_query_status(conn);
     mpd_query_stats(conn);
 
-    gettimeofday(&timestamp, NULL);
     return 1;
 }
 
@@ -876,29 +869,28 @@ int plugin_init_mpd(void)
 
     /* when mpd dies, do NOT exit application, ignore it! */
     signal(SIGPIPE, SIG_IGN);
-    gettimeofday(&timestamp, NULL);
-
-    AddFunction("mpd::artist", 0, getArtist);
-    AddFunction("mpd::title", 0, getTitle);
-    AddFunction("mpd::album", 0, getAlbum);
-    AddFunction("mpd::file", 0, getFilename);
-    AddFunction("mpd::totalTimeSec", 0, totalTimeSec);
-    AddFunction("mpd::elapsedTimeSec", 0, elapsedTimeSec);
-    AddFunction("mpd::bitRate", 0, bitRate);
-    AddFunction("mpd::getSamplerateHz", 0, getSamplerateHz);
-    AddFunction("mpd::getAudioChannels", 0, getAudioChannels);
-    AddFunction("mpd::getRepeatInt", 0, getRepeatInt);
-    AddFunction("mpd::getRandomInt", 0, getRandomInt);
-    AddFunction("mpd::getSingleInt", 0, getSingleInt);
-    AddFunction("mpd::getConsumeInt", 0, getConsumeInt);
-    AddFunction("mpd::getStateInt", 0, getStateInt);
-    AddFunction("mpd::getVolume", 0, getVolume);
-    AddFunction("mpd::getSongsInDb", 0, getSongsInDb);
-    AddFunction("mpd::getMpdUptime", 0, getMpdUptime);
-    AddFunction("mpd::getMpdPlayTime", 0, getMpdPlayTime);
-    AddFunction("mpd::getMpdDbPlayTime", 0, getMpdDbPlayTime);
-    AddFunction("mpd::getMpdPlaylistLength", 0, getMpdPlaylistLength);
-    AddFunction("mpd::getMpdPlaylistGetCurrentId", 0, getCurrentSongPos);
+
+    AddFunctionTTL("mpd::artist", 0, getArtist, F_STABLE, waittime);
+    AddFunctionTTL("mpd::title", 0, getTitle, F_STABLE, waittime);
+    AddFunctionTTL("mpd::album", 0, getAlbum, F_STABLE, waittime);
+    AddFunctionTTL("mpd::file", 0, getFilename, F_STABLE, waittime);
+    AddFunctionTTL("mpd::totalTimeSec", 0, totalTimeSec, F_STABLE, waittime);
+    AddFunctionTTL("mpd::elapsedTimeSec", 0, elapsedTimeSec, F_STABLE, waittime);
+    AddFunctionTTL("mpd::bitRate", 0, bitRate, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getSamplerateHz", 0, getSamplerateHz, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getAudioChannels", 0, getAudioChannels, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getRepeatInt", 0, getRepeatInt, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getRandomInt", 0, getRandomInt, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getSingleInt", 0, getSingleInt, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getConsumeInt", 0, getConsumeInt, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getStateInt", 0, getStateInt, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getVolume", 0, getVolume, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getSongsInDb", 0, getSongsInDb, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getMpdUptime", 0, getMpdUptime, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getMpdPlayTime", 0, getMpdPlayTime, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getMpdDbPlayTime", 0, getMpdDbPlayTime, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getMpdPlaylistLength", 0, getMpdPlaylistLength, F_STABLE, waittime);
+    AddFunctionTTL("mpd::getMpdPlaylistGetCurrentId", 0, getCurrentSongPos, F_STABLE, waittime);
 
     AddFunction("mpd::cmdNextSong", 0, nextSong);
     AddFunction("mpd::cmdPrevSong", 0, prevSong);
@@ -41,15 +41,20 @@
  *        Uptime in seconds and the number of running threads,
  *        questions, reloads, and open tables.
  *
+ *  the queries run in the background on a single connection, see
+ *  source.c for the additional 'Plugin:MySQL' config keys
+ *
  */
 
 #include "config.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include "debug.h"
 #include "plugin.h"
 #include "cfg.h"
+#include "source.h"
 
 #ifdef HAVE_MYSQL_MYSQL_H
 #include <mysql/mysql.h>
@@ -64,19 +69,24 @@
 
 #ifdef HAVE_MYSQL_MYSQL_H
 static MYSQL conex;
+static int connected = 0;
 
 static char Section[] = "Plugin:MySQL";
+static SOURCE *Source = NULL;
+
+static char server[256];
+static int port;
+static char user[128];
+static char password[256];
+static char database[256];
 
 
+/* the config is read by the main thread, the connection is made */
+/* by the first query */
 static int configure_mysql(void)
 {
     static int configured = 0;
 
-    char server[256];
-    int port;
-    char user[128];
-    char password[256];
-    char database[256];
     char *s;
 
     if (configured != 0)
@@ -87,7 +97,7 @@ static int configure_mysql(void)
 	info("[MySQL] empty '%s.server' entry from %s, assuming 'localhost'", Section, cfg_source());
 	strcpy(server, "localhost");
     } else
-	strcpy(server, s);
+	strncpy(server, s, sizeof(server) - 1);
     free(s);
 
     if (cfg_number(Section, "port", 0, 1, 65536, &port) < 1) {
@@ -101,7 +111,7 @@ static int configure_mysql(void)
 	info("[MySQL] empty '%s.user' entry from %s, assuming lcd4linux owner", Section, cfg_source());
 	strcpy(user, "");
     } else
-	strcpy(user, s);
+	strncpy(user, s, sizeof(user) - 1);
     free(s);
 
     s = cfg_get(Section, "password", "");
@@ -110,7 +120,7 @@ static int configure_mysql(void)
 	info("[MySQL] empty '%s.password' entry in %s, assuming none", Section, cfg_source());
 	strcpy(password, "");
     } else
-	strcpy(password, s);
+	strncpy(password, s, sizeof(password) - 1);
     free(s);
 
     s = cfg_get(Section, "database", "");
@@ -120,59 +130,116 @@ static int configure_mysql(void)
 	configured = -1;
 	return configured;
     }
-    strcpy(database, s);
+    strncpy(database, s, sizeof(database) - 1);
     free(s);
 
-    mysql_init(&conex);
-    if (!mysql_real_connect(&conex, server, user, password, database, port, NULL, 0)) {
-	error("[MySQL] conection error: %s", mysql_error(&conex));
-	configured = -1;
-	return configured;
-    }
-
     configured = 1;
     return configured;
 }
 
-static void my_MySQLcount(RESULT * result, RESULT * query)
+
+/* worker thread; the source is serial, so there is only one query */
+/* on the connection at any time */
+static char *query_fetch(const char *key, const int timeout)
 {
-    char *q;
-    double value;
+    unsigned int seconds = timeout < 1000 ? 1 : timeout / 1000;
+    char value[32], *first;
+    const char *q;
     MYSQL_RES *res;
-
-    if (configure_mysql() < 0) {
-	value = -1;
-	SetResult(&result, R_NUMBER, &value);
-	return;
+    MYSQL_ROW row;
+
+    mysql_thread_init();
+
+    if (!connected) {
+	mysql_init(&conex);
+	mysql_options(&conex, MYSQL_OPT_CONNECT_TIMEOUT, &seconds);
+	mysql_options(&conex, MYSQL_OPT_READ_TIMEOUT, &seconds);
+	mysql_options(&conex, MYSQL_OPT_WRITE_TIMEOUT, &seconds);
+	if (!mysql_real_connect(&conex, server, user, password, database, port, NULL, 0)) {
+	    error("[MySQL] conection error: %s", mysql_error(&conex));
+	    mysql_close(&conex);
+	    return NULL;
+	}
+	connected = 1;
     }
 
-    q = R2S(query);
-
     /* mysql_ping(MYSQL *mysql) checks whether the connection to the server is working. */
     /* If it has gone down, an automatic reconnection is attempted. */
     mysql_ping(&conex);
+
+    if (strcmp(key, "status:") == 0) {
+	const char *status = mysql_stat(&conex);
+	if (!status) {
+	    error("[MySQL] status error: %s", mysql_error(&conex));
+	    return strdup("error");
+	}
+	return strdup(status);
+    }
+
+    q = strchr(key, ':') + 1;
     if (mysql_real_query(&conex, q, (unsigned int) strlen(q))) {
 	error("[MySQL] query error: %s", mysql_error(&conex));
-	value = -1;
-    } else {
-	/* We don't use res=mysql_use_result();  because mysql_num_rows() will not */
-	/* return the correct value until all the rows in the result set have been retrieved */
-	/* with mysql_fetch_row(), so we use res=mysql_store_result(); instead */
-	res = mysql_store_result(&conex);
-	value = (double) mysql_num_rows(res);
+	return NULL;
+    }
+
+    /* We don't use res=mysql_use_result();  because mysql_num_rows() will not */
+    /* return the correct value until all the rows in the result set have been retrieved */
+    /* with mysql_fetch_row(), so we use res=mysql_store_result(); instead */
+    res = mysql_store_result(&conex);
+    if (res == NULL)
+	return NULL;
+
+    if (strncmp(key, "count:", 6) == 0) {
+	snprintf(value, sizeof(value), "%llu", (unsigned long long) mysql_num_rows(res));
 	mysql_free_result(res);
+	return strdup(value);
     }
 
+    row = mysql_fetch_row(res);
+    first = (row && row[0]) ? strdup(row[0]) : NULL;
+    mysql_free_result(res);
+
+    return first;
+}
+
+
+static const char *query_get(const char *what, const char *query)
+{
+    char *key;
+    const char *value;
+
+    key = malloc(strlen(what) + strlen(query) + 2);
+    sprintf(key, "%s:%s", what, query);
+    value = source_get(Source, key);
+    free(key);
+
+    return value;
+}
+
+
+static void my_MySQLcount(RESULT * result, RESULT * query)
+{
+    const char *count;
+    double value;
+
+    if (configure_mysql() < 0) {
+	value = -1;
+	SetResult(&result, R_NUMBER, &value);
+	return;
+    }
+
+    /* -1 until the query has been answered */
+    count = query_get("count", R2S(query));
+    value = count ? atof(count) : -1;
+
     SetResult(&result, R_NUMBER, &value);
 }
 
 
 static void my_MySQLquery(RESULT * result, RESULT * query)
 {
-    char *q;
+    const char *row;
     double value;
-    MYSQL_RES *res;
-    MYSQL_ROW row = NULL;
 
     if (configure_mysql() < 0) {
 	value = -1;
@@ -180,24 +247,14 @@ static void my_MySQLquery(RESULT * result, RESULT * query)
 	return;
     }
 
-    q = R2S(query);
-
-    /* mysql_ping(MYSQL *mysql) checks whether the connection to the server is working. */
-    /* If it has gone down, an automatic reconnection is attempted. */
-    mysql_ping(&conex);
-    if (mysql_real_query(&conex, q, (unsigned int) strlen(q))) {
-	error("[MySQL] query error: %s", mysql_error(&conex));
+    row = query_get("query", R2S(query));
+    if (row == NULL) {
 	value = -1;
-    } else {
-	/* We don't use res=mysql_use_result();  because mysql_num_rows() will not */
-	/* return the correct value until all the rows in the result set have been retrieved */
-	/* with mysql_fetch_row(), so we use res=mysql_store_result(); instead */
-	res = mysql_store_result(&conex);
-	row = mysql_fetch_row(res);
-	mysql_free_result(res);
+	SetResult(&result, R_NUMBER, &value);
+	return;
     }
 
-    SetResult(&result, R_STRING, row[0]);
+    SetResult(&result, R_STRING, row);
 }
 
 
@@ -207,15 +264,9 @@ static void my_MySQLstatus(RESULT * result)
     const char *status;
 
     if (configure_mysql() > 0) {
-
-	mysql_ping(&conex);
-	status = mysql_stat(&conex);
-	if (!status) {
-	    error("[MySQL] status error: %s", mysql_error(&conex));
-	    value = "error";
-	} else {
+	status = query_get("status", "");
+	if (status)
 	    value = status;
-	}
     }
 
     SetResult(&result, R_STRING, value);
@@ -228,6 +279,7 @@ static void my_MySQLstatus(RESULT * result)
 int plugin_init_mysql(void)
 {
 #ifdef HAVE_MYSQL_MYSQL_H
+    Source = source_create("mysql", Section, query_fetch, 1000, SOURCE_SERIAL);
     AddFunction("MySQL::count", 1, my_MySQLcount);
     AddFunction("MySQL::query", 1, my_MySQLquery);
     AddFunction("MySQL::status", 0, my_MySQLstatus);
@@ -238,6 +290,9 @@ int plugin_init_mysql(void)
 void plugin_exit_mysql(void)
 {
 #ifdef HAVE_MYSQL_MYSQL_H
-    mysql_close(&conex);
+    source_destroy(Source);
+    Source = NULL;
+    if (connected)
+	mysql_close(&conex);
 #endif
 }
@@ -53,13 +53,12 @@ const char *DELIMITER = " :|\t\n";
 
 static int parse_netdev(void)
 {
-    int age;
     int row, col;
     static int first_time = 1;
+    static unsigned long tick = 0;
 
-    /* reread every 10 msec only */
-    age = hash_age(&NetDev, NULL);
-    if (age > 0 && age <= 10)
+    /* read once per tick, results are cached by the evaluator */
+    if (!NewTick(&tick))
 	return 0;
 
     if (Stream == NULL)
@@ -169,14 +168,31 @@ static void my_netdev_fast(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT
     SetResult(&result, R_NUMBER, &value);
 }
 
+/* netdev::window(dev, key, window, what) aggregates */
+/* the rates of the last 'window' msec */
+static void my_netdev_window(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3, RESULT * arg4)
+{
+    double value;
+
+    if (parse_netdev() < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = hash_get_window(&NetDev, R2S(arg1), R2S(arg2), R2N(arg3), R2S(arg4), 1);
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
 
 int plugin_init_netdev(void)
 {
     hash_create(&NetDev);
     hash_set_delimiter(&NetDev, " :|\t\n");
 
-    AddFunction("netdev", 3, my_netdev);
-    AddFunction("netdev::fast", 3, my_netdev_fast);
+    AddFunctionTTL("netdev", 3, my_netdev, F_STABLE, 10);
+    AddFunctionTTL("netdev::fast", 3, my_netdev_fast, F_STABLE, 10);
+    AddFunctionTTL("netdev::window", 4, my_netdev_window, F_STABLE, 10);
     return 0;
 }
 
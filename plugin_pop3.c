@@ -36,6 +36,8 @@
 #include "debug.h"
 #include "plugin.h"
 #include "cfg.h"
+#include "qprintf.h"
+#include "source.h"
 
 /*added */
 #include <sys/socket.h>
@@ -76,16 +78,17 @@ static void check_node_add(struct check **head, struct check *new_check);
 static void check_destroy(struct check **head);
 
 /* pop3 */
-static void pop3_check_messages(struct check *hi, int verbose);
-static void pop3_recv_crlf_terminated(int sockfd, char *buf, int size);
+static int pop3_check_messages(struct check *hi, int verbose, int timeout);
+static int pop3_recv_crlf_terminated(int sockfd, char *buf, int size);
 
 /* socket  */
-static int tcp_connect(struct check *hi);
+static int tcp_connect(struct check *hi, int timeout);
 
 
 /************************ GLOBAL ***********************************/
 static char Section[] = "Plugin:POP3";
 static struct check *head = NULL;
+static SOURCE *Source = NULL;
 /********************************************************************/
 
 
@@ -122,17 +125,20 @@ static void check_destroy(struct check **head)
 }
 
 /************************ POP3  ********************************/
-static void pop3_check_messages(struct check *hi, int verbose)
+/* runs on a worker thread, returns the number of messages */
+static int pop3_check_messages(struct check *hi, int verbose, int timeout)
 {
     char buf[BUFSIZE];
-    int sockfd;
+    int sockfd, messages;
 
-    if ((sockfd = tcp_connect(hi)) < 0) {
-	hi->messages = -1;
-	return;
+    if ((sockfd = tcp_connect(hi, timeout)) < 0) {
+	return -1;
     }
 
-    pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf));	/* server greeting */
+    if (pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf)) < 0) {	/* server greeting */
+	close(sockfd);
+	return -1;
+    }
     if (verbose)
 	info("[POP3] %s -> %s\n", hi->server, buf);
 
@@ -141,7 +147,10 @@ static void pop3_check_messages(struct check *hi, int verbose)
     buf[strlen(buf) - 1] = '\0';
     if (verbose)
 	info("[POP3] %s <- %s\n", hi->server, buf);
-    pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf));	/* response from USER command */
+    if (pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf)) < 0) {	/* response from USER command */
+	close(sockfd);
+	return -1;
+    }
     if (verbose)
 	info("[POP3] %s -> %s\n", hi->server, buf);
 
@@ -149,91 +158,138 @@ static void pop3_check_messages(struct check *hi, int verbose)
     write(sockfd, buf, strlen(buf));
     if (verbose)
 	info("[POP3] %s <- PASS ???\n", hi->server);
-    pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf));	/* response from PASS command */
+    if (pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf)) < 0) {	/* response from PASS command */
+	close(sockfd);
+	return -1;
+    }
     if (verbose)
 	info("[POP3] %s -> %s\n", hi->server, buf);
 
     if (strncmp(buf, LOCKEDERR, strlen(LOCKEDERR)) == 0) {
-	hi->messages = -2;
 	close(sockfd);
-	return;
+	return -2;
     }
     if (strncmp(buf, POPERR, strlen(POPERR)) == 0) {
 	error("[POP3] error logging into %s\n", hi->server);
 	error("[POP3] server responded: %s\n", buf);
-	hi->messages = -1;
 	close(sockfd);
-	return;
+	return -1;
     }
 
     snprintf(buf, sizeof(buf), "STAT\r\n");
     write(sockfd, buf, strlen(buf));
     if (verbose)
 	info("[POP3] %s <- STAT\n", hi->server);
-    pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf));	/* response from PASS command */
+    if (pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf)) < 0) {	/* response from STAT command */
+	close(sockfd);
+	return -1;
+    }
     if (verbose)
 	info("[POP3] %s -> %s\n", hi->server, buf);
 
-    strtok(buf, " ");
-    hi->messages = atoi(strtok(NULL, " "));
+    /* "+OK <messages> <octets>" */
+    if (sscanf(buf, "%*s %d", &messages) != 1)
+	messages = -1;
 
     snprintf(buf, sizeof(buf), "QUIT\r\n");
     write(sockfd, buf, strlen(buf));
     if (verbose)
 	info("[POP3] %s <- QUIT\n", hi->server);
-    pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf));	/* response from QUIT command */
-    if (verbose)
+    if (pop3_recv_crlf_terminated(sockfd, buf, sizeof(buf)) == 0 && verbose)	/* response from QUIT command */
 	info("[POP3] %s -> %s\n", hi->server, buf);
 
     close(sockfd);
+    return messages;
 }
 
-static void pop3_recv_crlf_terminated(int sockfd, char *buf, int size)
+static int pop3_recv_crlf_terminated(int sockfd, char *buf, int size)
 {
     /* receive one line server responses terminated with CRLF */
     char *pos;
-    int bytes = 0;
+    int bytes = 0, len;
     memset(buf, 0, size);
-    while ((pos = strstr(buf, "\r\n")) == NULL)
-	bytes += read(sockfd, buf + bytes, size - bytes);
+    while ((pos = strstr(buf, "\r\n")) == NULL) {
+	/* keep the trailing zero */
+	if (bytes >= size - 1)
+	    return -1;
+	len = read(sockfd, buf + bytes, size - 1 - bytes);
+	/* closed, error or timeout */
+	if (len <= 0) {
+	    error("[POP3] no response from server");
+	    return -1;
+	}
+	bytes += len;
+    }
     *pos = '\0';
+    return 0;
 }
 
 /************************ SOCKET  ********************************/
-static int tcp_connect(struct check *hi)
+/* runs on a worker thread, so getaddrinfo() instead of gethostbyname() */
+static int tcp_connect(struct check *hi, int timeout)
 {
-    struct sockaddr_in addr;
-    struct hostent *he = gethostbyname(hi->server);
-    int sockfd;
+    struct addrinfo hints, *info;
+    char service[8];
+    int sockfd, err;
 
     if (hi == NULL)
 	return -1;
 
-    if (!he) {
-	error("[POP3] Failed to lookup %s\n", hi->server);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    qprintf(service, sizeof(service), "%d", hi->port);
+
+    if ((err = getaddrinfo(hi->server, service, &hints, &info)) != 0) {
+	error("[POP3] Failed to lookup %s: %s\n", hi->server, gai_strerror(err));
 	return (-1);
     }
 
-    memset((char *) &addr, 0, sizeof(struct sockaddr_in));
-    addr.sin_family = AF_INET;
-    memcpy(&(addr.sin_addr.s_addr), he->h_addr, he->h_length);
-    addr.sin_port = htons(hi->port);
-
     if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
 	perror("socket()");
+	freeaddrinfo(info);
 	return (-1);
     }
 
-    if (connect(sockfd, (struct sockaddr *) &addr, sizeof(struct sockaddr)) < 0) {
+    source_timeout(sockfd, timeout);
+
+    if (connect(sockfd, info->ai_addr, info->ai_addrlen) < 0) {
 	perror("connect()");
 	close(sockfd);
+	freeaddrinfo(info);
 	return (-1);
     }
 
+    freeaddrinfo(info);
     return (sockfd);
 }
 
 
+/* worker thread: 'key' is the number of the account */
+static char *pop3_fetch(const char *key, const int timeout)
+{
+    struct check *node;
+    char value[16];
+    int id = atoi(key);
+    int messages;
+
+    /* the list is complete before the first fetch */
+    for (node = head; node; node = node->next) {
+	if (node->id == id)
+	    break;
+    }
+    if (node == NULL)
+	return NULL;
+
+    /* a locked account (-2) is an answer, too */
+    if ((messages = pop3_check_messages(node, 0, timeout)) == -1)
+	return NULL;
+
+    qprintf(value, sizeof(value), "%d", messages);
+    return strdup(value);
+}
+
+
 static int getConfig(void)
 {
     struct check *node = NULL;
@@ -327,8 +383,12 @@ static void my_POP3check(RESULT * result, RESULT * check)
     if (node == NULL) {		/*Inexistent account */
 	value = -1;
     } else {
-	pop3_check_messages(node, 0);
-	value = (double) node->messages;
+	const char *messages;
+	char key[16];
+	qprintf(key, sizeof(key), "%d", node->id);
+	/* latest count, -1 until the server has been asked */
+	messages = source_get(Source, key);
+	value = messages ? atof(messages) : -1;
     }
     SetResult(&result, R_NUMBER, &value);
 }
@@ -336,11 +396,15 @@ static void my_POP3check(RESULT * result, RESULT * check)
 
 int plugin_init_pop3(void)
 {
+    Source = source_create("pop3", Section, pop3_fetch, 1000, 0);
     AddFunction("POP3check", 1, my_POP3check);
     return 0;
 }
 
 void plugin_exit_pop3(void)
 {
+    /* no fetch may use the accounts any longer */
+    source_destroy(Source);
+    Source = NULL;
     check_destroy(&head);
 }
@@ -82,11 +82,10 @@ static void hash_put3(const char *key1, const char *key2, const char *key3, cons
 
 static int parse_proc_stat(void)
 {
-    int age;
+    static unsigned long tick = 0;
 
-    /* reread every 10 msec only */
-    age = hash_age(&Stat, NULL);
-    if (age > 0 && age <= 10)
+    /* read once per tick, results are cached by the evaluator */
+    if (!NewTick(&tick))
 	return 0;
 
 #ifndef __MAC_OS_X_VERSION_10_3
@@ -361,13 +360,30 @@ static void my_disk(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3
     SetResult(&result, R_NUMBER, &value);
 }
 
+/* proc_stat::window(key, window, what) aggregates */
+/* the rates of the last 'window' msec */
+static void my_proc_stat_window(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3)
+{
+    double value;
+
+    if (parse_proc_stat() < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = hash_get_window(&Stat, R2S(arg1), NULL, R2N(arg2), R2S(arg3), 1);
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
 
 int plugin_init_proc_stat(void)
 {
     hash_create(&Stat);
-    AddFunction("proc_stat", -1, my_proc_stat);
-    AddFunction("proc_stat::cpu", 2, my_cpu);
-    AddFunction("proc_stat::disk", 3, my_disk);
+    AddFunctionTTL("proc_stat", -1, my_proc_stat, F_STABLE, 10);
+    AddFunctionTTL("proc_stat::cpu", 2, my_cpu, F_STABLE, 10);
+    AddFunctionTTL("proc_stat::disk", 3, my_disk, F_STABLE, 10);
+    AddFunctionTTL("proc_stat::window", 3, my_proc_stat_window, F_STABLE, 10);
     return 0;
 }
 
@@ -0,0 +1,128 @@
+/* $Id$
+ * $URL$
+ *
+ * plugin for the state of the asynchronous data sources
+ *
+ * Copyright (C) 2026 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
+ *
+ * This file is part of LCD4Linux.
+ *
+ * LCD4Linux is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * LCD4Linux is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * exported functions:
+ *
+ * int plugin_init_source (void)
+ *  adds functions for the data sources of blocking plugins like
+ *  'hddtemp', 'pop3', 'mysql', 'imon' or 'telmon':
+ *
+ *  source::age(name [, key])    age of the cached value in msec, of
+ *                               the oldest one without a key; -1 if
+ *                               there is no value yet
+ *  source::stale(name [, key])  1 if the value is stale, 0 if not
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "plugin.h"
+#include "source.h"
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+static int source_args(const char *func, int argc, RESULT * argv[], char **name, char **key)
+{
+    switch (argc) {
+    case 1:
+	*name = R2S(argv[0]);
+	*key = NULL;
+	return 0;
+    case 2:
+	*name = R2S(argv[0]);
+	*key = R2S(argv[1]);
+	return 0;
+    default:
+	error("%s(): wrong number of parameters", func);
+	return -1;
+    }
+}
+
+
+static void my_age(RESULT * result, int argc, RESULT * argv[])
+{
+    char *name, *key;
+    double value;
+    int age;
+
+    if (source_args("source::age", argc, argv, &name, &key) < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    if ((age = source_age(name, key)) < -1) {
+	error("source::age(): unknown source '%s'", name);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = age;
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+static void my_stale(RESULT * result, int argc, RESULT * argv[])
+{
+    char *name, *key;
+    double value;
+    int stale;
+
+    if (source_args("source::stale", argc, argv, &name, &key) < 0) {
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    if ((stale = source_stale(name, key)) < 0) {
+	error("source::stale(): unknown source '%s'", name);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    value = stale;
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+int plugin_init_source(void)
+{
+    AddFunction("source::age", -1, my_age);
+    AddFunction("source::stale", -1, my_stale);
+
+    return 0;
+}
+
+
+void plugin_exit_source(void)
+{
+}
@@ -91,7 +91,7 @@ static void my_statfs(RESULT * result, RESULT * arg1, RESULT * arg2)
 
 int plugin_init_statfs(void)
 {
-    AddFunction("statfs", 2, my_statfs);
+    AddFunctionFlags("statfs", 2, my_statfs, F_STABLE);
     return 0;
 }
 
@@ -0,0 +1,220 @@
+/* $Id$
+ * $URL$
+ *
+ * evaluator statistics plugin
+ *
+ * Copyright (C) 2026 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
+ *
+ * This file is part of LCD4Linux.
+ *
+ * LCD4Linux is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * LCD4Linux is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * exported functions:
+ *
+ * int plugin_init_stats (void)
+ *  adds the stats::eval() function and starts the periodic
+ *  profile dump
+ *
+ * config keys:
+ *  Evaluator.profile          1 measures the cost of every function
+ *                             call and property evaluation (default 0)
+ *  Evaluator.profileInterval  dump the profile every n msec (default 0)
+ *  Evaluator.profileFile      dump into this file instead of the log
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "debug.h"
+#include "cfg.h"
+#include "plugin.h"
+#include "property.h"
+#include "timer.h"
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+typedef struct {
+    const char *kind;
+    const char *name;
+    PROFILE *profile;
+} ENTRY;
+
+typedef struct {
+    const char *kind;
+    ENTRY *entry;
+    int nEntry;
+    int sEntry;
+} LIST;
+
+static char *File = NULL;
+
+
+static void collect(const char *name, PROFILE * profile, void *data)
+{
+    LIST *list = data;
+
+    if (profile->calls == 0)
+	return;
+
+    if (list->nEntry >= list->sEntry) {
+	list->sEntry = list->sEntry ? 2 * list->sEntry : 64;
+	list->entry = realloc(list->entry, list->sEntry * sizeof(ENTRY));
+    }
+    list->entry[list->nEntry].kind = list->kind;
+    list->entry[list->nEntry].name = name;
+    list->entry[list->nEntry].profile = profile;
+    list->nEntry++;
+}
+
+
+/* most expensive first */
+static int compare(const void *a, const void *b)
+{
+    const PROFILE *pa = ((const ENTRY *) a)->profile;
+    const PROFILE *pb = ((const ENTRY *) b)->profile;
+
+    if (pa->time != pb->time)
+	return pa->time < pb->time ? 1 : -1;
+    if (pa->calls != pb->calls)
+	return pa->calls < pb->calls ? 1 : -1;
+    return 0;
+}
+
+
+static void dump(void __attribute__ ((unused)) * data)
+{
+    LIST list = { NULL, NULL, 0, 0 };
+    FILE *stream = NULL;
+    char line[256];
+    int i;
+
+    list.kind = "function";
+    EachFunction(collect, &list);
+    list.kind = "property";
+    property_each(collect, &list);
+
+    qsort(list.entry, list.nEntry, sizeof(ENTRY), compare);
+
+    if (File != NULL && (stream = fopen(File, "w")) == NULL) {
+	error("stats: fopen(%s) failed: %s", File, strerror(errno));
+    }
+
+    snprintf(line, sizeof(line), "%-8s %-40s %10s %12s %10s %10s", "kind", "name", "calls", "total ms", "max ms",
+	     "allocs");
+    if (stream)
+	fprintf(stream, "%s\n", line);
+    else
+	info("%s", line);
+
+    for (i = 0; i < list.nEntry; i++) {
+	PROFILE *p = list.entry[i].profile;
+	snprintf(line, sizeof(line), "%-8s %-40s %10lu %12.3f %10.3f %10lu", list.entry[i].kind, list.entry[i].name,
+		 p->calls, p->time / 1e6, p->max / 1e6, p->allocs);
+	if (stream)
+	    fprintf(stream, "%s\n", line);
+	else
+	    info("%s", line);
+    }
+
+    if (stream)
+	fclose(stream);
+
+    free(list.entry);
+}
+
+
+/* stats::eval(name, what) with 'name' being a function */
+/* or a property like 'Widget:CPU.expression', and 'what' */
+/* one of 'calls', 'time', 'max', 'avg' (msec) or 'allocs' */
+static void my_eval(RESULT * result, RESULT * arg1, RESULT * arg2)
+{
+    char *name = R2S(arg1);
+    char *what = R2S(arg2);
+    PROFILE *p;
+    PROPERTY *prop;
+    double value;
+
+    p = FunctionProfile(name);
+    if (p == NULL && (prop = property_find(name)) != NULL)
+	p = &prop->profile;
+
+    if (p == NULL) {
+	error("stats::eval(): unknown function or property '%s'", name);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    if (strcasecmp(what, "calls") == 0)
+	value = p->calls;
+    else if (strcasecmp(what, "time") == 0)
+	value = p->time / 1e6;
+    else if (strcasecmp(what, "max") == 0)
+	value = p->max / 1e6;
+    else if (strcasecmp(what, "avg") == 0)
+	value = p->calls ? p->time / 1e6 / p->calls : 0.0;
+    else if (strcasecmp(what, "allocs") == 0)
+	value = p->allocs;
+    else {
+	error("stats::eval(): unknown statistics '%s'", what);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+int plugin_init_stats(void)
+{
+    int profile, interval;
+
+    cfg_number("Evaluator", "profile", 0, 0, 1, &profile);
+    SetProfile(profile);
+
+    cfg_number("Evaluator", "profileInterval", 0, 0, -1, &interval);
+    File = cfg_get("Evaluator", "profileFile", NULL);
+    if (File != NULL && *File == '\0') {
+	free(File);
+	File = NULL;
+    }
+
+    if (interval > 0)
+	timer_add(dump, NULL, interval, 0);
+
+    AddFunctionFlags("stats::eval", 2, my_eval, F_STABLE);
+
+    return 0;
+}
+
+
+void plugin_exit_stats(void)
+{
+    if (File != NULL) {
+	free(File);
+	File = NULL;
+    }
+}
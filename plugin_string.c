@@ -132,10 +132,10 @@ int plugin_init_string(void)
 {
 
     /* register some basic string functions */
-    AddFunction("strlen", 1, my_strlen);
-    AddFunction("strupper", 1, my_strupper);
-    AddFunction("strstr", 2, my_strstr);
-    AddFunction("substr", -1, my_substr);
+    AddFunctionFlags("strlen", 1, my_strlen, F_PURE);
+    AddFunctionFlags("strupper", 1, my_strupper, F_PURE);
+    AddFunctionFlags("strstr", 2, my_strstr, F_PURE);
+    AddFunctionFlags("substr", -1, my_substr, F_PURE);
     return 0;
 }
 
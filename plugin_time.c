@@ -100,9 +100,9 @@ int plugin_init_time(void)
 {
 
     /* register some basic time functions */
-    AddFunction("time", 0, my_time);
-    AddFunction("strftime", 2, my_strftime);
-    AddFunction("strftime_tz", 3, my_stftime_tz);
+    AddFunctionFlags("time", 0, my_time, F_STABLE);
+    AddFunctionFlags("strftime", 2, my_strftime, F_PURE);
+    AddFunctionFlags("strftime_tz", 3, my_stftime_tz, F_PURE);
 
     return 0;
 }
@@ -0,0 +1,128 @@
+/* $Id$
+ * $URL$
+ *
+ * timer statistics plugin
+ *
+ * Copyright (C) 2026 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
+ *
+ * This file is part of LCD4Linux.
+ *
+ * LCD4Linux is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * LCD4Linux is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * exported functions:
+ *
+ * int plugin_init_timer (void)
+ *  adds functions for the dispatch statistics of the timers:
+ *
+ *  timer::late_p99()   99th percentile of the lateness of all
+ *                      timers in msec
+ *  timer::run_p99()    99th percentile of the callback run time of
+ *                      all timers in msec
+ *  timer::skipped()    number of intervals skipped by all timers
+ *  timer::stat(name, what, percentile)
+ *                      'what' is one of 'late', 'run' (msec), 'skip'
+ *                      or 'calls'; 'name' is a timer's name like
+ *                      'group:500', or '' for all timers
+ *
+ * The statistics are also logged on SIGUSR1.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "debug.h"
+#include "plugin.h"
+#include "timer.h"
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+static void my_late_p99(RESULT * result)
+{
+    double value = timer_percentile(&timer_stats(NULL)->late, 99) / 1000;
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+static void my_run_p99(RESULT * result)
+{
+    double value = timer_percentile(&timer_stats(NULL)->run, 99) / 1000;
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+static void my_skipped(RESULT * result)
+{
+    double value = timer_stats(NULL)->skip.sum;
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+static void my_stat(RESULT * result, RESULT * arg1, RESULT * arg2, RESULT * arg3)
+{
+    char *name = R2S(arg1);
+    char *what = R2S(arg2);
+    double percentile = R2N(arg3);
+    TIMER_STATS *stats;
+    double value;
+
+    if ((stats = timer_stats(name)) == NULL) {
+	error("timer::stat(): unknown timer '%s'", name);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    if (strcasecmp(what, "late") == 0)
+	value = timer_percentile(&stats->late, percentile) / 1000;
+    else if (strcasecmp(what, "run") == 0)
+	value = timer_percentile(&stats->run, percentile) / 1000;
+    else if (strcasecmp(what, "skip") == 0)
+	value = timer_percentile(&stats->skip, percentile);
+    else if (strcasecmp(what, "calls") == 0)
+	value = stats->late.count;
+    else {
+	error("timer::stat(): unknown statistics '%s'", what);
+	SetResult(&result, R_STRING, "");
+	return;
+    }
+
+    SetResult(&result, R_NUMBER, &value);
+}
+
+
+int plugin_init_timer(void)
+{
+    AddFunction("timer::late_p99", 0, my_late_p99);
+    AddFunction("timer::run_p99", 0, my_run_p99);
+    AddFunction("timer::skipped", 0, my_skipped);
+    AddFunction("timer::stat", 3, my_stat);
+
+    return 0;
+}
+
+
+void plugin_exit_timer(void)
+{
+}
@@ -83,7 +83,7 @@ static void my_uname(RESULT * result, RESULT * arg1)
 
 int plugin_init_uname(void)
 {
-    AddFunction("uname", 1, my_uname);
+    AddFunctionFlags("uname", 1, my_uname, F_STABLE);
     return 0;
 }
 
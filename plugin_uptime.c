@@ -188,10 +188,8 @@ double getuptime(void)
 
 static void my_uptime(RESULT * result, const int argc, RESULT * argv[])
 {
-    int age;
     static double uptime = 0.0;
-    static struct timeval last_value;
-    struct timeval now;
+    static unsigned long tick = 0;
 
     if (argc > 1) {
 	error("uptime(): wrong number of parameters");
@@ -199,19 +197,14 @@ static void my_uptime(RESULT * result, const int argc, RESULT * argv[])
 	return;
     }
 
-    gettimeofday(&now, NULL);
-
-    age = (now.tv_sec - last_value.tv_sec) * 1000 + (now.tv_usec - last_value.tv_usec) / 1000;
-    /* reread every 100 msec only */
-    if (fd == -2 || age == 0 || age > 100) {
+    /* read once per tick, results are cached by the evaluator */
+    if (fd == -2 || NewTick(&tick)) {
 	uptime = getuptime();
 	if (uptime < 0.0) {
 	    error("parse(/proc/uptime) failed!");
 	    SetResult(&result, R_STRING, "");
 	    return;
 	}
-
-	last_value = now;
     }
 
     if (argc == 0) {
@@ -226,7 +219,7 @@ static void my_uptime(RESULT * result, const int argc, RESULT * argv[])
 
 int plugin_init_uptime(void)
 {
-    AddFunction("uptime", -1, my_uptime);
+    AddFunctionTTL("uptime", -1, my_uptime, F_STABLE, 100);
     return 0;
 }
 
@@ -34,8 +34,24 @@
  * void property_free (PROPERTY *prop)
  *   frees all property allocations
  *
+ * void property_defer (void)
+ *   properties loaded from now on are not compiled at once,
+ *   but collected for property_compile()
+ *
+ * void property_compile (void)
+ *   compiles all deferred properties using several threads
+ *
+ * PROPERTY *property_find (const char *name)
+ *   returns the property loaded from 'section.key', or NULL
+ *
+ * void property_each (void (*callback)(name, profile, data), void *data)
+ *   calls 'callback' for every loaded property
+ *
  * int property_eval(PROPERTY * prop)
  *   evaluates a property; returns 1 if value has changed
+ *   the expression is not evaluated at all if none of its
+ *   dependencies has changed since the last evaluation.
+ *   The cost of evaluations is accounted to prop->profile
  *
  * double P2N(PROPERTY * prop)
  *   returns a (already evaluated) property as number
@@ -51,6 +67,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "debug.h"
 #include "cfg.h"
@@ -61,6 +79,50 @@
 #include <dmalloc.h>
 #endif
 
+/* maximum number of compiler threads */
+#define MAX_THREADS 16
+
+/* properties waiting to be compiled */
+static int Deferred = 0;
+static PROPERTY **Pending = NULL;
+static int nPending = 0;
+static int sPending = 0;
+
+/* all loaded properties */
+static PROPERTY **Property = NULL;
+static int nProperty = 0;
+static int sProperty = 0;
+
+/* next pending property to be compiled by a thread */
+static int nNext = 0;
+static pthread_mutex_t NextLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* remove a property from the pending list; the positions are kept */
+/* in the properties, so this does not need to search the list */
+static int property_unpend(PROPERTY * prop)
+{
+    int i = prop->pending - 1;
+
+    if (i < 0)
+	return 0;
+
+    Pending[i] = Pending[--nPending];
+    if (i < nPending)
+	Pending[i]->pending = i + 1;
+    prop->pending = 0;
+
+    return 1;
+}
+
+
+/* compile a pending property now, because it is needed now */
+static void property_undefer(PROPERTY * prop)
+{
+    if (property_unpend(prop))
+	Compile(prop->expression, &prop->compiled);
+}
+
 
 void property_load(const char *section, const char *name, const char *defval, PROPERTY * prop)
 {
@@ -74,7 +136,17 @@ void property_load(const char *section, const char *name, const char *defval, PR
     DelResult(&prop->result);
 
     /* remember the name */
-    prop->name = strdup(name);
+    prop->name = malloc(strlen(section) + strlen(name) + 2);
+    sprintf(prop->name, "%s.%s", section, name);
+    memset(&prop->profile, 0, sizeof(PROFILE));
+
+    if (nProperty >= sProperty) {
+	sProperty = sProperty ? 2 * sProperty : 64;
+	Property = realloc(Property, sProperty * sizeof(PROPERTY *));
+    }
+    Property[nProperty++] = prop;
+    prop->index = nProperty;
+    prop->pending = 0;
 
     /* load expression from config, but do not evaluate it */
     expression = cfg_get_raw(section, name, NULL);
@@ -88,8 +160,17 @@ void property_load(const char *section, const char *name, const char *defval, PR
 	prop->expression = expression;
     }
 
-    /* pre-compile the expression */
-    Compile(prop->expression, &prop->compiled);
+    /* pre-compile the expression, or leave it to property_compile() */
+    if (Deferred) {
+	if (nPending >= sPending) {
+	    sPending = sPending ? 2 * sPending : 64;
+	    Pending = realloc(Pending, sPending * sizeof(PROPERTY *));
+	}
+	Pending[nPending++] = prop;
+	prop->pending = nPending;
+    } else {
+	Compile(prop->expression, &prop->compiled);
+    }
 }
 
 
@@ -101,33 +182,35 @@ int property_valid(PROPERTY * prop)
 
 int property_eval(PROPERTY * prop)
 {
-    RESULT old;
+    RESULT *result;
+    RESULT *rp = &prop->result;
+    PROFILE_CLOCK clock;
     int update;
 
-    /* this is a bit ugly: we need to remember the old value */
-    old.type = prop->result.type;
-    old.size = prop->result.size;
-    old.number = prop->result.number;
-    old.string = prop->result.string != NULL ? strdup(prop->result.string) : NULL;
+    if (nPending > 0 && prop->compiled == NULL)
+	property_undefer(prop);
 
-    DelResult(&prop->result);
-    Eval(prop->compiled, &prop->result);
+    /* nothing the expression depends on has changed */
+    if (prop->result.type != 0 && !EvalStale(prop->compiled))
+	return 0;
+
+    /* borrow the new value, so it can be compared */
+    /* against the old one without copying either */
+    ProfileStart(&clock);
+    EvalBorrow(prop->compiled, &result);
+    ProfileStop(&clock, &prop->profile);
 
     /* check if property value has changed */
     update = 1;
-    if (prop->result.type & R_NUMBER && old.type & R_NUMBER && prop->result.number == old.number) {
+    if (result->type & R_NUMBER && prop->result.type & R_NUMBER && result->number == prop->result.number) {
 	update = 0;
     }
-    if (prop->result.type & R_STRING && old.type & R_STRING && prop->result.size == old.size) {
-	if (prop->result.string == NULL && old.string == NULL) {
-	    update = 0;
-	} else if (prop->result.string != NULL && old.string != NULL && strcmp(prop->result.string, old.string) == 0) {
-	    update = 0;
-	}
+    if (result->type & R_STRING && prop->result.type & R_STRING && strcmp(result->string, prop->result.string) == 0) {
+	update = 0;
     }
 
-    if (old.string)
-	free(old.string);
+    /* this reuses the buffer of the old value */
+    CopyResult(&rp, result);
 
     return update;
 }
@@ -154,6 +237,23 @@ char *P2S(PROPERTY * prop)
 
 void property_free(PROPERTY * prop)
 {
+    int i;
+
+    /* a pending property must not be compiled anymore */
+    property_unpend(prop);
+
+    if ((i = prop->index - 1) >= 0) {
+	Property[i] = Property[--nProperty];
+	if (i < nProperty)
+	    Property[i]->index = i + 1;
+	prop->index = 0;
+    }
+    if (nProperty == 0 && Property != NULL) {
+	free(Property);
+	Property = NULL;
+	sProperty = 0;
+    }
+
     if (prop->name != NULL) {
 	free(prop->name);
 	prop->name = NULL;
@@ -165,9 +265,95 @@ void property_free(PROPERTY * prop)
     }
 
     if (prop->compiled != NULL) {
-        free(prop->compiled);
-        prop->compiled = NULL;
+	DelTree(prop->compiled);
+	prop->compiled = NULL;
     }
 
     DelResult(&prop->result);
 }
+
+
+void property_defer(void)
+{
+    Deferred = 1;
+}
+
+
+static void *property_worker(void *arg)
+{
+    int i;
+
+    (void) arg;
+
+    while (1) {
+	pthread_mutex_lock(&NextLock);
+	i = nNext++;
+	pthread_mutex_unlock(&NextLock);
+	if (i >= nPending)
+	    break;
+	Compile(Pending[i]->expression, &Pending[i]->compiled);
+    }
+
+    return NULL;
+}
+
+
+void property_compile(void)
+{
+    int i, n, err;
+    pthread_t thread[MAX_THREADS];
+
+    Deferred = 0;
+
+    /* one thread per CPU, the calling thread helps out */
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > MAX_THREADS)
+	n = MAX_THREADS;
+    if (n > nPending / 16)
+	n = nPending / 16;
+
+    nNext = 0;
+    for (i = 1; i < n; i++) {
+	if ((err = pthread_create(&thread[i], NULL, property_worker, NULL)) != 0) {
+	    error("Property: cannot create compiler thread: %s", strerror(err));
+	    break;
+	}
+    }
+    n = i;
+    property_worker(NULL);
+    for (i = 1; i < n; i++) {
+	pthread_join(thread[i], NULL);
+    }
+
+    debug("compiled %d properties using %d thread(s)", nPending, n > 1 ? n : 1);
+
+    for (i = 0; i < nPending; i++)
+	Pending[i]->pending = 0;
+
+    free(Pending);
+    Pending = NULL;
+    nPending = 0;
+    sPending = 0;
+}
+
+
+PROPERTY *property_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nProperty; i++) {
+	if (strcasecmp(Property[i]->name, name) == 0)
+	    return Property[i];
+    }
+    return NULL;
+}
+
+
+void property_each(void (*callback) (const char *name, PROFILE * profile, void *data), void *data)
+{
+    int i;
+
+    for (i = 0; i < nProperty; i++) {
+	callback(Property[i]->name, &Property[i]->profile, data);
+    }
+}
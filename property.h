@@ -33,10 +33,13 @@
 
 typedef struct {
     int valid;
-    char *name;
+    char *name;			/* section.key */
     char *expression;
     void *compiled;
     RESULT result;
+    PROFILE profile;
+    int index;			/* 1 + position in the list of all properties, 0 if none */
+    int pending;		/* 1 + position in the pending list, 0 if none */
 } PROPERTY;
 
 
@@ -46,5 +49,9 @@ int property_eval(PROPERTY * prop);
 double P2N(PROPERTY * prop);
 char *P2S(PROPERTY * prop);
 void property_free(PROPERTY * prop);
+void property_defer(void);
+void property_compile(void);
+PROPERTY *property_find(const char *name);
+void property_each(void (*callback) (const char *name, PROFILE * profile, void *data), void *data);
 
 #endif
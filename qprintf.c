@@ -34,6 +34,20 @@
  *   works like snprintf(), but format only knows about %d, %x, %u and %s
  *     and for the numbers an optional length like %<len>d. If <len> beginns
  *     with '0' the free space is filled with '0's, otherwise with ' '
+ *
+ * int qftoa(char *str, size_t size, double value, int precision)
+ *   works like snprintf(str, size, "%.*f", precision, value)
+ *
+ * int qgtoa(char *str, size_t size, double value)
+ *   works like snprintf(str, size, "%g", value)
+ *
+ * int qftoa_width(char *str, size_t size, double value, int precision, int width)
+ *   like qftoa(), but reduces the precision if the number does not fit
+ *     into 'width' characters, and fills the field with '*' if it still
+ *     does not fit. 'size' must be at least width+1
+ *
+ *   all three use integer arithmetic for common values, and fall back
+ *   to snprintf() for huge values, high precisions and near-ties
  */
 
 
@@ -43,6 +57,16 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <math.h>
+
+#include "qprintf.h"
+
+/* maximum precision of the integer formatting path */
+#define QF_PRECISION 10
+
+static const double pow10d[QF_PRECISION + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
 
 static char *itoa(char *buffer, const size_t size, int value, unsigned int fixedlen, unsigned int fill0)
 {
@@ -258,3 +282,165 @@ int qprintf(char *str, const size_t size, const char *format, ...)
     /* do not count terminating zero */
     return len - 1;
 }
+
+
+/* rounds |value| * 10^precision to an integer the way printf() does; */
+/* fails if the result is too large or too close to a tie, because */
+/* the multiplication may be off by a few units in the last place */
+static int qround(const double value, const int precision, unsigned long long *digits)
+{
+    double f, i;
+
+    if (precision < 0 || precision > QF_PRECISION)
+	return -1;
+
+    f = fabs(value) * pow10d[precision];
+
+    /* this fails on NaN, too */
+    if (!(f < 1e11))
+	return -1;
+
+    i = floor(f);
+    f -= i;
+    if (f > 0.4999 && f < 0.5001)
+	return -1;
+
+    *digits = (unsigned long long) i + (f > 0.5);
+    return 0;
+}
+
+
+/* prints digits / 10^precision into buffer, returns the length */
+static int qfixed(char *buffer, const int negative, unsigned long long digits, const int precision)
+{
+    char tmp[32], *p;
+    int i, len;
+
+    /* p points behind the last char */
+    p = tmp + sizeof(tmp);
+
+    for (i = 0; i < precision; i++) {
+	*--p = digits % 10 + '0';
+	digits /= 10;
+    }
+    if (precision > 0)
+	*--p = '.';
+
+    do {
+	*--p = digits % 10 + '0';
+	digits /= 10;
+    } while (digits != 0);
+
+    if (negative)
+	*--p = '-';
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(buffer, p, len);
+    buffer[len] = '\0';
+
+    return len;
+}
+
+
+/* copies a formatted number, returns its untruncated length */
+static int qcopy(char *str, const size_t size, const char *buffer, const int len)
+{
+    size_t n = len;
+
+    if (size == 0)
+	return len;
+
+    if (n > size - 1)
+	n = size - 1;
+    memcpy(str, buffer, n);
+    str[n] = '\0';
+
+    return len;
+}
+
+
+int qftoa(char *str, const size_t size, const double value, const int precision)
+{
+    char buffer[32];
+    unsigned long long digits;
+
+    if (qround(value, precision, &digits) < 0)
+	return snprintf(str, size, "%.*f", precision, value);
+
+    return qcopy(str, size, buffer, qfixed(buffer, signbit(value), digits, precision));
+}
+
+
+int qgtoa(char *str, const size_t size, const double value)
+{
+    char buffer[32];
+    unsigned long long digits;
+    double a = fabs(value);
+    int precision, len;
+
+    if (a == 0.0)
+	return qcopy(str, size, signbit(value) ? "-0" : "0", signbit(value) ? 2 : 1);
+
+    /* %g uses exponential notation outside of this range */
+    if (!(a >= 1e-4 && a < 1e6))
+	return snprintf(str, size, "%g", value);
+
+    /* six significant digits */
+    for (precision = 0; precision < 9; precision++) {
+	if (a * pow10d[precision] >= 1e5)
+	    break;
+    }
+
+    while (1) {
+	if (qround(value, precision, &digits) < 0)
+	    return snprintf(str, size, "%g", value);
+	if (digits < 1000000)
+	    break;
+	/* rounding added a digit */
+	if (precision == 0)
+	    return snprintf(str, size, "%g", value);
+	precision--;
+    }
+
+    len = qfixed(buffer, signbit(value), digits, precision);
+
+    /* strip trailing zeros and decimal point */
+    if (precision > 0) {
+	while (buffer[len - 1] == '0')
+	    len--;
+	if (buffer[len - 1] == '.')
+	    len--;
+	buffer[len] = '\0';
+    }
+
+    return qcopy(str, size, buffer, len);
+}
+
+
+int qftoa_width(char *str, const size_t size, const double value, int precision, int width)
+{
+    int len, delta;
+
+    if (width < 0)
+	width = 0;
+
+    len = qftoa(str, size, value, precision);
+
+    /* number does not fit into field width: try to reduce precision */
+    while (len > width && precision > 0) {
+	delta = len - width;
+	if (delta > precision)
+	    delta = precision;
+	precision -= delta;
+	len = qftoa(str, size, value, precision);
+    }
+
+    /* number still doesn't fit: display '*****' */
+    if (len > width) {
+	memset(str, '*', width);
+	str[width] = '\0';
+	len = width;
+    }
+
+    return len;
+}
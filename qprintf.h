@@ -34,5 +34,8 @@
 #include <stdio.h>
 
 int qprintf(char *str, size_t size, const char *format, ...);
+int qftoa(char *str, size_t size, double value, int precision);
+int qgtoa(char *str, size_t size, double value);
+int qftoa_width(char *str, size_t size, double value, int precision, int width);
 
 #endif
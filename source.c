@@ -0,0 +1,405 @@
+/* $Id$
+ * $URL$
+ *
+ * asynchronous data sources for plugins which would block
+ *
+ * Copyright (C) 2026 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
+ *
+ * This file is part of LCD4Linux.
+ *
+ * LCD4Linux is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * LCD4Linux is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * exported functions:
+ *
+ * SOURCE *source_create (char *name, char *section, SOURCE_FETCH fetch,
+ *                        int interval, int flags)
+ *   creates a data source whose values are fetched on the worker
+ *   pool; 'interval' is the default refresh interval in msec, flags
+ *   may be SOURCE_SERIAL if the fetches share a connection; every
+ *   source reserves a pool worker, so that a server which does not
+ *   answer does not hold up the other sources
+ *
+ * void source_destroy (SOURCE *source)
+ *   waits for running fetches and releases the source
+ *
+ * const char *source_get (SOURCE *source, char *key)
+ *   returns the cached value for 'key' (NULL if there is none yet)
+ *   without blocking, and starts a refresh if it is due
+ *
+ * int source_age (char *name, char *key)
+ *   age of a value in msec, or of the oldest one if key is NULL;
+ *   -1 if there is no value yet, -2 for an unknown source
+ *
+ * int source_stale (char *name, char *key)
+ *   1 if the value (any value if key is NULL) is stale, 0 if not,
+ *   -2 for an unknown source
+ *
+ * int source_timeout (int fd, int timeout)
+ *   applies a fetch's timeout to the send and receive calls (and
+ *   the connect) on a socket
+ *
+ * config keys in the plugin's section:
+ *   interval  refresh interval in msec
+ *   timeout   handed to the fetch function in msec (default 5000)
+ *   stale     a value older than this many msec is stale (default
+ *             twice the interval plus the timeout)
+ *   fallback  returned instead of a stale value; if not set, the
+ *             last value is kept
+ *
+ * Every key of a source has its own entry. The fetch function runs
+ * on a pool worker and hands its result over through the entry; the
+ * main loop picks it up on the next source_get(), so no locking is
+ * needed. An entry never has more than one fetch running.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+#include "cfg.h"
+#include "thread.h"
+#include "source.h"
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+typedef struct {
+    char *key;
+    SOURCE_FETCH fetch;
+    int timeout;
+    char *value;		/* latest value, main thread only */
+    unsigned long long updated;	/* msec, 0 if there is no value yet */
+    unsigned long long started;	/* msec, start of the last fetch */
+    int busy;			/* a fetch has been submitted */
+    char *result;		/* written by the worker before 'done' */
+    int done;			/* accessed atomically only */
+    int cancel;			/* accessed atomically only */
+} SOURCE_ENTRY;
+
+struct SOURCE {
+    char *name;
+    SOURCE_FETCH fetch;
+    int interval;
+    int timeout;
+    int stale;
+    int flags;
+    char *fallback;
+    int running;
+    int nEntry;
+    int sEntry;
+    SOURCE_ENTRY **Entry;
+};
+
+static SOURCE **Sources = NULL;
+static int nSources = 0;
+static int sSources = 0;
+
+
+static unsigned long long source_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/* worker thread */
+static void source_job(void *data)
+{
+    SOURCE_ENTRY *entry = (SOURCE_ENTRY *) data;
+    char *result = NULL;
+
+    if (!__atomic_load_n(&entry->cancel, __ATOMIC_RELAXED))
+	result = entry->fetch(entry->key, entry->timeout);
+
+    entry->result = result;
+    __atomic_store_n(&entry->done, 1, __ATOMIC_RELEASE);
+}
+
+
+/* pick up the results of finished fetches */
+static void source_collect(SOURCE * source, const unsigned long long now)
+{
+    SOURCE_ENTRY *entry;
+    int i;
+
+    for (i = 0; i < source->nEntry && source->running > 0; i++) {
+	entry = source->Entry[i];
+	if (!entry->busy || !__atomic_load_n(&entry->done, __ATOMIC_ACQUIRE))
+	    continue;
+
+	entry->busy = 0;
+	source->running--;
+
+	if (entry->result != NULL) {
+	    if (entry->value)
+		free(entry->value);
+	    entry->value = entry->result;
+	    entry->result = NULL;
+	    entry->updated = now;
+	} else if (!__atomic_load_n(&entry->cancel, __ATOMIC_RELAXED)) {
+	    debug("source %s: fetching '%s' failed", source->name, entry->key);
+	}
+    }
+}
+
+
+static SOURCE_ENTRY *source_entry(SOURCE * source, const char *key)
+{
+    SOURCE_ENTRY *entry;
+    int i;
+
+    /* sources have a handful of keys at most */
+    for (i = 0; i < source->nEntry; i++) {
+	if (strcmp(source->Entry[i]->key, key) == 0)
+	    return source->Entry[i];
+    }
+
+    if (source->nEntry >= source->sEntry) {
+	source->sEntry = source->sEntry ? 2 * source->sEntry : 4;
+	source->Entry = realloc(source->Entry, source->sEntry * sizeof(SOURCE_ENTRY *));
+    }
+
+    entry = calloc(1, sizeof(SOURCE_ENTRY));
+    entry->key = strdup(key);
+    entry->fetch = source->fetch;
+    entry->timeout = source->timeout;
+    source->Entry[source->nEntry++] = entry;
+
+    return entry;
+}
+
+
+static void source_refresh(SOURCE * source, SOURCE_ENTRY * entry, const unsigned long long now)
+{
+    if (entry->busy)
+	return;
+
+    if (entry->started != 0 && now - entry->started < (unsigned long long) source->interval)
+	return;
+
+    if ((source->flags & SOURCE_SERIAL) && source->running > 0)
+	return;
+
+    entry->started = now;
+    entry->result = NULL;
+    entry->done = 0;
+    entry->cancel = 0;
+
+    if (thread_pool_submit(source_job, entry) < 0)
+	return;
+
+    entry->busy = 1;
+    source->running++;
+}
+
+
+static int source_entry_stale(SOURCE * source, SOURCE_ENTRY * entry, const unsigned long long now)
+{
+    return entry->updated == 0 || now - entry->updated > (unsigned long long) source->stale;
+}
+
+
+static SOURCE *source_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nSources; i++) {
+	if (strcasecmp(Sources[i]->name, name) == 0)
+	    return Sources[i];
+    }
+    return NULL;
+}
+
+
+SOURCE *source_create(const char *name, const char *section, SOURCE_FETCH fetch, const int interval,
+		      const int flags)
+{
+    SOURCE *source;
+
+    source = calloc(1, sizeof(SOURCE));
+    source->name = strdup(name);
+    source->fetch = fetch;
+    source->flags = flags;
+
+    cfg_number(section, "interval", interval, 10, -1, &source->interval);
+    cfg_number(section, "timeout", 5000, 10, -1, &source->timeout);
+    cfg_number(section, "stale", 2 * source->interval + source->timeout, 0, -1, &source->stale);
+    source->fallback = cfg_get(section, "fallback", NULL);
+
+    if (nSources >= sSources) {
+	sSources = sSources ? 2 * sSources : 8;
+	Sources = realloc(Sources, sSources * sizeof(SOURCE *));
+    }
+    Sources[nSources++] = source;
+
+    thread_pool_reserve(1);
+
+    debug("source %s: refresh every %d msec, timeout %d msec, stale after %d msec", source->name,
+	 source->interval, source->timeout, source->stale);
+
+    return source;
+}
+
+
+void source_destroy(SOURCE * source)
+{
+    struct timespec delay = { 0, 10000000 };
+    SOURCE_ENTRY *entry;
+    int i;
+
+    if (source == NULL)
+	return;
+
+    /* queued fetches are skipped, running ones have to finish */
+    for (i = 0; i < source->nEntry; i++) {
+	if (source->Entry[i]->busy)
+	    __atomic_store_n(&source->Entry[i]->cancel, 1, __ATOMIC_RELAXED);
+    }
+    if (source->running > 0)
+	info("source %s: waiting for %d running fetches", source->name, source->running);
+    while (source->running > 0) {
+	nanosleep(&delay, NULL);
+	source_collect(source, source_clock());
+    }
+
+    for (i = 0; i < source->nEntry; i++) {
+	entry = source->Entry[i];
+	free(entry->key);
+	if (entry->value)
+	    free(entry->value);
+	free(entry);
+    }
+    if (source->Entry)
+	free(source->Entry);
+
+    for (i = 0; i < nSources; i++) {
+	if (Sources[i] == source) {
+	    Sources[i] = Sources[--nSources];
+	    break;
+	}
+    }
+    if (nSources == 0) {
+	free(Sources);
+	Sources = NULL;
+	sSources = 0;
+    }
+
+    thread_pool_reserve(-1);
+
+    if (source->fallback)
+	free(source->fallback);
+    free(source->name);
+    free(source);
+}
+
+
+const char *source_get(SOURCE * source, const char *key)
+{
+    unsigned long long now = source_clock();
+    SOURCE_ENTRY *entry;
+
+    source_collect(source, now);
+
+    entry = source_entry(source, key);
+    source_refresh(source, entry, now);
+
+    if (source->fallback && source_entry_stale(source, entry, now))
+	return source->fallback;
+
+    return entry->value;
+}
+
+
+int source_age(const char *name, const char *key)
+{
+    unsigned long long now = source_clock();
+    SOURCE *source;
+    int i, age, oldest = -1;
+
+    if ((source = source_find(name)) == NULL)
+	return -2;
+
+    source_collect(source, now);
+
+    for (i = 0; i < source->nEntry; i++) {
+	SOURCE_ENTRY *entry = source->Entry[i];
+	if (key != NULL && strcmp(entry->key, key) != 0)
+	    continue;
+	if (entry->updated == 0)
+	    return -1;
+	age = now - entry->updated;
+	if (age > oldest)
+	    oldest = age;
+    }
+
+    return oldest;
+}
+
+
+int source_stale(const char *name, const char *key)
+{
+    unsigned long long now = source_clock();
+    SOURCE *source;
+    int i, found = 0;
+
+    if ((source = source_find(name)) == NULL)
+	return -2;
+
+    source_collect(source, now);
+
+    for (i = 0; i < source->nEntry; i++) {
+	SOURCE_ENTRY *entry = source->Entry[i];
+	if (key != NULL && strcmp(entry->key, key) != 0)
+	    continue;
+	if (source_entry_stale(source, entry, now))
+	    return 1;
+	found = 1;
+    }
+
+    /* nothing fetched yet */
+    return found ? 0 : 1;
+}
+
+
+int source_timeout(const int fd, const int timeout)
+{
+    struct timeval tv;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    /* SO_SNDTIMEO limits connect(), too */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+	return -1;
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
+	return -1;
+
+    return 0;
+}
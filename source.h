@@ -0,0 +1,48 @@
+/* $Id$
+ * $URL$
+ *
+ * asynchronous data sources for plugins which would block
+ *
+ * Copyright (C) 2026 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
+ *
+ * This file is part of LCD4Linux.
+ *
+ * LCD4Linux is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * LCD4Linux is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+/* a source's refreshes never overlap */
+#define SOURCE_SERIAL 1
+
+typedef struct SOURCE SOURCE;
+
+/* runs on a worker thread, returns a malloc'ed value or NULL on error */
+typedef char *(*SOURCE_FETCH) (const char *key, const int timeout);
+
+SOURCE *source_create(const char *name, const char *section, SOURCE_FETCH fetch, const int interval,
+		      const int flags);
+void source_destroy(SOURCE * source);
+
+const char *source_get(SOURCE * source, const char *key);
+
+int source_age(const char *name, const char *key);
+int source_stale(const char *name, const char *key);
+
+int source_timeout(const int fd, const int timeout);
+
+#endif
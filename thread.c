@@ -1,7 +1,7 @@
 /* $Id$
  * $URL$
  *
- * thread handling (mutex, shmem, ...)
+ * thread handling (threads, worker pool, mutex, shmem, ...)
  *
  * Copyright (C) 2004 Michael Reinelt <michael@reinelt.co.at>
  * Copyright (C) 2004 The LCD4Linux Team <lcd4linux-devel@users.sourceforge.net>
@@ -34,7 +34,8 @@
  *   creates a mutex and treturns its ID
  * 
  * void mutex_lock    (int semid);
- *   try to lock a mutex
+ *   try to lock a mutex; the calling thread cannot be cancelled
+ *   while it holds a mutex
  *
  * void mutex_unlock  (int semid);
  *   unlock a mutex
@@ -50,7 +51,34 @@
  *   release shared memory segment
  *
  * int thread_create (char *name, void (*thread)(void *data), void *data);
- *   create a new thread
+ *   create a new thread, returns its ID (IDs are never 0)
+ *
+ * int thread_destroy (int id);
+ *   cancel a thread and wait for it
+ *
+ * int thread_pool_submit (void (*job)(void *data), void *data);
+ *   run a short job on one of the pool's worker threads
+ *
+ * void thread_pool_reserve (int n);
+ *   reserve n more workers for jobs which may block on I/O (or
+ *   release them if n is negative)
+ *
+ * int  thread_slot_create  (THREAD_SLOT *slot, int size);
+ * void thread_slot_destroy (THREAD_SLOT *slot);
+ * void *thread_slot_buffer (THREAD_SLOT *slot);
+ * void thread_slot_publish (THREAD_SLOT *slot);
+ * void *thread_slot_read   (THREAD_SLOT *slot);
+ *   lock-free result slot for one producer and one consumer thread
+ *
+ * void thread_exit (void);
+ *   cancels all remaining threads and stops the pool
+ *
+ *
+ * "threads" used to be forked processes sharing SysV semaphores and
+ * shared memory; they are POSIX threads now, and the mutex and shm
+ * functions are kept for the existing callers. Mutexes and shared
+ * memory are plain pthread mutexes and heap memory, identified by
+ * their index in a table.
  *
  */
 
@@ -63,12 +91,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <signal.h>
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
-#include <sys/shm.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "debug.h"
+#include "cfg.h"
 #include "thread.h"
 
 
@@ -80,59 +107,149 @@
 int thread_argc;
 char **thread_argv;
 
+/* table sizes; tables are never reallocated, because other threads */
+/* may access them at any time */
+#define MUTEX_MAX 256
+#define SHM_MAX 256
+#define THREAD_MAX 64
+
+/* maximum number of pool workers */
+#define POOL_MAX 16
+
+/* minimum number of pool workers, the jobs may block on I/O */
+#define POOL_MIN 4
+
+/* size of the pool's job queue */
+#define POOL_QUEUE 64
+
+/* a published slot buffer which has not been read yet */
+#define SLOT_FRESH 4
+
+/* mutexes and shared memory segments, indexed by their IDs */
+static pthread_mutex_t *Mutex[MUTEX_MAX];
+static void *Shm[SHM_MAX];
+static pthread_mutex_t TableLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* threads created by thread_create() */
+typedef struct {
+    pthread_t thread;
+    char *name;
+    void (*func) (void *data);
+    void *data;
+    int active;
+} THREAD;
+
+static THREAD Thread[THREAD_MAX];
+
+/* mutexes held by the calling thread, cancellation is disabled */
+/* while it is not zero */
+static __thread int Held = 0;
+static __thread int HeldState = PTHREAD_CANCEL_ENABLE;
+
+/* worker pool */
+typedef struct {
+    void (*job) (void *data);
+    void *data;
+} JOB;
+
+static pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PoolCond = PTHREAD_COND_INITIALIZER;
+static JOB PoolQueue[POOL_QUEUE];
+static int PoolHead = 0;
+static int PoolCount = 0;
+static pthread_t PoolWorker[POOL_MAX];
+static int nPoolWorker = 0;
+static int nPoolIdle = 0;
+static int PoolSize = 0;
+static int PoolFixed = 0;
+static int PoolReserved = 0;
+static int PoolStop = 0;
+static time_t PoolFullTime = 0;
+static int PoolRefused = 0;
+
+
+/* find a free table entry; IDs start at 1, so that 0 is never valid */
+static int table_slot(void **table, const int size)
+{
+    int i;
 
-/* glibc 2.1 requires defining semun ourselves */
-#ifdef _SEM_SEMUN_UNDEFINED
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short int *array;
-    struct seminfo *__buf;
-};
-#endif
+    for (i = 1; i < size; i++) {
+	if (table[i] == NULL)
+	    return i;
+    }
+    return -1;
+}
 
 
 int mutex_create(void)
 {
-    int semid;
-    union semun semun;
+    pthread_mutex_t *mutex;
+    int id;
 
-    semid = semget(IPC_PRIVATE, 1, 0);
-    if (semid == -1) {
-	error("fatal error: semget() failed: %s", strerror(errno));
+    if ((mutex = malloc(sizeof(pthread_mutex_t))) == NULL) {
+	error("fatal error: mutex allocation failed");
 	return -1;
     }
-    semun.val = 1;
-    semctl(semid, 0, SETVAL, semun);
+    pthread_mutex_init(mutex, NULL);
+
+    pthread_mutex_lock(&TableLock);
+    id = table_slot((void **) Mutex, MUTEX_MAX);
+    if (id >= 0)
+	Mutex[id] = mutex;
+    pthread_mutex_unlock(&TableLock);
+
+    if (id < 0) {
+	error("fatal error: mutex allocation failed");
+	pthread_mutex_destroy(mutex);
+	free(mutex);
+    }
 
-    return semid;
+    return id;
 }
 
 
 void mutex_lock(const int semid)
 {
-    struct sembuf sembuf;
-    sembuf.sem_num = 0;
-    sembuf.sem_op = -1;
-    sembuf.sem_flg = 0;
-    semop(semid, &sembuf, 1);
+    int state;
+
+    if (semid <= 0 || semid >= MUTEX_MAX || Mutex[semid] == NULL)
+	return;
+
+    /* a thread holding a mutex must not be cancelled */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+    if (Held++ == 0)
+	HeldState = state;
+
+    pthread_mutex_lock(Mutex[semid]);
 }
 
 
 void mutex_unlock(const int semid)
 {
-    struct sembuf sembuf;
-    sembuf.sem_num = 0;
-    sembuf.sem_op = 1;
-    sembuf.sem_flg = 0;
-    semop(semid, &sembuf, 1);
+    if (semid <= 0 || semid >= MUTEX_MAX || Mutex[semid] == NULL)
+	return;
+
+    pthread_mutex_unlock(Mutex[semid]);
+
+    if (Held > 0 && --Held == 0) {
+	pthread_setcancelstate(HeldState, NULL);
+	/* a pending cancellation request takes effect now */
+	pthread_testcancel();
+    }
 }
 
 
 void mutex_destroy(const int semid)
 {
-    union semun arg;
-    semctl(semid, 0, IPC_RMID, arg);
+    pthread_mutex_t *mutex;
+
+    pthread_mutex_lock(&TableLock);
+    if (semid > 0 && semid < MUTEX_MAX && (mutex = Mutex[semid]) != NULL) {
+	Mutex[semid] = NULL;
+	pthread_mutex_destroy(mutex);
+	free(mutex);
+    }
+    pthread_mutex_unlock(&TableLock);
 }
 
 
@@ -140,16 +257,21 @@ int shm_create(void **buffer, const int size)
 {
     int shmid;
 
-    shmid = shmget(IPC_PRIVATE, size, SHM_R | SHM_W);
-    if (shmid == -1) {
-	error("fatal error: shmget() failed: %s", strerror(errno));
+    if ((*buffer = calloc(1, size)) == NULL) {
+	error("fatal error: shared memory allocation failed: %s", strerror(errno));
 	return -1;
     }
 
-    *buffer = shmat(shmid, NULL, 0);
-    if (*buffer == NULL) {
-	error("fatal error: shmat() failed: %s", strerror(errno));
-	return -1;
+    pthread_mutex_lock(&TableLock);
+    shmid = table_slot(Shm, SHM_MAX);
+    if (shmid >= 0)
+	Shm[shmid] = *buffer;
+    pthread_mutex_unlock(&TableLock);
+
+    if (shmid < 0) {
+	error("fatal error: shared memory allocation failed");
+	free(*buffer);
+	*buffer = NULL;
     }
 
     return shmid;
@@ -158,36 +280,295 @@ int shm_create(void **buffer, const int size)
 
 void shm_destroy(const int shmid, const void *buffer)
 {
-    shmdt(buffer);
-    shmctl(shmid, IPC_RMID, NULL);
+    pthread_mutex_lock(&TableLock);
+    if (shmid > 0 && shmid < SHM_MAX && Shm[shmid] == buffer) {
+	free(Shm[shmid]);
+	Shm[shmid] = NULL;
+    }
+    pthread_mutex_unlock(&TableLock);
+}
+
+
+/* start a thread with all signals blocked, so that signals are */
+/* delivered to the main loop */
+static int thread_start(pthread_t * thread, void *(*func) (void *), void *arg)
+{
+    sigset_t all, old;
+    int err;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(thread, NULL, func, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return err;
+}
+
+
+static void *thread_main(void *arg)
+{
+    THREAD *T = &Thread[(long) arg];
+
+#ifdef __linux__
+    char name[16];
+    snprintf(name, sizeof(name), "%s", T->name);
+    pthread_setname_np(pthread_self(), name);
+#endif
+
+    info("thread %s starting...", T->name);
+    T->func(T->data);
+    info("thread %s ended.", T->name);
+
+    return NULL;
 }
 
 
 int thread_create(const char *name, void (*thread) (void *data), void *data)
 {
-    pid_t pid;
+    int id, err;
+
+    for (id = 1; id < THREAD_MAX; id++) {
+	if (!Thread[id].active)
+	    break;
+    }
+    if (id == THREAD_MAX) {
+	error("fatal error: thread_create(%s) failed: too many threads", name);
+	return -1;
+    }
+
+    Thread[id].name = strdup(name);
+    Thread[id].func = thread;
+    Thread[id].data = data;
+    Thread[id].active = 1;
+
+    if ((err = thread_start(&Thread[id].thread, thread_main, (void *) (long) id)) != 0) {
+	error("fatal error: thread_create(%s) failed: %s", name, strerror(err));
+	free(Thread[id].name);
+	Thread[id].active = 0;
+	return -1;
+    }
+
+    info("created thread %d for %s", id, name);
+
+    return id;
+}
+
+
+int thread_destroy(const int id)
+{
+    int err;
+
+    if (id <= 0 || id >= THREAD_MAX || !Thread[id].active)
+	return -1;
+
+    pthread_cancel(Thread[id].thread);
+
+#ifdef __linux__
+    /* a thread stuck without a cancellation point is left behind */
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+    if ((err = pthread_timedjoin_np(Thread[id].thread, NULL, &deadline)) != 0) {
+	error("thread %s did not terminate: %s", Thread[id].name, strerror(err));
+	pthread_detach(Thread[id].thread);
+    }
+#else
+    if ((err = pthread_join(Thread[id].thread, NULL)) != 0) {
+	error("thread %s could not be joined: %s", Thread[id].name, strerror(err));
+	pthread_detach(Thread[id].thread);
+    }
+#endif
+
+    free(Thread[id].name);
+    Thread[id].name = NULL;
+    Thread[id].active = 0;
+
+    return err ? -1 : 0;
+}
+
+
+static void *pool_worker(void *arg)
+{
+    JOB job;
+
+    (void) arg;
+
+    pthread_mutex_lock(&PoolLock);
+    while (1) {
+	while (PoolCount == 0 && !PoolStop) {
+	    nPoolIdle++;
+	    pthread_cond_wait(&PoolCond, &PoolLock);
+	    nPoolIdle--;
+	}
+	/* on stop, the queue is drained first */
+	if (PoolCount == 0)
+	    break;
+	job = PoolQueue[PoolHead];
+	PoolHead = (PoolHead + 1) % POOL_QUEUE;
+	PoolCount--;
+	pthread_mutex_unlock(&PoolLock);
+
+	job.job(job.data);
+
+	pthread_mutex_lock(&PoolLock);
+    }
+    pthread_mutex_unlock(&PoolLock);
+
+    return NULL;
+}
+
+
+/* one worker per CPU and per reserved one, but at least POOL_MIN */
+static int pool_default(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < PoolReserved)
+	n = PoolReserved;
+    if (n < POOL_MIN)
+	n = POOL_MIN;
+    return n < POOL_MAX ? (int) n : POOL_MAX;
+}
+
 
-    switch (pid = fork()) {
-    case -1:
-	error("fatal error: fork(%s) failed: %s", name, strerror(errno));
+void thread_pool_reserve(const int n)
+{
+    pthread_mutex_lock(&PoolLock);
+    PoolReserved += n;
+    /* an explicit 'Thread.pool' wins */
+    if (PoolSize != 0 && !PoolFixed)
+	PoolSize = pool_default();
+    pthread_mutex_unlock(&PoolLock);
+}
+
+
+int thread_pool_submit(void (*job) (void *data), void *data)
+{
+    int err;
+
+    pthread_mutex_lock(&PoolLock);
+
+    if (PoolSize == 0)
+	PoolFixed = cfg_number("Thread", "pool", pool_default(), 1, POOL_MAX, &PoolSize) > 0;
+
+    if (PoolCount >= POOL_QUEUE) {
+	time_t now = time(NULL);
+	/* complain once a second at most */
+	PoolRefused++;
+	if (now != PoolFullTime) {
+	    PoolFullTime = now;
+	    error("thread pool: job queue full, %d jobs refused", PoolRefused);
+	    PoolRefused = 0;
+	}
+	pthread_mutex_unlock(&PoolLock);
 	return -1;
-    case 0:
-	info("thread %s starting...", name);
-	if (thread_argc > 0) {
-	    strncpy(thread_argv[0], name, strlen(thread_argv[0]));
+    }
+
+    PoolQueue[(PoolHead + PoolCount) % POOL_QUEUE].job = job;
+    PoolQueue[(PoolHead + PoolCount) % POOL_QUEUE].data = data;
+    PoolCount++;
+
+    /* workers are started on demand */
+    if (nPoolIdle < PoolCount && nPoolWorker < PoolSize) {
+	if ((err = thread_start(&PoolWorker[nPoolWorker], pool_worker, NULL)) == 0)
+	    nPoolWorker++;
+	else if (nPoolWorker == 0)
+	    error("thread pool: cannot create worker: %s", strerror(err));
+    }
+
+    pthread_cond_signal(&PoolCond);
+    pthread_mutex_unlock(&PoolLock);
+
+    return 0;
+}
+
+
+int thread_slot_create(THREAD_SLOT * slot, const int size)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	if ((slot->buffer[i] = calloc(1, size)) == NULL) {
+	    while (i-- > 0)
+		free(slot->buffer[i]);
+	    return -1;
 	}
-	thread(data);
-	info("thread %s ended.", name);
-	exit(0);
-    default:
-	info("forked process %d for thread %s", pid, name);
     }
+    slot->size = size;
+    slot->write = 0;
+    slot->latest = 1;
+    slot->read = 2;
+
+    return 0;
+}
+
+
+void thread_slot_destroy(THREAD_SLOT * slot)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	free(slot->buffer[i]);
+	slot->buffer[i] = NULL;
+    }
+}
+
 
-    return pid;
+void *thread_slot_buffer(THREAD_SLOT * slot)
+{
+    return slot->buffer[slot->write];
 }
 
 
-int thread_destroy(const int pid)
+void thread_slot_publish(THREAD_SLOT * slot)
 {
-    return kill(pid, SIGKILL);
+    /* swap the filled buffer with the latest one, which the */
+    /* producer may overwrite next, whether it has been read or not */
+    slot->write = __atomic_exchange_n(&slot->latest, slot->write | SLOT_FRESH, __ATOMIC_ACQ_REL) & ~SLOT_FRESH;
+}
+
+
+void *thread_slot_read(THREAD_SLOT * slot)
+{
+    /* take the latest buffer if something has been published since */
+    if (__atomic_load_n(&slot->latest, __ATOMIC_ACQUIRE) & SLOT_FRESH)
+	slot->read = __atomic_exchange_n(&slot->latest, slot->read, __ATOMIC_ACQ_REL) & ~SLOT_FRESH;
+
+    return slot->buffer[slot->read];
+}
+
+
+void thread_exit(void)
+{
+    int i;
+
+    /* cancel threads their owners did not destroy */
+    for (i = 1; i < THREAD_MAX; i++) {
+	if (Thread[i].active)
+	    thread_destroy(i);
+    }
+
+    /* let the workers finish all queued jobs and stop */
+    pthread_mutex_lock(&PoolLock);
+    PoolStop = 1;
+    pthread_cond_broadcast(&PoolCond);
+    pthread_mutex_unlock(&PoolLock);
+    for (i = 0; i < nPoolWorker; i++) {
+	pthread_join(PoolWorker[i], NULL);
+    }
+    nPoolWorker = 0;
+    PoolCount = 0;
+    PoolHead = 0;
+    PoolSize = 0;
+    PoolStop = 0;
+
+    for (i = 1; i < MUTEX_MAX; i++) {
+	if (Mutex[i] != NULL)
+	    mutex_destroy(i);
+    }
+
+    for (i = 0; i < SHM_MAX; i++) {
+	free(Shm[i]);
+	Shm[i] = NULL;
+    }
 }
@@ -30,25 +30,6 @@
 #ifndef _THREAD_H_
 #define _THREAD_H_
 
-#ifdef __CYGWIN__
-
-#ifndef HAVE_UNION_SEMUN
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
-#endif
-
-#ifndef SHM_R
-#define SHM_R 0400
-#endif
-#ifndef SHM_W
-#define SHM_W 0660
-#endif
-
-#endif
-
 extern int thread_argc;
 extern char **thread_argv;
 
@@ -61,6 +42,27 @@ int shm_create(void **buffer, const int size);
 void shm_destroy(const int shmid, const void *buffer);
 
 int thread_create(const char *name, void (*thread) (void *data), void *data);
-int thread_destroy(const int pid);
+int thread_destroy(const int id);
+
+int thread_pool_submit(void (*job) (void *data), void *data);
+void thread_pool_reserve(const int n);
+
+/* triple buffer: the producer fills one buffer while the consumer */
+/* reads another, the third one holds the latest published result */
+typedef struct {
+    void *buffer[3];
+    int size;
+    int write;			/* producer's buffer */
+    int read;			/* consumer's buffer */
+    int latest;			/* shared, accessed atomically only */
+} THREAD_SLOT;
+
+int thread_slot_create(THREAD_SLOT * slot, const int size);
+void thread_slot_destroy(THREAD_SLOT * slot);
+void *thread_slot_buffer(THREAD_SLOT * slot);
+void thread_slot_publish(THREAD_SLOT * slot);
+void *thread_slot_read(THREAD_SLOT * slot);
+
+void thread_exit(void);
 
 #endif
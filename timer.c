@@ -28,7 +28,8 @@
  * int timer_add(void (*callback) (void *data), void *data, const int
  *     interval, const int one_shot)
  *
- *   Create a new timer and add it to the timer queue.
+ *   Create a new timer and add it to the timer queue; returns a
+ *   handle which may be passed to timer_cancel().
  *
  *
  * int timer_add_late(void (*callback) (void *data), void *data, const
@@ -41,7 +42,20 @@
  *
  * int timer_process(struct timespec *delay)
  *
- *    Process timer queue.
+ *    Process timer queue; returns 1 if the main loop may sleep without
+ *    a timeout, because a timerfd wakes it up at the next deadline.
+ *
+ *
+ * int timer_cancel(const int handle)
+ *
+ *   Remove the timer with the given handle.
+ *
+ *
+ * int timer_set_slack(const int handle, const int slack)
+ *
+ *   Allow the timer with the given handle to be processed up to
+ *   'slack' milliseconds late ('Timer.slack' by default), so that
+ *   timers with nearby deadlines share a single wake-up.
  *
  *
  * int timer_remove(void (*callback) (void *data), void *data)
@@ -49,10 +63,44 @@
  *   Remove a new timer with given callback and data.
  *
  *
+ * int timer_set_name(const int handle, const char *name)
+ *
+ *   Name the timer with the given handle for timer_stats() and
+ *   timer_dump().
+ *
+ *
+ * TIMER_STATS *timer_stats(const char *name)
+ *
+ *   Return the lateness, run time and skipped intervals histograms
+ *   of the named timer, or of all timers if name is NULL or empty.
+ *
+ *
+ * double timer_percentile(const TIMER_HISTOGRAM *histogram, const
+ *     double percentile)
+ *
+ *   Estimate a percentile (0..100) of the values in a histogram.
+ *
+ *
+ * void timer_dump(void)
+ *
+ *   Log the statistics of all timers.
+ *
+ *
  * void timer_exit(void)
  *
  *   Release all timers and free the associated memory block.
  *
+ *
+ * All times are taken from the monotonic clock, which does not jump
+ * when the system time is set, so there is no clock skew to detect.
+ *
+ * The timer queue is a binary min-heap ordered by triggering time, so
+ * the next upcoming timer is always on top. Every timer knows its
+ * position in the heap, so it can be removed without searching.
+ * A second heap is ordered by triggering time plus slack, its top is
+ * the time the main loop has to wake up at. All timers which are due
+ * by then are processed together, which coalesces their wake-ups.
+ *
  */
 
 
@@ -61,20 +109,28 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 
 #include "debug.h"
 #include "cfg.h"
 #include "timer.h"
+#include "event.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
 #endif
 
-/* threshold in milliseconds that differentiates between clock skew
-   and clock jitter */
-#define CLOCK_SKEW_DETECT_TIME_IN_MS 1000
+/* a handle consists of the timer's slot in the lower bits and a serial
+   number in the upper bits, so a stale handle does not match a timer
+   which re-uses the slot */
+#define TIMER_SLOT_BITS 16
+#define TIMER_SLOT_MASK ((1 << TIMER_SLOT_BITS) - 1)
 
 /* structure for storing all relevant data of a single timer */
 typedef struct TIMER {
@@ -87,9 +143,9 @@ typedef struct TIMER {
        it will also be used to identify a specific timer */
     void *data;
 
-    /* struct to hold the time (in seconds and milliseconds since the
-       Epoch) when the timer will be processed for the next time */
-    struct timeval when;
+    /* time (in nanoseconds of the monotonic clock) when the timer will
+       be processed for the next time */
+    long long when;
 
     /* specifies the timer's triggering interval in milliseconds */
     int interval;
@@ -102,43 +158,205 @@ typedef struct TIMER {
        inactive (which means the timer has been deleted and its
        allocated memory may be re-used) */
     int active;
+
+    /* the handle returned by timer_add() */
+    int handle;
+
+    /* the timer may be processed up to 'slack' nanoseconds late, so
+       it can share a wake-up with other timers */
+    long long slack;
+
+    /* positions in the heaps, or -1 while the timer is not queued
+       (i.e. while its callback is running) */
+    int heap[2];
+
+    /* next inactive timer slot */
+    int next;
+
+    /* name for the statistics, may be empty */
+    char name[32];
+
+    /* dispatch statistics */
+    TIMER_STATS stats;
 } TIMER;
 
 /* number of allocated timer slots */
-int nTimers = 0;
+static int nTimers = 0;
 
 /* pointer to memory allocated for storing the timer slots */
-TIMER *Timers = NULL;
+static TIMER *Timers = NULL;
+
+/* first inactive timer slot, or -1 */
+static int FreeTimer = -1;
+
+/* serial number of the next handle */
+static int Serial = 0;
 
+/* heaps of active timer slots, the next upcoming timer comes first;
+   one heap is ordered by the triggering time, the other by the
+   triggering time plus slack */
+#define HEAP_WHEN 0
+#define HEAP_LATEST 1
+static int nHeap = 0;
+static int *Heap[2] = { NULL, NULL };
+
+/* default slack in milliseconds ('Timer.slack') */
+static int Slack = 0;
+
+/* default slack has been read from the config */
+static int SlackInit = 0;
+
+/* timerfd the main loop sleeps on, -1 if not used (yet) */
+static int TimerFd = -1;
+
+/* time the timerfd has been armed for */
+static long long Armed = 0;
+
+/* timerfd has been set up (or failed to) */
+static int TimerFdInit = 0;
+
+/* dispatch statistics of all timers, including removed ones */
+static TIMER_STATS Total;
+
+
+static long long timer_now(void)
+/*  Return the current time of the monotonic clock in nanoseconds, which
+    does not jump if the system time is set.
+ */
+{
+    struct timespec now;
 
-static void timer_inc(const int timer, struct timeval *now)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+static long long timer_key(const int h, const int timer)
+/*  Return the time a timer is ordered by in heap h.
+ */
+{
+    return h == HEAP_LATEST ? Timers[timer].when + Timers[timer].slack : Timers[timer].when;
+}
+
+
+static void timer_place(const int h, const int timer, const int pos)
+/*  Put a timer into a heap position, and remember the position.
+ */
+{
+    Heap[h][pos] = timer;
+    Timers[timer].heap[h] = pos;
+}
+
+
+static void timer_sift_up(const int h, int pos)
+/*  Move a heap entry towards the top until its parent is due before.
+ */
+{
+    int timer = Heap[h][pos];
+
+    while (pos > 0 && timer_key(h, timer) < timer_key(h, Heap[h][(pos - 1) / 2])) {
+	timer_place(h, Heap[h][(pos - 1) / 2], pos);
+	pos = (pos - 1) / 2;
+    }
+    timer_place(h, timer, pos);
+}
+
+
+static void timer_sift_down(const int h, int pos)
+/*  Move a heap entry towards the bottom until its children are due
+    after.
+ */
+{
+    int timer = Heap[h][pos];
+    int child;
+
+    while ((child = 2 * pos + 1) < nHeap) {
+	if (child + 1 < nHeap && timer_key(h, Heap[h][child + 1]) < timer_key(h, Heap[h][child]))
+	    child++;
+	if (timer_key(h, Heap[h][child]) >= timer_key(h, timer))
+	    break;
+	timer_place(h, Heap[h][child], pos);
+	pos = child;
+    }
+    timer_place(h, timer, pos);
+}
+
+
+static void timer_queue(const int timer)
+/*  Add a timer to the heaps. The heaps never hold more entries than
+    there are timer slots, so they have been allocated along with them.
+ */
+{
+    int h;
+
+    for (h = HEAP_WHEN; h <= HEAP_LATEST; h++) {
+	timer_place(h, timer, nHeap);
+	timer_sift_up(h, nHeap);
+    }
+    nHeap++;
+}
+
+
+static void timer_dequeue(const int timer)
+/*  Remove a timer from the heaps by moving the last heap entry into its
+    position.
+ */
+{
+    int h, pos;
+
+    if (Timers[timer].heap[HEAP_WHEN] < 0)
+	return;
+
+    nHeap--;
+    for (h = HEAP_WHEN; h <= HEAP_LATEST; h++) {
+	pos = Timers[timer].heap[h];
+	Timers[timer].heap[h] = -1;
+	if (pos == nHeap)
+	    continue;
+	timer_place(h, Heap[h][nHeap], pos);
+	if (pos > 0 && timer_key(h, Heap[h][pos]) < timer_key(h, Heap[h][(pos - 1) / 2]))
+	    timer_sift_up(h, pos);
+	else
+	    timer_sift_down(h, pos);
+    }
+}
+
+
+static void timer_free(const int timer)
+/*  Mark a timer slot inactive and put it on the list of free slots.
+ */
+{
+    timer_dequeue(timer);
+    Timers[timer].active = TIMER_INACTIVE;
+    Timers[timer].next = FreeTimer;
+    FreeTimer = timer;
+}
+
+
+static long long timer_inc(const int timer, const long long now)
 /*  Update the time a given timer updates next.
 
     timer (integer): internal ID of timer that is to be updated
 
-	now (timeval pointer): struct holding the "current" time
+	now (long long): the "current" time in nanoseconds
 
-	return value: void
+	return value (long long): the number of skipped intervals
  */
 {
-    /* calculate the time difference between the last time the given
-       timer has been processed and the current time */
-    struct timeval diff;
-    timersub(now, &Timers[timer].when, &diff);
-
-    /* convert this time difference to fractional milliseconds */
-    float time_difference = (diff.tv_sec * 1000.0f) + (diff.tv_usec / 1000.0f);
+    /* a timer with an interval of zero would never leave the queue */
+    long long interval = (Timers[timer].interval > 0 ? Timers[timer].interval : 1) * 1000000LL;
 
     /* calculate the number of timer intervals that have passed since
        the last timer the given timer has been processed -- value is
        truncated (rounded down) to an integer */
-    int number_of_intervals = (int) (time_difference / Timers[timer].interval);
+    long long number_of_intervals = now > Timers[timer].when ? (now - Timers[timer].when) / interval : 0;
 
     /* notify the user in case one or more timer intervals have been
-       missed */
+       missed; the monotonic clock does not jump, so this really means
+       that the timer has been late */
     if (number_of_intervals > 0)
-	info("Timer #%d skipped %d interval(s) or %d ms.", timer, number_of_intervals,
-	     number_of_intervals * Timers[timer].interval);
+	info("Timer #%d skipped %lld interval(s) or %lld ms.", timer, number_of_intervals,
+	     number_of_intervals * interval / 1000000);
 
     /* increment the number of passed intervals in order to skip all
        missed intervals -- thereby avoiding that unprocessed timers
@@ -146,19 +364,101 @@ static void timer_inc(const int timer, struct timeval *now)
        railway companies might learn a lesson from us <g>) */
     number_of_intervals++;
 
-    /* calculate time difference between the last time the timer has
-       been processed and the next time it will be processed */
-    int interval = Timers[timer].interval * number_of_intervals;
+    /* finally, add the intervals to the timer's trigger; adding to the
+       last trigger (rather than to the current time) keeps the timer
+       from drifting */
+    Timers[timer].when += interval * number_of_intervals;
+
+    return number_of_intervals - 1;
+}
+
+
+static void timer_record(TIMER_HISTOGRAM * histogram, const unsigned long long value)
+/*  Add a value to a histogram.
+ */
+{
+    int b = 0;
+
+    while (b < TIMER_BUCKETS - 1 && value >> b)
+	b++;
+
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max)
+	histogram->max = value;
+    histogram->bucket[b]++;
+}
+
+
+static void timer_slack(const int timer, const int slack)
+/*  Set the slack of a timer. A timer must not be late by a whole
+    interval, so the slack is limited to half of the interval.
+ */
+{
+    int limit = Timers[timer].interval / 2;
+
+    Timers[timer].slack = (slack < limit ? slack : limit) * 1000000LL;
+}
+
+
+int timer_set_slack(const int handle, const int slack)
+/*  Set the slack of the timer with the given handle.
+
+	handle (integer): the handle returned by timer_add() or
+	timer_add_late()
+
+	slack (integer): the timer may be processed up to this many
+	milliseconds late, so it shares a wake-up with other timers;
+	a negative value selects the default 'Timer.slack'
+
+	return value (integer): returns a value of 0 on success;
+	otherwise returns a value of -1
+*/
+{
+    int timer = handle & TIMER_SLOT_MASK;
+
+    if (handle < 0 || timer >= nTimers)
+	return -1;
+
+    if (Timers[timer].active == TIMER_INACTIVE || Timers[timer].handle != handle)
+	return -1;
+
+    /* re-queue the timer, unless its callback is running */
+    if (Timers[timer].heap[HEAP_WHEN] >= 0) {
+	timer_dequeue(timer);
+	timer_slack(timer, slack < 0 ? Slack : slack);
+	timer_queue(timer);
+    } else {
+	timer_slack(timer, slack < 0 ? Slack : slack);
+    }
+
+    return 0;
+}
+
+
+int timer_cancel(const int handle)
+/*  Remove the timer with the given handle.
+
+	handle (integer): the handle returned by timer_add() or
+	timer_add_late()
+
+	return value (integer): returns a value of 0 on successful timer
+	removal; otherwise (e.g. if a one-shot timer has already been
+	processed) returns a value of -1
+*/
+{
+    int timer = handle & TIMER_SLOT_MASK;
+
+    if (handle < 0 || timer >= nTimers)
+	return -1;
 
-    /* convert time difference (in milliseconds) to a "timeval"
-       struct (in seconds and microseconds) */
-    struct timeval tv_interval = {
-	.tv_sec = interval / 1000,
-	.tv_usec = (interval % 1000) * 1000
-    };
+    if (Timers[timer].active == TIMER_INACTIVE || Timers[timer].handle != handle)
+	return -1;
 
-    /* finally, add time difference to the timer's trigger */
-    timeradd(&Timers[timer].when, &tv_interval, &Timers[timer].when);
+    timer_free(timer);
+
+    /* signal successful timer removal */
+    return 0;
 }
 
 
@@ -178,7 +478,8 @@ int timer_remove(void (*callback) (void *data), void *data)
     int timer;			/* current timer's ID */
 
     /* loop through the timer slots and try to find the specified
-       timer slot by looking for its settings */
+       timer slot by looking for its settings; timer_cancel() does
+       not need to search */
     for (timer = 0; timer < nTimers; timer++) {
 	/* skip inactive (i.e. deleted) timers */
 	if (Timers[timer].active == TIMER_INACTIVE)
@@ -188,7 +489,7 @@ int timer_remove(void (*callback) (void *data), void *data)
 	    /* we have found the timer slot, so mark it as being inactive;
 	       we will not actually delete the slot, so its allocated
 	       memory may be re-used */
-	    Timers[timer].active = TIMER_INACTIVE;
+	    timer_free(timer);
 
 	    /* signal successful timer removal */
 	    return 0;
@@ -201,76 +502,120 @@ int timer_remove(void (*callback) (void *data), void *data)
 }
 
 
-int timer_add(void (*callback) (void *data), void *data, const int interval, const int one_shot)
-/*  Create a new timer and add it to the timer queue.
-
-    callback (void pointer): function of type void func(void *data)
-	which will be called whenever the timer triggers; this pointer
-	will also be used to identify a specific timer
-
-	data (void pointer): data which will be passed to the callback
-	function; this pointer will also be used to identify a specific
-	timer
-
-	interval (integer): specifies the timer's triggering interval in
-	milliseconds
-
-	one_shot (integer): specifies whether the timer should trigger
-	indefinitely until it is deleted (value of 0) or only once (all
-	other values)
+static int timer_new(void (*callback) (void *data), void *data, const int interval, const int one_shot)
+/*  Create a new timer which triggers immediately, but do not queue it
+	yet.
 
-	return value (integer): returns a value of 0 on successful timer
-	creation; otherwise returns a value of -1
+	return value (integer): returns the new timer's ID; otherwise
+	returns a value of -1
 */
 {
     int timer;			/* current timer's ID */
-    struct timeval now;		/* struct to hold current time */
 
-    /* try to minimize memory usage by looping through the timer slots
-       and looking for an inactive timer */
-    for (timer = 0; timer < nTimers; timer++) {
-	if (Timers[timer].active == TIMER_INACTIVE) {
-	    /* we've just found one, so let's reuse it ("timer" holds its
-	       ID) by breaking the loop */
-	    break;
-	}
+    /* the config has been read before the first timer is added */
+    if (!SlackInit) {
+	SlackInit = 1;
+	cfg_number("Timer", "slack", 0, 0, -1, &Slack);
     }
 
+    /* try to minimize memory usage by re-using an inactive timer */
+    timer = FreeTimer;
+
     /* no inactive timers (or none at all) found, so we have to add a
        new timer slot */
-    if (timer == nTimers) {
+    if (timer < 0) {
 	TIMER *tmp;
+	int h, *heap;
+
+	if (nTimers > TIMER_SLOT_MASK) {
+	    error("Too many timers!");
+	    return -1;
+	}
 
 	if ((tmp = realloc(Timers, (nTimers + 1) * sizeof(*Timers))) == NULL) {
 	    /* signal unsuccessful timer creation */
 	    return -1;
 	}
 	Timers = tmp;
-	nTimers++;
-    }
 
-    /* get current time so the timer triggers immediately */
-    gettimeofday(&now, NULL);
+	for (h = HEAP_WHEN; h <= HEAP_LATEST; h++) {
+	    if ((heap = realloc(Heap[h], (nTimers + 1) * sizeof(int))) == NULL) {
+		/* signal unsuccessful timer creation */
+		return -1;
+	    }
+	    Heap[h] = heap;
+	}
+
+	timer = nTimers++;
+    } else {
+	FreeTimer = Timers[timer].next;
+    }
 
-    /* initialize timer data */
+    /* initialize timer data; use the current time so the timer
+       triggers immediately */
     Timers[timer].callback = callback;
     Timers[timer].data = data;
-    Timers[timer].when = now;
+    Timers[timer].when = timer_now();
     Timers[timer].interval = interval;
     Timers[timer].one_shot = one_shot;
+    Timers[timer].heap[HEAP_WHEN] = -1;
+    Timers[timer].heap[HEAP_LATEST] = -1;
+    Timers[timer].next = -1;
+    Timers[timer].name[0] = '\0';
+    memset(&Timers[timer].stats, 0, sizeof(TIMER_STATS));
+    timer_slack(timer, Slack);
+
+    /* hand out a new handle for the slot */
+    Serial = (Serial + 1) & (TIMER_SLOT_MASK >> 1);
+    Timers[timer].handle = (Serial << TIMER_SLOT_BITS) | timer;
 
     /* set timer to active so that it is processed and not overwritten
        by the memory optimization routine above */
     Timers[timer].active = TIMER_ACTIVE;
 
+    return timer;
+}
+
+
+int timer_add(void (*callback) (void *data), void *data, const int interval, const int one_shot)
+/*  Create a new timer and add it to the timer queue.
+
+    callback (void pointer): function of type void func(void *data)
+	which will be called whenever the timer triggers; this pointer
+	will also be used to identify a specific timer
+
+	data (void pointer): data which will be passed to the callback
+	function; this pointer will also be used to identify a specific
+	timer
+
+	interval (integer): specifies the timer's triggering interval in
+	milliseconds
+
+	one_shot (integer): specifies whether the timer should trigger
+	indefinitely until it is deleted (value of 0) or only once (all
+	other values)
+
+	return value (integer): returns a handle (a value of 0 or more)
+	on successful timer creation; otherwise returns a value of -1
+*/
+{
+    int timer;			/* current timer's ID */
+
+    if ((timer = timer_new(callback, data, interval, one_shot)) < 0) {
+	/* signal unsuccessful timer creation */
+	return -1;
+    }
+
     /* one-shot timers should NOT fire immediately, so delay them by a
        single timer interval */
     if (one_shot) {
-	timer_inc(timer, &now);
+	timer_inc(timer, Timers[timer].when);
     }
 
+    timer_queue(timer);
+
     /* signal successful timer creation */
-    return 0;
+    return Timers[timer].handle;
 }
 
 
@@ -294,41 +639,101 @@ int timer_add_late(void (*callback) (void *data), void *data, const int interval
 	indefinitely until it is deleted (value of 0) or only once (all
 	other values)
 
-	return value (integer): returns a value of 0 on successful timer
-	creation; otherwise returns a value of -1
+	return value (integer): returns a handle (a value of 0 or more)
+	on successful timer creation; otherwise returns a value of -1
 */
 {
-    /* create new timer slot and add it to the timer queue; mask it as
-       one-shot timer for now, so the timer will be delayed by a
-       single timer interval */
-    if (!timer_add(callback, data, interval, 1)) {
+    int timer;			/* current timer's ID */
+
+    if ((timer = timer_new(callback, data, interval, one_shot)) < 0) {
 	/* signal unsuccessful timer creation */
 	return -1;
     }
 
-    int timer;			/* current timer's ID */
+    /* delay the timer by a single timer interval */
+    timer_inc(timer, Timers[timer].when);
 
-    /* loop through the timer slots and try to find the new timer slot
-       by looking for its settings */
-    for (timer = 0; timer < nTimers; timer++) {
-	/* skip inactive (i.e. deleted) timers */
-	if (Timers[timer].active == TIMER_INACTIVE)
-	    continue;
+    timer_queue(timer);
 
-	if (Timers[timer].callback == callback && Timers[timer].data == data && Timers[timer].interval == interval) {
-	    /* we have found the new timer slot, so unmask it by setting
-	       its "one_shot" variable to the REAL value; then signal
-	       successful timer creation */
-	    Timers[timer].one_shot = one_shot;
+    /* signal successful timer creation */
+    return Timers[timer].handle;
+}
 
-	    /* signal successful timer creation */
-	    return 0;
-	}
+
+static void timer_fd_read(event_flags_t flags, void *data)
+/*  Event callback of the timerfd; just consume the expiration, the
+    timers are processed by timer_process() in the main loop.
+ */
+{
+    unsigned long long expirations;
+
+    (void) flags;
+    (void) data;
+
+    /* the deadline has passed, so the timerfd has to be re-armed even
+       for the same deadline */
+    Armed = 0;
+
+    if (read(TimerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+	error("timer: read(timerfd) failed: %s", strerror(errno));
+}
+
+
+static void timer_fd_init(void)
+/*  Set up the timerfd, unless disabled by 'Timer.timerfd 0'.
+ */
+{
+    int enable;
+
+    TimerFdInit = 1;
+
+    cfg_number("Timer", "timerfd", 1, 0, 1, &enable);
+    if (!enable)
+	return;
+
+#ifdef __linux__
+    TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (TimerFd < 0) {
+	info("timer: timerfd_create() failed: %s, using poll timeouts", strerror(errno));
+	return;
     }
+    event_add(timer_fd_read, NULL, TimerFd, 1, 0, 1);
+#endif
+}
 
-    /* we have NOT found the new timer slot for some reason, so signal
-       failure by returning a value of -1 */
-    return -1;
+
+static int timer_fd_arm(const long long when)
+/*  Arm the timerfd for an absolute deadline on the monotonic clock.
+
+	return value (integer): returns a value of 1 if the timerfd has
+	been armed; otherwise returns a value of 0
+*/
+{
+#ifdef __linux__
+    struct itimerspec deadline;
+
+    if (TimerFd < 0)
+	return 0;
+
+    /* the timerfd is still armed for the same deadline */
+    if (when == Armed)
+	return 1;
+
+    memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value.tv_sec = when / 1000000000LL;
+    deadline.it_value.tv_nsec = when % 1000000000LL;
+
+    if (timerfd_settime(TimerFd, TFD_TIMER_ABSTIME, &deadline, NULL) < 0) {
+	error("timer: timerfd_settime() failed: %s", strerror(errno));
+	return 0;
+    }
+
+    Armed = when;
+    return 1;
+#else
+    (void) when;
+    return 0;
+#endif
 }
 
 
@@ -338,18 +743,25 @@ int timer_process(struct timespec *delay)
 	delay (timespec pointer): struct holding delay till the next
 	upcoming timer event
 
-	return value (integer): returns a value of 0 when timers have been
+	return value (integer): returns a value of 1 if the timerfd has
+	been armed for the next upcoming timer event, so there is no need
+	for a timeout; returns a value of 0 when timers have been
 	processed successfully; otherwise returns a value of -1
 */
 {
-    struct timeval now;		/* struct to hold current time */
+    long long now;		/* current time */
+    long long clock;		/* time the next callback starts at */
+
+    if (!TimerFdInit)
+	timer_fd_init();
 
     /* get current time to check which timers need processing */
-    gettimeofday(&now, NULL);
+    now = timer_now();
+    clock = now;
 
     /* sanity check; by now, at least one timer should be
        instantiated */
-    if (nTimers <= 0) {
+    if (nHeap <= 0) {
 	/* otherwise, print an error and return a value of -1 to
 	   signal an error */
 	error("Huh? Not even a single timer to process? Dazed and confused...");
@@ -358,133 +770,209 @@ int timer_process(struct timespec *delay)
 
     int timer;			/* current timer's ID */
 
-    /* process all expired timers */
-    for (timer = 0; timer < nTimers; timer++) {
-	/* skip inactive (i.e. deleted) timers */
-	if (Timers[timer].active == TIMER_INACTIVE)
-	    continue;
+    /* process all expired timers, i.e. the timer's triggering time is
+       less than or equal to the current time */
+    while (nHeap > 0 && Timers[Heap[HEAP_WHEN][0]].when <= now) {
+	timer = Heap[HEAP_WHEN][0];
 
-	/* check whether current timer needs to be processed, i.e. the
-	   timer's triggering time is less than or equal to the current
-	   time; according to the man page of timercmp(), this avoids
-	   using the operators ">=", "<=" and "==" which might be broken
-	   on some systems */
-	if (!timercmp(&Timers[timer].when, &now, >)) {
-	    /* if the timer's callback function has been set, call it and
-	       pass the corresponding data */
-	    if (Timers[timer].callback != NULL) {
-		Timers[timer].callback(Timers[timer].data);
-	    }
+	/* take the timer off the queue while its callback is running,
+	   the callback may add and remove timers */
+	timer_dequeue(timer);
 
-	    /* check for one-shot timers */
-	    if (Timers[timer].one_shot) {
-		/* mark one-shot timer as inactive (which means the timer has
-		   been deleted and its allocated memory may be re-used) */
-		Timers[timer].active = TIMER_INACTIVE;
-	    } else {
-		/* otherwise, re-spawn timer by adding one triggering interval
-		   to its triggering time */
-		timer_inc(timer, &now);
-	    }
-	}
-    }
+	void (*callback) (void *data) = Timers[timer].callback;
+	void *data = Timers[timer].data;
+	int handle = Timers[timer].handle;
+	unsigned long long late = (clock - Timers[timer].when) / 1000;
 
-    int next_timer = -1;	/* ID of the next upcoming timer */
+	timer_record(&Timers[timer].stats.late, late);
+	timer_record(&Total.late, late);
 
-    /* loop through the timer slots and try to find the next upcoming
-       timer */
-    for (timer = 0; timer < nTimers; timer++) {
-	/* skip inactive (i.e. deleted) timers */
-	if (Timers[timer].active == TIMER_INACTIVE)
-	    continue;
+	/* one-shot timers are deleted before their callback is called,
+	   which may re-add them */
+	if (Timers[timer].one_shot)
+	    timer_free(timer);
 
-	/* if this is the first timer that we check, mark it as the next
-	   upcoming timer; otherwise, we'll have nothing to compare
-	   against in this loop */
-	if (next_timer < 0)
-	    next_timer = timer;
-	/* check whether current timer needs processing prior to the one
-	   selected */
-	else if (timercmp(&Timers[timer].when, &Timers[next_timer].when, <)) {
-	    /* if so, mark it as the next upcoming timer */
-	    next_timer = timer;
+	/* if the timer's callback function has been set, call it and
+	   pass the corresponding data */
+	if (callback != NULL) {
+	    callback(data);
+	}
+
+	long long end = timer_now();
+	int alive = Timers[timer].active == TIMER_ACTIVE && Timers[timer].handle == handle;
+
+	timer_record(&Total.run, (end - clock) / 1000);
+	if (alive)
+	    timer_record(&Timers[timer].stats.run, (end - clock) / 1000);
+	clock = end;
+
+	/* re-spawn a periodic timer by adding one triggering interval to
+	   its triggering time, unless the callback removed it */
+	if (alive && Timers[timer].heap[HEAP_WHEN] < 0) {
+	    long long skipped = timer_inc(timer, now);
+	    timer_record(&Timers[timer].stats.skip, skipped);
+	    timer_record(&Total.skip, skipped);
+	    timer_queue(timer);
 	}
     }
 
-    /* sanity check; we should by now have found the next upcoming
-       timer */
-    if (next_timer < 0) {
+    /* sanity check; we should by now have the next upcoming timer on
+       top of the heap */
+    if (nHeap <= 0) {
 	/* otherwise, print an error and return a value of -1 to signal an
 	   error */
 	error("Huh? Not even a single timer left? Dazed and confused...");
 	return -1;
     }
 
+    /* the next wake-up is the earliest time a timer must be processed
+       at; all timers which are due by then will be processed together */
+    long long next = timer_key(HEAP_LATEST, Heap[HEAP_LATEST][0]);
+
+    /* let the kernel wake us up at the deadline */
+    if (timer_fd_arm(next))
+	return 1;
+
     /* processing all the timers might have taken a while, so update
        the current time to compensate for processing delay */
-    gettimeofday(&now, NULL);
-
-    struct timeval diff;	/* struct holding the time difference
-				   between current time and the triggering time of the
-				   next upcoming timer event */
-
-    /* calculate delay to the next upcoming timer event and store it
-       in "diff" */
-    timersub(&Timers[next_timer].when, &now, &diff);
-
-    /* a negative delay has occurred (positive clock skew or some
-       timers are faster than the time needed for processing their
-       callbacks) */
-    if (diff.tv_sec < 0 || diff.tv_usec < 0) {
-	/* zero "diff" so the next update is triggered immediately */
-	timerclear(&diff);
-    } else {
-	/* convert "diff" to milliseconds */
-	int time_difference = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-
-	/* if there is a notable difference between "time_difference" and
-	   the next upcoming timer's interval, assume clock skew */
-	if (time_difference > (Timers[next_timer].interval + CLOCK_SKEW_DETECT_TIME_IN_MS)) {
-	    /* extract clock skew from "time_difference" by eliminating
-	       the timer's triggering interval */
-	    int skew = time_difference - Timers[next_timer].interval;
-
-	    /* display an info message to inform the user */
-	    info("Oops, clock skewed by %d ms, updating timestamps...", skew);
-
-	    /* convert clock skew from milliseconds to "timeval"
-	       structure */
-	    struct timeval clock_skew = {
-		.tv_sec = skew / 1000,
-		.tv_usec = (skew % 1000) * 1000
-	    };
-
-	    /* process all timers */
-	    for (timer = 0; timer < nTimers; timer++) {
-		/* skip inactive (i.e. deleted) timers */
-		if (Timers[timer].active == TIMER_INACTIVE)
-		    continue;
-
-		/* correct timer's time stamp by clock skew */
-		timersub(&Timers[timer].when, &clock_skew, &Timers[timer].when);
-	    }
+    now = timer_now();
 
-	    /* finally, zero "diff" so the next update is triggered
-	       immediately */
-	    timerclear(&diff);
-	}
-    }
+    /* the next timer event may be due already; in that case, trigger
+       the next update immediately */
+    long long diff = next > now ? next - now : 0;
 
-    /* set timespec "delay" passed by calling function to "diff" */
-    delay->tv_sec = diff.tv_sec;
-    /* timespec uses nanoseconds instead of microseconds!!! */
-    delay->tv_nsec = diff.tv_usec * 1000;
+    /* set timespec "delay" passed by calling function */
+    delay->tv_sec = diff / 1000000000LL;
+    delay->tv_nsec = diff % 1000000000LL;
 
     /* signal successful timer processing */
     return 0;
 }
 
 
+int timer_set_name(const int handle, const char *name)
+/*  Name a timer, so its statistics can be found by timer_stats().
+
+	handle (integer): the handle returned by timer_add()
+
+	name (string): the timer's name
+
+	return value (integer): returns a value of 0 on success;
+	otherwise returns a value of -1
+*/
+{
+    int timer = handle & TIMER_SLOT_MASK;
+
+    if (handle < 0 || timer >= nTimers || Timers[timer].active != TIMER_ACTIVE || Timers[timer].handle != handle)
+	return -1;
+
+    snprintf(Timers[timer].name, sizeof(Timers[timer].name), "%s", name);
+    return 0;
+}
+
+
+TIMER_STATS *timer_stats(const char *name)
+/*  Return the dispatch statistics of a timer.
+
+	name (string): the name given by timer_set_name(); if NULL or
+	empty, the statistics of all timers (including removed ones) are
+	returned
+
+	return value (pointer): returns the statistics, or NULL if there
+	is no active timer of that name
+*/
+{
+    int timer;
+
+    if (name == NULL || *name == '\0')
+	return &Total;
+
+    for (timer = 0; timer < nTimers; timer++) {
+	if (Timers[timer].active == TIMER_ACTIVE && strcmp(Timers[timer].name, name) == 0)
+	    return &Timers[timer].stats;
+    }
+
+    return NULL;
+}
+
+
+double timer_percentile(const TIMER_HISTOGRAM * histogram, const double percentile)
+/*  Estimate a percentile of the values in a histogram by linear
+	interpolation within the bucket it falls into.
+
+	histogram (pointer): the histogram
+
+	percentile (double): the percentile from 0 to 100; 100 returns
+	the exact maximum
+
+	return value (double): returns the estimated value, or 0.0 for
+	an empty histogram
+*/
+{
+    double rank, lo, hi, value;
+    unsigned long below = 0;
+    int b;
+
+    if (histogram->count == 0)
+	return 0.0;
+
+    if (percentile >= 100.0)
+	return histogram->max;
+
+    rank = (percentile > 0.0 ? percentile : 0.0) / 100.0 * histogram->count;
+
+    for (b = 0; b < TIMER_BUCKETS - 1; b++) {
+	if (below + histogram->bucket[b] > rank)
+	    break;
+	below += histogram->bucket[b];
+    }
+
+    lo = b ? (double) (1ULL << (b - 1)) : 0.0;
+    hi = b < TIMER_BUCKETS - 1 ? (double) (1ULL << b) : (double) histogram->max;
+    value = histogram->bucket[b] ? lo + (hi - lo) * (rank - below) / histogram->bucket[b] : lo;
+
+    return value < histogram->max ? value : histogram->max;
+}
+
+
+static void timer_dump_stats(const char *name, const int interval, const TIMER_STATS * stats)
+{
+    const TIMER_HISTOGRAM *late = &stats->late;
+    const TIMER_HISTOGRAM *run = &stats->run;
+
+    info("%-20s %8d %10lu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %8llu", name, interval, late->count,
+	 timer_percentile(late, 50) / 1000, timer_percentile(late, 99) / 1000, late->max / 1000.0,
+	 timer_percentile(run, 50) / 1000, timer_percentile(run, 99) / 1000, run->max / 1000.0, stats->skip.sum);
+}
+
+
+void timer_dump(void)
+/*  Log lateness, run time (both in milliseconds) and skipped
+	intervals of all timers, e.g. on SIGUSR1.
+
+	return value: void
+*/
+{
+    char name[32];
+    int timer;
+
+    info("%-20s %8s %10s %9s %9s %9s %9s %9s %9s %8s", "timer", "interval", "calls", "late p50", "late p99",
+	 "late max", "run p50", "run p99", "run max", "skipped");
+
+    for (timer = 0; timer < nTimers; timer++) {
+	if (Timers[timer].active != TIMER_ACTIVE)
+	    continue;
+	if (Timers[timer].name[0] != '\0')
+	    snprintf(name, sizeof(name), "%s", Timers[timer].name);
+	else
+	    snprintf(name, sizeof(name), "#%d", timer);
+	timer_dump_stats(name, Timers[timer].interval, &Timers[timer].stats);
+    }
+
+    timer_dump_stats("all", 0, &Total);
+}
+
+
 void timer_exit(void)
 /*  Release all timers and free the associated memory block.
 
@@ -493,10 +981,29 @@ void timer_exit(void)
 {
     /* reset number of allocated timer slots */
     nTimers = 0;
+    nHeap = 0;
+    FreeTimer = -1;
+
+    /* remove the timerfd from the events and close it */
+    if (TimerFd >= 0) {
+	event_del(TimerFd);
+	close(TimerFd);
+	TimerFd = -1;
+    }
+    Armed = 0;
+    TimerFdInit = 0;
+    SlackInit = 0;
+    memset(&Total, 0, sizeof(Total));
 
     /* free memory used for storing the timer slots */
     if (Timers != NULL) {
 	free(Timers);
 	Timers = NULL;
     }
+
+    /* free memory used for the heaps */
+    free(Heap[HEAP_WHEN]);
+    free(Heap[HEAP_LATEST]);
+    Heap[HEAP_WHEN] = NULL;
+    Heap[HEAP_LATEST] = NULL;
 }
@@ -33,14 +33,43 @@
 
 #include <time.h>
 
+/* log2 histogram: bucket 0 counts values below 1, bucket b counts */
+/* values from 2^(b-1) up to 2^b, the last bucket everything above */
+#define TIMER_BUCKETS 32
+
+typedef struct {
+    unsigned long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long bucket[TIMER_BUCKETS];
+} TIMER_HISTOGRAM;
+
+typedef struct {
+    TIMER_HISTOGRAM late;	/* dispatch lateness in usec */
+    TIMER_HISTOGRAM run;	/* callback run time in usec */
+    TIMER_HISTOGRAM skip;	/* skipped intervals per dispatch */
+} TIMER_STATS;
+
 int timer_add(void (*callback) (void *data), void *data, const int interval, const int one_shot);
 
 int timer_add_late(void (*callback) (void *data), void *data, const int interval, const int one_shot);
 
 int timer_process(struct timespec *delay);
 
+int timer_cancel(const int handle);
+
+int timer_set_slack(const int handle, const int slack);
+
 int timer_remove(void (*callback) (void *data), void *data);
 
+int timer_set_name(const int handle, const char *name);
+
+TIMER_STATS *timer_stats(const char *name);
+
+double timer_percentile(const TIMER_HISTOGRAM * histogram, const double percentile);
+
+void timer_dump(void);
+
 void timer_exit(void);
 
 #endif
@@ -32,8 +32,9 @@
  *
  * void timer_process_group(void *data)
  *
- *  Process all widgets of a timer group; if the timer group only
- *  contains one-shot timers, it will be deleted after processing.
+ *  Process all widgets of a timer group as one batch, so that the
+ *  display is updated only once; if the timer group only contains
+ *  one-shot timers, it will be deleted after processing.
  *
  *
  * void timer_exit_group(void)
@@ -43,10 +44,12 @@
  *
  *
  * int timer_add_widget(void (*callback) (void *data), void *data,
- *     const int interval, const int one_shot)
+ *     const int interval, const int one_shot, const int slack)
  *
  *   Add widget to timer group of the specified update interval
- *   (also creates a new timer group if necessary).
+ *   (also creates a new timer group if necessary); the group's timer
+ *   uses the smallest slack of its widgets, which is recomputed when
+ *   a widget is removed.
  *
  *
  * int timer_remove_widget(void (*callback) (void *data), void *data)
@@ -57,41 +60,27 @@
  */
 
 
+
+
 #include "config.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "debug.h"
 #include "cfg.h"
 #include "timer.h"
 #include "timer_group.h"
+#include "drv_generic.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
 #endif
 
 
-/* structure for storing all relevant data of a single timer group */
-typedef struct TIMER_GROUP {
-    /* pointer to the group's triggering interval in milliseconds;
-       this will be used to identify a specific timer group and also
-       as callback data for the underlying generic timer */
-    int *interval;
-
-    /* marks timer group as being active (so it will get processed) or
-       inactive (which means the timer group has been deleted and its
-       allocated memory may be re-used) */
-    int active;
-} TIMER_GROUP;
-
-/* number of allocated timer group slots */
-int nTimerGroups = 0;
-
-/* pointer to memory allocated for storing the timer group slots */
-TIMER_GROUP *TimerGroups = NULL;
-
+struct TIMER_GROUP;
 
 /* structure for storing all relevant timer data of a single widget */
 typedef struct TIMER_GROUP_WIDGET {
@@ -104,281 +93,451 @@ typedef struct TIMER_GROUP_WIDGET {
        it will also be used to identify a specific widget */
     void *data;
 
-    /* specifies the timer's triggering interval in milliseconds; it
-       will also be used to identify a specific widget */
-    int interval;
-
     /* specifies whether the timer should trigger indefinitely until
        it is deleted (value of 0) or only once (all other values) */
     int one_shot;
 
     /* marks timer as being active (so it will get processed) or
-       inactive (which means the timer has been deleted and its
-       allocated memory may be re-used) */
+       inactive (which means the widget has been removed while its
+       group was being processed, and its slot will be released
+       afterwards) */
     int active;
+
+    /* the widget may be updated up to this many milliseconds late */
+    int slack;
+
+    /* the timer group this widget belongs to, and the widget's
+       position in the group's widget list */
+    struct TIMER_GROUP *group;
+    int index;
 } TIMER_GROUP_WIDGET;
 
-/* number of allocated widget slots */
-int nTimerGroupWidgets = 0;
 
-/* pointer to memory allocated for storing the widget slots */
-TIMER_GROUP_WIDGET *TimerGroupWidgets = NULL;
+/* structure for storing all relevant data of a single timer group */
+typedef struct TIMER_GROUP {
+    /* the group's triggering interval in milliseconds; this will be
+       used to identify a specific timer group */
+    int interval;
+
+    /* handle of the underlying generic timer, which gets the group
+       itself as callback data */
+    int handle;
+
+    /* slack of the generic timer in milliseconds, or -1 for the
+       default slack */
+    int slack;
+
+    /* the group's widgets in the order they have been added; nActive
+       does not count widgets which have been removed while the group
+       was being processed */
+    int nWidgets;
+    int sWidgets;
+    int nActive;
+    TIMER_GROUP_WIDGET **Widgets;
+
+    /* set while the group's widgets are being processed, so that
+       removed widgets are only marked inactive */
+    int busy;
+} TIMER_GROUP;
+
+
+/* all timer groups, sorted by interval */
+static int nTimerGroups = 0;
+static int sTimerGroups = 0;
+static TIMER_GROUP **TimerGroups = NULL;
 
+/* all widgets, hashed by their data pointer (open addressing with
+   linear probing; the size is a power of 2 and at most half used) */
+static int nWidgetIndex = 0;
+static int sWidgetIndex = 0;
+static TIMER_GROUP_WIDGET **WidgetIndex = NULL;
 
-int timer_group_exists(const int interval)
-/*  Check whether a timer group for the specified interval exists.
+
+static int timer_group_find(const int interval, int *pos)
+/*  Binary search for the timer group of the specified interval.
 
     interval (integer): the sought-after triggering interval in
     milliseconds
 
-	return value (integer): returns a value of 1 if timer group
-	exists; otherwise returns a value of 0
+    pos (integer pointer): receives the position where a group with
+    this interval is (or would have to be inserted)
+
+	return value (integer): returns the group's position if the
+	timer group exists; otherwise returns a value of -1
 */
 {
-    int group;			/* current timer group's ID */
+    int lo = 0, hi = nTimerGroups;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (TimerGroups[mid]->interval < interval)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
 
-    /* loop through the timer group slots to search for one that
-       matches the specified interval */
-    for (group = 0; group < nTimerGroups; group++) {
-	/* skip inactive (i.e. deleted) timer groups */
-	if (TimerGroups[group].active == TIMER_INACTIVE)
-	    continue;
+    *pos = lo;
+
+    if (lo < nTimerGroups && TimerGroups[lo]->interval == interval)
+	return lo;
+
+    return -1;
+}
+
+
+static unsigned timer_index_hash(const void *data)
+{
+    /* Fibonacci hashing of the pointer, without its alignment bits */
+    return (unsigned) (((uintptr_t) data >> 3) * 2654435761u);
+}
+
+
+static int timer_index_find(void (*callback) (void *data), void *data)
+/*  Look up a widget in the widget index.
+
+	return value (integer): returns the widget's index slot, or -1 if
+	the widget does not exist
+*/
+{
+    unsigned mask, i;
+
+    if (sWidgetIndex == 0)
+	return -1;
+
+    mask = sWidgetIndex - 1;
+    for (i = timer_index_hash(data) & mask; WidgetIndex[i] != NULL; i = (i + 1) & mask) {
+	if (WidgetIndex[i]->data == data && WidgetIndex[i]->callback == callback)
+	    return i;
+    }
+
+    return -1;
+}
+
+
+static int timer_index_slot(TIMER_GROUP_WIDGET * widget)
+/*  Look up the index slot of a specific widget (there may be several
+	widgets with the same callback and data).
+
+	return value (integer): returns the widget's index slot, or -1 if
+	the widget is not indexed
+*/
+{
+    unsigned mask, i;
+
+    if (sWidgetIndex == 0)
+	return -1;
+
+    mask = sWidgetIndex - 1;
+    for (i = timer_index_hash(widget->data) & mask; WidgetIndex[i] != NULL; i = (i + 1) & mask) {
+	if (WidgetIndex[i] == widget)
+	    return i;
+    }
+
+    return -1;
+}
+
+
+static int timer_index_add(TIMER_GROUP_WIDGET * widget)
+/*  Add a widget to the widget index, growing the index if it would
+	be more than half full.
+
+	return value (integer): returns a value of 0 on success;
+	otherwise returns a value of -1
+*/
+{
+    unsigned mask, i;
+
+    if (2 * (nWidgetIndex + 1) > sWidgetIndex) {
+	TIMER_GROUP_WIDGET **old = WidgetIndex;
+	int n, size = sWidgetIndex ? 2 * sWidgetIndex : 64;
+
+	if ((WidgetIndex = calloc(size, sizeof(*WidgetIndex))) == NULL) {
+	    WidgetIndex = old;
+	    return -1;
+	}
 
-	if (*TimerGroups[group].interval == interval) {
-	    /* matching timer group found, so signal success by returning
-	       a value of 1 */
-	    return 1;
+	mask = size - 1;
+	for (n = 0; n < sWidgetIndex; n++) {
+	    if (old[n] == NULL)
+		continue;
+	    for (i = timer_index_hash(old[n]->data) & mask; WidgetIndex[i] != NULL; i = (i + 1) & mask);
+	    WidgetIndex[i] = old[n];
 	}
+
+	free(old);
+	sWidgetIndex = size;
     }
 
-    /* matching timer group not found, so signal failure by returning
-       a value of 0 */
+    mask = sWidgetIndex - 1;
+    for (i = timer_index_hash(widget->data) & mask; WidgetIndex[i] != NULL; i = (i + 1) & mask);
+    WidgetIndex[i] = widget;
+    nWidgetIndex++;
+
     return 0;
 }
 
 
-int timer_add_group(const int interval)
+static void timer_index_del(const int slot)
+/*  Remove the widget in the specified slot from the widget index;
+	following entries of the probe sequence are shifted back, so that
+	no tombstones are needed.
+*/
+{
+    unsigned mask = sWidgetIndex - 1;
+    unsigned i = slot, j = slot, k;
+
+    WidgetIndex[i] = NULL;
+    nWidgetIndex--;
+
+    while (1) {
+	j = (j + 1) & mask;
+	if (WidgetIndex[j] == NULL)
+	    break;
+	k = timer_index_hash(WidgetIndex[j]->data) & mask;
+	/* the entry at j may stay if its home slot k lies cyclically
+	   in (i, j] */
+	if ((i < j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	WidgetIndex[i] = WidgetIndex[j];
+	WidgetIndex[j] = NULL;
+	i = j;
+    }
+}
+
+
+static TIMER_GROUP *timer_add_group(const int interval)
 /*  Create a new timer group (unless it already exists) and link it to
 	the timer queue.
 
 	interval (integer): the new timer group's triggering interval in
 	milliseconds
 
-	return value (integer): returns a value of 0 on successful timer
-	group creation; otherwise returns a value of -1
+	return value (pointer): returns the timer group, or NULL if it
+	could not be created
 */
 {
-    /* if timer group for update interval already exists, signal
-       success by returning a value of 0 */
-    if (timer_group_exists(interval))
-	return 0;
+    TIMER_GROUP *group;
+    char name[32];
+    int pos;
+
+    /* if timer group for update interval already exists, return it */
+    if (timer_group_find(interval, &pos) >= 0)
+	return TimerGroups[pos];
 
     /* display an info message to inform the user that a new timer
        group is being created */
     info("Creating new timer group (%d ms)", interval);
 
-    int group;			/* current timer group's ID */
+    if (nTimerGroups >= sTimerGroups) {
+	int size = sTimerGroups ? 2 * sTimerGroups : 8;
+	TIMER_GROUP **tmp;
 
-    /* try to minimize memory usage by looping through timer group
-       slots and looking for an inactive timer group */
-    for (group = 0; group < nTimerGroups; group++) {
-	if (TimerGroups[group].active == TIMER_INACTIVE) {
-	    /* we've just found one, so let's reuse it ("group" holds its
-	       ID) by breaking the loop */
-	    debug("Reusing Timergroup %i", group);
-	    break;
+	if ((tmp = realloc(TimerGroups, size * sizeof(*TimerGroups))) == NULL) {
+	    error("Error expanding TimerGroups");
+	    return NULL;
 	}
+	TimerGroups = tmp;
+	sTimerGroups = size;
     }
 
-    /* no inactive timer groups (or none at all) found, so we have to
-       add a new timer group slot */
-    if (group == nTimerGroups) {
-	TIMER_GROUP *tmp;
+    if ((group = calloc(1, sizeof(*group))) == NULL) {
+	error("Error allocating timer group");
+	return NULL;
+    }
 
-	if ((tmp = realloc(TimerGroups, (nTimerGroups + 1) * sizeof(*TimerGroups))) == NULL) {
-	    error("Error expanding TimerGroups");
-	    /* signal unsuccessful timer group creation */
-	    return -1;
-	}
-	TimerGroups = tmp;
-	nTimerGroups++;
+    group->interval = interval;
+    group->slack = -1;
 
-	if ((TimerGroups[group].interval = malloc(sizeof(int))) == NULL) {
-	    /* signal unsuccessful timer group creation */
-	    return -1;
-	}
+    /* finally, request a generic timer that calls this group */
+    group->handle = timer_add(timer_process_group, group, interval, 0);
+    if (group->handle < 0) {
+	free(group);
+	return NULL;
     }
 
-    /* initialize timer group's interval */
-    *TimerGroups[group].interval = interval;
+    /* the group's dispatch statistics are the ones of its timer */
+    snprintf(name, sizeof(name), "group:%d", interval);
+    timer_set_name(group->handle, name);
 
-    /* set timer group to active so that it is processed and not
-       overwritten by the memory optimization routine above */
-    TimerGroups[group].active = TIMER_ACTIVE;
+    /* keep the groups sorted by interval */
+    memmove(TimerGroups + pos + 1, TimerGroups + pos, (nTimerGroups - pos) * sizeof(*TimerGroups));
+    TimerGroups[pos] = group;
+    nTimerGroups++;
 
-    /* finally, request a generic timer that calls this group and
-       signal success or failure */
-    return timer_add(timer_process_group, TimerGroups[group].interval, interval, 0);
+    return group;
 }
 
 
-int timer_remove_group(const int interval)
+static int timer_remove_group(TIMER_GROUP * group)
 /*  Remove a timer group and unlink it from the timer queue (also
-	removes all remaining widget slots in this timer group).
+	removes all remaining widgets in this timer group).
 
-	interval (integer): triggering interval in milliseconds; here, it
-    will be used to identify the timer group
+	group (pointer): the timer group to remove
 
 	return value (integer): returns a value of 0 on successful timer
 	group removal; otherwise returns a value of -1
 */
 {
+    int pos, widget, slot;
+
     /* display an info message to inform the user that a timer group
        is being removed */
-    info("Removing timer group (%d ms)", interval);
+    info("Removing timer group (%d ms)", group->interval);
 
-    int group;			/* current timer group's ID */
-    int widget;			/* current widget's ID */
+    if (timer_group_find(group->interval, &pos) < 0 || TimerGroups[pos] != group)
+	return -1;
 
-    /* loop through the widget slots to look for remaining widgets
-       with the specified update interval */
-    for (widget = 0; widget < nTimerGroupWidgets; widget++) {
-	/* skip inactive (i.e. deleted) widget slots */
-	if (TimerGroupWidgets[widget].active == TIMER_INACTIVE)
-	    continue;
+    nTimerGroups--;
+    memmove(TimerGroups + pos, TimerGroups + pos + 1, (nTimerGroups - pos) * sizeof(*TimerGroups));
 
-	if (TimerGroupWidgets[widget].interval == interval) {
-	    /* we have found a matching widget slot, so mark it as being
-	       inactive; we will not actually delete the slot, so its
-	       allocated memory may be re-used */
-	    TimerGroupWidgets[widget].active = TIMER_INACTIVE;
-	}
+    /* release remaining widgets */
+    for (widget = 0; widget < group->nWidgets; widget++) {
+	if ((slot = timer_index_slot(group->Widgets[widget])) >= 0)
+	    timer_index_del(slot);
+	free(group->Widgets[widget]);
     }
+    free(group->Widgets);
 
-    /* loop through timer group slots and try to find the specified
-       timer group slot by looking for its settings */
-    for (group = 0; group < nTimerGroups; group++) {
-	/* skip inactive (i.e. deleted) timer groups */
-	if (TimerGroups[group].active == TIMER_INACTIVE)
-	    continue;
+    /* remove the generic timer that calls this group and signal
+       success or failure */
+    pos = timer_cancel(group->handle);
+    free(group);
 
-	if (*TimerGroups[group].interval == interval) {
-	    /* we have found the timer group slot, so mark it as being
-	       inactive; we will not actually delete the slot, so its
-	       allocated memory may be re-used */
-	    TimerGroups[group].active = TIMER_INACTIVE;
-
-	    /* remove the generic timer that calls this group */
-	    if (timer_remove(timer_process_group, &TimerGroups[group].interval)) {
-		/* signal successful removal of timer group */
-		return 0;
-	    } else {
-		/* an error occurred on generic timer removal, so signal
-		   failure by returning a value of -1 */
-		return -1;
-	    }
-	}
+    return pos;
+}
+
+
+static void timer_release_widget(TIMER_GROUP_WIDGET * widget)
+/*  Remove a widget from its timer group's widget list; the last
+	widget of the list takes its place.
+*/
+{
+    TIMER_GROUP *group = widget->group;
+
+    group->Widgets[widget->index] = group->Widgets[--group->nWidgets];
+    group->Widgets[widget->index]->index = widget->index;
+    free(widget);
+}
+
+
+static void timer_update_slack(TIMER_GROUP * group)
+/*  Recompute the smallest slack of a group's active widgets and hand
+	it to the group's timer, so that the timer becomes lax again once
+	the widget with the tightest slack is gone.
+*/
+{
+    int widget, slack = -1;
+
+    for (widget = 0; widget < group->nWidgets; widget++) {
+	TIMER_GROUP_WIDGET *w = group->Widgets[widget];
+	if (w->active == TIMER_ACTIVE && (slack < 0 || w->slack < slack))
+	    slack = w->slack;
     }
 
-    /* we have NOT found the timer group slot, so signal failure by
-       returning a value of -1 */
-    return -1;
+    if (slack != group->slack) {
+	group->slack = slack;
+	timer_set_slack(group->handle, slack);
+    }
 }
 
 
-int timer_remove_empty_group(const int interval)
-/*  Remove timer group *only* if it contains no more widget slots.
+static int timer_drop_widget(TIMER_GROUP_WIDGET * widget)
+/*  Remove a widget from the widget index and from its timer group
+	(also removes the timer group if it is empty). While the group
+	is being processed, the widget is only marked as inactive.
 
-	interval (integer): triggering interval in milliseconds; here, it
-    will be used to identify the timer group
+	widget (pointer): the widget to remove
 
 	return value (integer): returns a value of 0 on successful
 	processing; otherwise returns a value of -1
 */
 {
-    int widget;			/* current widget's ID */
+    TIMER_GROUP *group = widget->group;
+    int slot;
 
-    /* loop through the widget slots to look for widgets with the
-       specified update interval */
-    for (widget = 0; widget < nTimerGroupWidgets; widget++) {
-	/* skip inactive (i.e. deleted) widget slots */
-	if (TimerGroupWidgets[widget].active == TIMER_INACTIVE)
-	    continue;
+    if ((slot = timer_index_slot(widget)) >= 0)
+	timer_index_del(slot);
+    widget->active = TIMER_INACTIVE;
+    group->nActive--;
 
-	/* at least one other widget with specified update interval
-	   exists, so signal success by returning a value of 0 */
-	if (TimerGroupWidgets[widget].interval == interval)
-	    return 0;
-    }
+    /* the group's timer may have been held back by this widget */
+    if (group->nActive > 0 && widget->slack == group->slack)
+	timer_update_slack(group);
 
-    /* no other widgets with specified update interval exist, so
-       remove corresponding timer group and signal success or
-       failure */
-    return timer_remove_group(interval);
+    /* timer_process_group() cleans up after itself */
+    if (group->busy)
+	return 0;
+
+    timer_release_widget(widget);
+
+    if (group->nActive == 0)
+	return timer_remove_group(group);
+
+    return 0;
 }
 
 
 void timer_process_group(void *data)
-/*  Process all widgets of a timer group; if the timer group only
-	contains one-shot timers, it will be deleted after processing.
+/*  Process all widgets of a timer group as one batch; if the timer
+	group only contains one-shot timers, it will be deleted after
+	processing.
+
+	While the batch runs, the widgets draw into the layout framebuffer
+	only, and the generic driver transfers the damaged region to the
+	display once at the end of the batch.
 
-	data (void pointer): points to an integer holding the triggering
-    interval in milliseconds; here, it will be used to identify the
-    timer group
+	data (void pointer): points to the timer group
 
 	return value: void
 */
 {
-    int widget;			/* current widget's ID */
-
-    /* convert callback data to integer (triggering interval in
-       milliseconds) */
-    int interval = *((int *) data);
-
-    /* sanity check; by now, at least one timer group should be
-       instantiated */
-    if (nTimerGroups <= 0) {
-	/* otherwise, print an error and return early */
-	error("Huh? Not even a single timer group to process? Dazed and confused...");
-	return;
-    }
+    TIMER_GROUP *group = data;
+    int widget, nWidgets;
 
-    /* sanity check; by now, at least one widget slot should be
-       instantiated */
-    if (nTimerGroupWidgets <= 0) {
-	/* otherwise, print an error and return early */
-	error("Huh? Not even a single widget slot to process? Dazed and confused...");
-	return;
-    }
+    /* widgets added by a callback will be processed next time */
+    nWidgets = group->nWidgets;
+    group->busy = 1;
+
+    if (drv_generic_batch_begin)
+	drv_generic_batch_begin();
 
-    /* loop through widgets and search for those matching the timer
-       group's update interval */
-    for (widget = 0; widget < nTimerGroupWidgets; widget++) {
-	/* skip inactive (i.e. deleted) widgets */
-	if (TimerGroupWidgets[widget].active == TIMER_INACTIVE)
+    for (widget = 0; widget < nWidgets; widget++) {
+	TIMER_GROUP_WIDGET *w = group->Widgets[widget];
+
+	/* skip widgets removed during this batch */
+	if (w->active == TIMER_INACTIVE)
 	    continue;
 
-	/* the current widget belongs to the specified timer group */
-	if (TimerGroupWidgets[widget].interval == interval) {
-	    /* if the widget's callback function has been set, call it and
-	       pass the corresponding data */
-	    if (TimerGroupWidgets[widget].callback != NULL)
-		TimerGroupWidgets[widget].callback(TimerGroupWidgets[widget].data);
-
-	    /* mark one-shot widget as inactive (which means the it has
-	       been deleted and its allocated memory may be re-used) */
-	    if (TimerGroupWidgets[widget].one_shot) {
-		TimerGroupWidgets[widget].active = TIMER_INACTIVE;
-
-		/* also remove the corresponding timer group if it is empty */
-		timer_remove_empty_group(interval);
-	    }
-	}
+	/* if the widget's callback function has been set, call it and
+	   pass the corresponding data */
+	if (w->callback != NULL)
+	    w->callback(w->data);
+
+	/* one-shot widgets are removed after they have been processed
+	   (unless the callback did so already) */
+	if (w->one_shot && w->active == TIMER_ACTIVE)
+	    timer_drop_widget(w);
+    }
+
+    if (drv_generic_batch_end)
+	drv_generic_batch_end();
+
+    group->busy = 0;
+
+    /* release widgets which have been removed during the batch */
+    for (widget = group->nWidgets - 1; widget >= 0; widget--) {
+	if (group->Widgets[widget]->active == TIMER_INACTIVE)
+	    timer_release_widget(group->Widgets[widget]);
     }
+
+    /* also remove the timer group if it is empty */
+    if (group->nActive == 0)
+	timer_remove_group(group);
 }
 
 
-int timer_add_widget(void (*callback) (void *data), void *data, const int interval, const int one_shot)
+int timer_add_widget(void (*callback) (void *data), void *data, const int interval, const int one_shot,
+		     const int slack)
 /*  Add widget to timer group of the specified update interval
     (also creates a new timer group if necessary).
 
@@ -397,55 +556,65 @@ int timer_add_widget(void (*callback) (void *data), void *data, const int interv
 	indefinitely until it is deleted (value of 0) or only once (all
 	other values)
 
+	slack (integer): the widget may be updated up to this many
+	milliseconds late, so its update can share a wake-up with others
+
 	return value (integer): returns a value of 0 on successful widget
 	addition; otherwise returns a value of -1
 */
 {
-    int widget;			/* current widget's ID */
+    TIMER_GROUP *group;
+    TIMER_GROUP_WIDGET *widget;
 
-    /* if no timer group for update interval exists, create one */
-    if (!timer_group_exists(interval)) {
-	/* creation of new timer group failed, so signal failure by
-	   returning a value of -1 */
-	if (timer_add_group(interval) != 0)
-	    return -1;
-    }
+    /* find or create the timer group for the update interval */
+    if ((group = timer_add_group(interval)) == NULL)
+	return -1;
 
-    /* try to minimize memory usage by looping through the widget
-       slots and looking for an inactive widget slot */
-    for (widget = 0; widget < nTimerGroupWidgets; widget++) {
-	if (TimerGroupWidgets[widget].active == TIMER_INACTIVE) {
-	    /* we've just found one, so let's reuse it ("widget" holds its
-	       ID) by breaking the loop */
-	    break;
-	}
-    }
+    if (group->nWidgets >= group->sWidgets) {
+	int size = group->sWidgets ? 2 * group->sWidgets : 8;
+	TIMER_GROUP_WIDGET **tmp;
 
-    /* no inactive widget slots (or none at all) found, so we have to
-       add a new widget slot */
-    if (widget == nTimerGroupWidgets) {
-	TIMER_GROUP_WIDGET *tmp;
+	if ((tmp = realloc(group->Widgets, size * sizeof(*group->Widgets))) == NULL)
+	    goto fail;
+	group->Widgets = tmp;
+	group->sWidgets = size;
+    }
 
-	if ((tmp = realloc(TimerGroupWidgets, (nTimerGroupWidgets + 1) * sizeof(*TimerGroupWidgets))) == NULL) {
-	    /* signal unsuccessful creation of widget slot */
-	    return -1;
-	}
-	TimerGroupWidgets = tmp;
-	nTimerGroupWidgets++;
+    if ((widget = malloc(sizeof(*widget))) == NULL)
+	goto fail;
+
+    /* initialize widget */
+    widget->callback = callback;
+    widget->data = data;
+    widget->one_shot = one_shot;
+    widget->active = TIMER_ACTIVE;
+    widget->slack = slack;
+    widget->group = group;
+    widget->index = group->nWidgets;
+
+    if (timer_index_add(widget) < 0) {
+	free(widget);
+	goto fail;
     }
 
-    /* initialize widget slot */
-    TimerGroupWidgets[widget].callback = callback;
-    TimerGroupWidgets[widget].data = data;
-    TimerGroupWidgets[widget].interval = interval;
-    TimerGroupWidgets[widget].one_shot = one_shot;
+    group->Widgets[group->nWidgets++] = widget;
+    group->nActive++;
 
-    /* set widget slot to active so that it is processed and not
-       overwritten by the memory optimization routine above */
-    TimerGroupWidgets[widget].active = TIMER_ACTIVE;
+    /* the group's timer must not be later than any of its widgets
+       allows */
+    if (group->slack < 0 || slack < group->slack) {
+	group->slack = slack;
+	timer_set_slack(group->handle, slack);
+    }
 
-    /* signal successful addition of widget slot */
+    /* signal successful addition of widget */
     return 0;
+
+  fail:
+    /* do not leave an empty group behind */
+    if (group->nActive == 0 && !group->busy)
+	timer_remove_group(group);
+    return -1;
 }
 
 
@@ -463,39 +632,17 @@ int timer_remove_widget(void (*callback) (void *data), void *data)
 	removal; otherwise returns a value of -1
 */
 {
-    int widget;			/* current widget's ID */
-    int interval = -1;		/* specified widget's triggering interval in
-				   milliseconds */
-
-    /* loop through the widget slots and try to find the specified
-       widget slot by looking for its settings */
-    for (widget = 0; widget < nTimerGroupWidgets; widget++) {
-	/* skip inactive (i.e. deleted) widget slots */
-	if (TimerGroupWidgets[widget].active == TIMER_INACTIVE)
-	    continue;
-
-	if (TimerGroupWidgets[widget].callback == callback && TimerGroupWidgets[widget].data == data) {
-	    /* we have found the widget slot, so mark it as being
-	       inactive; we will not actually delete the slot, so its
-	       allocated memory may be re-used */
-	    TimerGroupWidgets[widget].active = TIMER_INACTIVE;
-
-	    /* store the widget's triggering interval for later use and
-	       break the loop */
-	    interval = TimerGroupWidgets[widget].interval;
-	    break;
-	}
-    }
+    int slot;
 
     /* if no matching widget was found, signal an error by returning
        a value of -1 */
-    if (interval < 0)
+    if ((slot = timer_index_find(callback, data)) < 0)
 	return -1;
 
     /* if no other widgets with specified update interval exist,
        remove corresponding timer group and signal success or
        failure */
-    return timer_remove_empty_group(interval);
+    return timer_drop_widget(WidgetIndex[slot]);
 }
 
 
@@ -506,33 +653,17 @@ void timer_exit_group(void)
 	return value: void
 */
 {
-    int group;			/* current timer group's ID */
-
-    /* loop through all timer groups and remove them one by one */
-    for (group = 0; group < nTimerGroups; group++) {
-	/* remove generic timer */
-	timer_remove(timer_process_group, TimerGroups[group].interval);
-
-	/* free memory allocated for callback data (i.e. the group's
-	   triggering interval in milliseconds) */
-	free(TimerGroups[group].interval);
-    }
-
-    /* reset number of allocated timer groups */
-    nTimerGroups = 0;
-
-    /* free allocated memory containing the timer group slots */
-    if (TimerGroups != NULL) {
-	free(TimerGroups);
-	TimerGroups = NULL;
-    }
-
-    /* reset number of allocated widget slots */
-    nTimerGroupWidgets = 0;
-
-    /* free allocated memory containing the widget slots */
-    if (TimerGroupWidgets != NULL) {
-	free(TimerGroupWidgets);
-	TimerGroupWidgets = NULL;
-    }
+    /* remove the timer groups one by one, this also releases their
+       widgets */
+    while (nTimerGroups > 0)
+	timer_remove_group(TimerGroups[nTimerGroups - 1]);
+
+    free(TimerGroups);
+    TimerGroups = NULL;
+    sTimerGroups = 0;
+
+    free(WidgetIndex);
+    WidgetIndex = NULL;
+    nWidgetIndex = 0;
+    sWidgetIndex = 0;
 }
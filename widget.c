@@ -160,6 +160,7 @@ int widget_add(const char *name, const int type, const int layer, const int row,
     char *section;
     char *class;
     int fg_valid, bg_valid;
+    int slack;
     RGBA FG, BG;
 
     WIDGET_CLASS *Class;
@@ -186,6 +187,10 @@ int widget_add(const char *name, const int type, const int layer, const int row,
     fg_valid = widget_color(section, name, "foreground", &FG);
     bg_valid = widget_color(section, name, "background", &BG);
 
+    /* get widget timer slack, defaults to 'Timer.slack' */
+    cfg_number("Timer", "slack", 0, 0, -1, &slack);
+    cfg_number(section, "slack", slack, 0, -1, &slack);
+
     free(section);
 
     /* lookup widget class */
@@ -265,6 +270,7 @@ int widget_add(const char *name, const int type, const int layer, const int row,
     Widget->layer = layer;
     Widget->row = row;
     Widget->col = col;
+    Widget->slack = slack;
 
     if (Class->init != NULL) {
 	Class->init(Widget);
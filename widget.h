@@ -58,6 +58,7 @@ typedef struct WIDGET {
     void *data;
     int x2;			/* x of opposite corner, -1 for no display widget */
     int y2;			/* y of opposite corner, -1 for no display widget */
+    int slack;			/* updates may be late by this many msec */
 } WIDGET;
 
 
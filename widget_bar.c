@@ -204,7 +204,7 @@ int widget_bar_init(WIDGET * Self)
     free(section);
     Self->data = Bar;
 
-    timer_add_widget(widget_bar_update, Self, Bar->update, 0);
+    timer_add_widget(widget_bar_update, Self, Bar->update, 0, Self->slack);
 
     return 0;
 }
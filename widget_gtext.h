@@ -38,6 +38,8 @@ typedef struct WIDGET_GTEXT {
     PROPERTY value;		/* value of text widget */
     PROPERTY style;		/* text style (plain/bold/slant) */
     char *string;		/* formatted value */
+    int size;			/* allocated size of string */
+    char *number;		/* formatted number with 'width+1' bytes */
     int value_x_skip;
     int value_x_off;
     int postfix_x_off;
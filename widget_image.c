@@ -270,35 +270,41 @@ static void widget_image_update(void *Self)
 {
 	WIDGET *W = (WIDGET *) Self;
 	WIDGET_IMAGE *Image = W->data;
+	int update = 1;
 
 	/* process the parent only */
 	if (W->parent == NULL)
 	{
 
 		/* evaluate properties */
-		property_eval(&Image->file);
-		property_eval(&Image->scale);
-		property_eval(&Image->_width);
-		property_eval(&Image->_height);
-		property_eval(&Image->update);
-		property_eval(&Image->reload);
-		property_eval(&Image->visible);
-		property_eval(&Image->inverted);
-		property_eval(&Image->center);
-
-		/* render image into bitmap */
-		widget_image_render(W->name, Image);
+		update = 0;
+		update += property_eval(&Image->file);
+		update += property_eval(&Image->scale);
+		update += property_eval(&Image->_width);
+		update += property_eval(&Image->_height);
+		update += property_eval(&Image->update);
+		update += property_eval(&Image->reload);
+		update += property_eval(&Image->visible);
+		update += property_eval(&Image->inverted);
+		update += property_eval(&Image->center);
+
+		/* render image into bitmap, unless nothing has changed */
+		if (update || Image->gdImage == NULL || P2N(&Image->reload))
+		{
+			widget_image_render(W->name, Image);
+			update = 1;
+		}
 
 	}
 
 	/* finally, draw it! */
-	if (W->class->draw)
+	if (update && W->class->draw)
 		W->class->draw(W);
 
 	/* add a new one-shot timer */
 	if (P2N(&Image->update) > 0)
 	{
-		timer_add_widget(widget_image_update, Self, P2N(&Image->update), 1);
+		timer_add_widget(widget_image_update, Self, P2N(&Image->update), 1, W->slack);
 	}
 }
 
@@ -42,6 +42,7 @@
 
 #include "debug.h"
 #include "cfg.h"
+#include "qprintf.h"
 #include "evaluator.h"
 #include "property.h"
 #include "timer.h"
@@ -232,49 +233,30 @@ void widget_text_update(void *Self)
     update += property_eval(&T->style);
 
     /* evaluate value */
-    property_eval(&T->value);
+    /* nothing to do if neither value nor labels have changed */
+    if (property_eval(&T->value) == 0 && update == 0 && T->string != NULL)
+	return;
 
     /* string or number? */
     if (T->precision == 0xDEAD) {
-	string = strdup(P2S(&T->value));
+	string = P2S(&T->value);
     } else {
-	double number = P2N(&T->value);
+	/* reduce precision or display '*****' if the number does not fit */
 	int width = T->width - strlen(P2S(&T->prefix)) - strlen(P2S(&T->postfix));
-	int precision = T->precision;
-	/* print zero bytes so we can specify NULL as target  */
-	/* and get the length of the resulting string */
-	int size = snprintf(NULL, 0, "%.*f", precision, number);
-	/* number does not fit into field width: try to reduce precision */
-	if (width < 0)
-	    width = 0;
-	if (size > width && precision > 0) {
-	    int delta = size - width;
-	    if (delta > precision)
-		delta = precision;
-	    precision -= delta;
-	    size -= delta;
-	    /* zero precision: omit decimal point, too */
-	    if (precision == 0)
-		size--;
-	}
-	/* number still doesn't fit: display '*****'  */
-	if (size > width) {
-	    string = malloc(width + 1);
-	    memset(string, '*', width);
-	    *(string + width) = '\0';
-	} else {
-	    string = malloc(size + 1);
-	    snprintf(string, size + 1, "%.*f", precision, number);
-	}
+	qftoa_width(T->number, T->width + 1, P2N(&T->value), T->precision, width);
+	string = T->number;
     }
 
     /* did the formatted string change? */
     if (T->string == NULL || strcmp(T->string, string) != 0) {
+	int len = strlen(string);
 	update++;
-	free(T->string);
-	T->string = string;
-    } else {
-	free(string);
+	/* reuse the buffer if it is large enough */
+	if (len >= T->size) {
+	    T->size = len + 1;
+	    T->string = realloc(T->string, T->size);
+	}
+	memcpy(T->string, string, len + 1);
     }
 
     /* something has changed and should be updated */
@@ -401,13 +383,17 @@ int widget_text_init(WIDGET * Self)
     /* buffer */
     Text->buffer = malloc(Text->width + 1);
 
+    /* formatted number */
+    if (Text->precision != 0xDEAD)
+	Text->number = malloc(Text->width + 1);
+
     free(section);
     Self->data = Text;
     Self->x2 = Self->col + Text->width;
     Self->y2 = Self->row;
 
     /* add update timer, use one-shot if 'update' is zero */
-    timer_add_widget(widget_text_update, Self, Text->update, Text->update == 0);
+    timer_add_widget(widget_text_update, Self, Text->update, Text->update == 0, Self->slack);
 
     /* a marquee scroller has its own timer and callback */
     if (Text->align == ALIGN_MARQUEE || Text->align == ALIGN_AUTOMATIC || Text->align == ALIGN_PINGPONG_LEFT
@@ -430,6 +416,7 @@ int widget_text_quit(WIDGET * Self)
 	    property_free(&Text->postfix);
 	    property_free(&Text->style);
 	    free(Text->string);
+	    free(Text->number);
 	    free(Text->buffer);
 	    free(Self->data);
 	    Self->data = NULL;
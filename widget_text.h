@@ -41,6 +41,8 @@ typedef struct WIDGET_TEXT {
     PROPERTY value;		/* value of text widget */
     PROPERTY style;		/* text style (plain/bold/slant) */
     char *string;		/* formatted value */
+    int size;			/* allocated size of string */
+    char *number;		/* formatted number with 'width+1' bytes */
     char *buffer;		/* string with 'width+1' bytes allocated  */
     int width;			/* field width */
     int precision;		/* number of digits after the decimal point */
@@ -72,7 +72,7 @@ void widget_timer_update(void *Self)
     }
 
     /* add a new one-shot timer */
-    timer_add(widget_timer_update, Self, update, 1);
+    timer_set_slack(timer_add(widget_timer_update, Self, update, 1), W->slack);
 }
 
 
@@ -294,7 +294,7 @@ static void widget_ttf_update(void *Self)
 	/* add a new one-shot timer */
 	if (P2N(&Image->update) > 0)
 	{
-		timer_add_widget(widget_ttf_update, Self, P2N(&Image->update), 1);
+		timer_add_widget(widget_ttf_update, Self, P2N(&Image->update), 1, W->slack);
 	}
 }
 
@@ -389,9 +389,9 @@ int widget_ttf_quit(WIDGET * Self)
 				property_free(&Image->visible);
 				property_free(&Image->inverted);
 				property_free(&Image->center);
-				property_eval(&Image->_width);
-				property_eval(&Image->_height);
-				property_eval(&Image->align);
+				property_free(&Image->_width);
+				property_free(&Image->_height);
+				property_free(&Image->align);
 
 				free(Self->data);
 				Self->data = NULL;